@@ -47,7 +47,7 @@ private:
       if (!ec) {
         do_write(length);
       } else {
-        if (ec.value() != SEC_I_CONTEXT_EXPIRED) { // SEC_I_CONTEXT_EXPIRED means the client shutdown the TLS channel
+        if (ec != boost::asio::error::eof) { // EOF means the client shutdown the TLS channel
           std::cerr << "Read failed: " << ec.message() << "\n";
         }
       }
@@ -0,0 +1,279 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "certificate.hpp"
+
+#include <boost/wintls.hpp>
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::tcp;
+
+// Fixed size buffers reused by the sessions of a single shard. As
+// every shard is only ever run by one thread no locking is needed.
+class buffer_pool {
+public:
+  using buffer_type = std::array<char, 16 * 1024>;
+
+  std::unique_ptr<buffer_type> acquire() {
+    if (free_.empty()) {
+      return std::make_unique<buffer_type>();
+    }
+    auto buffer = std::move(free_.back());
+    free_.pop_back();
+    return buffer;
+  }
+
+  void release(std::unique_ptr<buffer_type> buffer) {
+    free_.push_back(std::move(buffer));
+  }
+
+private:
+  std::vector<std::unique_ptr<buffer_type>> free_;
+};
+
+// An io_context run by a single thread together with the state only
+// accessed from that thread. The io_context is declared last so any
+// sessions owned by pending handlers are destroyed before the pool.
+struct shard {
+  buffer_pool buffers;
+  std::atomic<std::uint64_t> bytes_echoed{0};
+  std::atomic<std::uint64_t> sessions{0};
+  boost::asio::io_context io_context{1};
+};
+
+class session : public std::enable_shared_from_this<session> {
+public:
+  session(boost::wintls::stream<tcp::socket> stream, shard& owner)
+    : stream_(std::move(stream))
+    , shard_(owner)
+    , data_(shard_.buffers.acquire()) {
+    ++shard_.sessions;
+  }
+
+  ~session() {
+    --shard_.sessions;
+    shard_.buffers.release(std::move(data_));
+  }
+
+  void start() {
+    do_handshake();
+  }
+
+private:
+  void do_handshake() {
+    auto self(shared_from_this());
+    stream_.async_handshake(boost::wintls::handshake_type::server,
+                            [this, self](const boost::system::error_code& ec) {
+      if (!ec) {
+        do_read();
+      } else {
+        std::cerr << "Handshake failed: " << ec.message() << "\n";
+      }
+    });
+  }
+
+  void do_read() {
+    auto self(shared_from_this());
+    stream_.async_read_some(boost::asio::buffer(*data_),
+                            [this, self](const boost::system::error_code& ec, std::size_t length) {
+      if (!ec) {
+        do_write(length);
+      } else {
+        if (ec != boost::asio::error::eof) { // EOF means the client shutdown the TLS channel
+          std::cerr << "Read failed: " << ec.message() << "\n";
+        }
+      }
+    });
+  }
+
+  void do_write(std::size_t length) {
+    auto self(shared_from_this());
+    boost::asio::async_write(stream_, boost::asio::buffer(*data_, length),
+                             [this, self](const boost::system::error_code& ec, std::size_t length) {
+      if (!ec) {
+        shard_.bytes_echoed.fetch_add(length, std::memory_order_relaxed);
+        do_read();
+      } else {
+        std::cerr << "Write failed: " << ec.message() << "\n";
+      }
+    });
+  }
+
+  boost::wintls::stream<tcp::socket> stream_;
+  shard& shard_;
+  std::unique_ptr<buffer_pool::buffer_type> data_;
+};
+
+class server {
+public:
+  server(boost::asio::io_context& io_context, unsigned short port, std::size_t shard_count)
+    : io_context_(io_context)
+    , acceptor_(io_context, tcp::endpoint(tcp::v4(), port))
+    , report_timer_(io_context)
+    , context_(boost::wintls::method::system_default)
+    , private_key_name_("wintls-sharded-echo-server-example") {
+
+    // Convert X509 PEM bytes to Windows CERT_CONTEXT
+    auto certificate = boost::wintls::x509_to_cert_context(boost::asio::buffer(x509_certificate),
+                                                           boost::wintls::file_format::pem);
+
+    // Import RSA private key into the default cryptographic provider
+    boost::system::error_code ec;
+    boost::wintls::import_private_key(boost::asio::buffer(rsa_key),
+                                      boost::wintls::file_format::pem,
+                                      private_key_name_,
+                                      ec);
+
+    // If the key already exists, assume it's the one already imported
+    // and ignore that error
+    if (ec && ec.value() != NTE_EXISTS) {
+      throw boost::system::system_error(ec);
+    }
+
+    // Use the imported private key for the certificate
+    boost::wintls::assign_private_key(certificate.get(), private_key_name_);
+
+    // The same context is shared by the streams of all shards
+    context_.use_certificate(certificate.get());
+
+    for (std::size_t i = 0; i < shard_count; ++i) {
+      shards_.push_back(std::make_unique<shard>());
+    }
+  }
+
+  ~server() {
+    // Remove the imported private key. Most real applications
+    // probably only want to import the key once and most likely not
+    // in the server code. This is just for demonstration purposes.
+    boost::system::error_code ec;
+    boost::wintls::delete_private_key(private_key_name_, ec);
+  }
+
+  void run() {
+    // Keep the shards running even when they have no sessions
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work;
+    for (auto& s : shards_) {
+      work.push_back(boost::asio::make_work_guard(s->io_context));
+      threads_.emplace_back([&s] { s->io_context.run(); });
+    }
+
+    do_accept();
+    do_report();
+    io_context_.run();
+
+    work.clear();
+    for (auto& s : shards_) {
+      s->io_context.stop();
+    }
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+private:
+  // Windows does not load balance connections between sockets bound to
+  // the same port like SO_REUSEPORT does on other platforms, so a
+  // single acceptor hands out connections to the shards in a round
+  // robin fashion. Accepting directly onto the io_context of the shard
+  // ensures all I/O for a connection is done by that shard only.
+  void do_accept() {
+    auto& next_shard = *shards_[next_shard_++ % shards_.size()];
+    acceptor_.async_accept(next_shard.io_context,
+                           [this, &next_shard](const boost::system::error_code& ec, tcp::socket socket) {
+      if (!ec) {
+        // Create the session on the thread running the shard as the
+        // buffer pool of the shard is not thread safe
+        boost::asio::post(next_shard.io_context, [this, &next_shard, socket = std::move(socket)]() mutable {
+          boost::wintls::stream<tcp::socket> stream(std::move(socket), context_);
+          std::make_shared<session>(std::move(stream), next_shard)->start();
+        });
+      } else {
+        std::cerr << "Accept failed: " << ec.message() << "\n";
+      }
+
+      do_accept();
+    });
+  }
+
+  void do_report() {
+    report_timer_.expires_after(report_interval);
+    report_timer_.async_wait([this](const boost::system::error_code& ec) {
+      if (ec) {
+        return;
+      }
+
+      const auto seconds = std::chrono::duration<double>(report_interval).count();
+      double total = 0;
+      std::cout << std::fixed << std::setprecision(2);
+      for (std::size_t i = 0; i < shards_.size(); ++i) {
+        const auto bytes = shards_[i]->bytes_echoed.exchange(0, std::memory_order_relaxed);
+        const auto mib_per_second = static_cast<double>(bytes) / seconds / (1024 * 1024);
+        total += mib_per_second;
+        std::cout << "shard " << i << ": " << shards_[i]->sessions << " sessions, "
+                  << mib_per_second << " MiB/s\n";
+      }
+      std::cout << "total: " << total << " MiB/s\n";
+
+      do_report();
+    });
+  }
+
+  static constexpr std::chrono::seconds report_interval{5};
+
+  boost::asio::io_context& io_context_;
+  tcp::acceptor acceptor_;
+  boost::asio::steady_timer report_timer_;
+  boost::wintls::context context_;
+  std::string private_key_name_;
+  std::vector<std::unique_ptr<shard>> shards_;
+  std::vector<std::thread> threads_;
+  std::size_t next_shard_ = 0;
+};
+
+constexpr std::chrono::seconds server::report_interval;
+
+int main(int argc, char* argv[]) {
+  try {
+    if (argc != 2 && argc != 3) {
+      std::cerr << "Usage: sharded_echo_server <port> [shards]\n";
+      return 1;
+    }
+
+    // Default to one shard per core
+    const auto shards = argc == 3 ? std::atoi(argv[2])
+                                  : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if (shards < 1) {
+      std::cerr << "The number of shards must be at least 1\n";
+      return 1;
+    }
+
+    boost::asio::io_context io_context{1};
+    server s(io_context, static_cast<std::uint16_t>(std::atoi(argv[1])), static_cast<std::size_t>(shards));
+
+    boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+    signals.async_wait([&io_context](const boost::system::error_code&, int) { io_context.stop(); });
+
+    s.run();
+  } catch (std::exception& e) {
+    std::cerr << "Exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
@@ -8,12 +8,24 @@
 #ifndef BOOST_WINTLS_HPP
 #define BOOST_WINTLS_HPP
 
+#include <boost/wintls/broadcaster.hpp>
 #include <boost/wintls/certificate.hpp>
 #include <boost/wintls/context.hpp>
 #include <boost/wintls/error.hpp>
 #include <boost/wintls/file_format.hpp>
 #include <boost/wintls/handshake_type.hpp>
+#include <boost/wintls/initialize.hpp>
 #include <boost/wintls/method.hpp>
+#include <boost/wintls/ocsp_stapler.hpp>
+#include <boost/wintls/record_buffer.hpp>
+#include <boost/wintls/relay.hpp>
+#include <boost/wintls/relay_statistics.hpp>
+#include <boost/wintls/shutdown_mode.hpp>
 #include <boost/wintls/stream.hpp>
+#include <boost/wintls/stream_statistics.hpp>
+#include <boost/wintls/stream_timeouts.hpp>
+#include <boost/wintls/timer_wheel.hpp>
+#include <boost/wintls/traffic_keys.hpp>
+#include <boost/wintls/trust_store.hpp>
 
 #endif // BOOST_WINTLS_HPP
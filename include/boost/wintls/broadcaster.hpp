@@ -0,0 +1,385 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_BROADCASTER_HPP
+#define BOOST_WINTLS_BROADCASTER_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/error.hpp>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+
+/// Counters describing the messages sent by a @ref broadcaster.
+struct broadcast_statistics {
+  /// The number of messages published.
+  std::uint64_t published = 0;
+
+  /// The number of messages completely written to a subscriber.
+  std::uint64_t delivered = 0;
+
+  /// The number of bytes of messages written to subscribers.
+  std::uint64_t bytes_delivered = 0;
+
+  /// The number of subscribers removed for not keeping up.
+  std::uint64_t dropped = 0;
+
+  /// The number of subscribers removed as writing to them failed.
+  std::uint64_t failed = 0;
+
+  /// The number of subscribers.
+  std::size_t subscribers = 0;
+};
+
+/** Sends the same messages to a set of streams.
+ *
+ * Messages are published as a shared, immutable payload which is
+ * queued for each subscribing stream without being copied. Each
+ * stream still encrypts the message with its own session keys, which
+ * copies every record into the buffer of the stream before it is
+ * encrypted in place.
+ *
+ * Publishing a message posts a single function to each executor used
+ * by the subscribers, which queues the message and starts writing to
+ * all of the subscribers using that executor, instead of starting an
+ * operation per subscriber from the publishing thread. The list of
+ * subscribers passed along is shared and only copied when a
+ * subscriber is added or removed.
+ *
+ * Every subscriber has a queue of at most a given number of messages
+ * waiting to be written. A subscriber not keeping up, which would
+ * need to queue more than that, is removed along with its queued
+ * messages, so a slow subscriber neither holds up the others nor
+ * makes memory use grow without bounds.
+ *
+ * The streams must outlive their subscription and all operations on
+ * a stream must be performed from its executor, which must not run
+ * handlers concurrently, e.g. using a strand when running an
+ * io_context from multiple threads.
+ *
+ * @tparam Stream The type of the streams, e.g. @ref stream, which
+ * must support the <em>AsyncWriteStream</em> concept.
+ *
+ * @par Thread Safety
+ * @e Distinct @e objects: Safe.@n
+ * @e Shared @e objects: Safe.
+ */
+template <class Stream>
+class broadcaster {
+public:
+  /// The type of the messages published.
+  using payload_type = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+  /// The function called when a subscriber is removed due to an error.
+  using removal_handler = std::function<void(Stream& stream, const boost::system::error_code& ec)>;
+
+  /** Construct a broadcaster.
+   *
+   * @param max_queued The maximum number of messages queued for a
+   * subscriber, including the one being written.
+   *
+   * @param on_removed Called from the executor of a stream when it is
+   * removed for not keeping up, in which case the error is
+   * `net::error::no_buffer_space`, or when writing to it failed.
+   */
+  explicit broadcaster(std::size_t max_queued = 64, removal_handler on_removed = {})
+    : state_(std::make_shared<state>(max_queued, std::move(on_removed))) {
+  }
+
+  broadcaster(const broadcaster&) = delete;
+  broadcaster& operator=(const broadcaster&) = delete;
+
+  /** Add a subscriber.
+   *
+   * Only messages published afterwards are sent to the stream.
+   *
+   * A stream cannot be subscribed again while a message from an
+   * earlier subscription is still being written to it, as that would
+   * start a second write operation on the stream.
+   *
+   * @param stream The stream to send the messages to. Must have
+   * completed a handshake.
+   *
+   * @param ec Set to `net::error::already_started` if the stream is
+   * subscribed already or a message is still being written to it.
+   */
+  void subscribe(Stream& stream, boost::system::error_code& ec) {
+    ec = {};
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->find(&stream) || state_->find_draining(&stream) != state_->draining.end()) {
+      ec = net::error::already_started;
+      return;
+    }
+    const auto executor = stream.get_executor();
+    auto it = std::find_if(state_->groups.begin(), state_->groups.end(), [&executor](const group& g) {
+      return g.executor == executor;
+    });
+    if (it == state_->groups.end()) {
+      state_->groups.push_back(group{executor, std::make_shared<const subscriber_list>()});
+      it = std::prev(state_->groups.end());
+    }
+    auto subscribers = std::make_shared<subscriber_list>(*it->subscribers);
+    subscribers->push_back(std::make_shared<subscriber>(stream));
+    it->subscribers = std::move(subscribers);
+  }
+
+  /** Add a subscriber.
+   *
+   * Only messages published afterwards are sent to the stream.
+   *
+   * A stream cannot be subscribed again while a message from an
+   * earlier subscription is still being written to it, as that would
+   * start a second write operation on the stream.
+   *
+   * @param stream The stream to send the messages to. Must have
+   * completed a handshake.
+   *
+   * @throws boost::system::system_error Thrown if the stream is
+   * subscribed already or a message is still being written to it.
+   */
+  void subscribe(Stream& stream) {
+    boost::system::error_code ec{};
+    subscribe(stream, ec);
+    if (ec) {
+      detail::throw_error(ec, "subscribe");
+    }
+  }
+
+  /** Remove a subscriber.
+   *
+   * Messages already queued for the stream are discarded, although a
+   * message being written when this is called is written completely.
+   * The stream cannot be subscribed again until that write has
+   * completed.
+   *
+   * @param stream The stream to remove.
+   */
+  void unsubscribe(Stream& stream) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->remove(&stream);
+  }
+
+  /** Send a message to all subscribers.
+   *
+   * @param payload The message to send. Kept alive until written to
+   * all subscribers.
+   */
+  void publish(payload_type payload) {
+    ++state_->published;
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    for (const auto& g : state_->groups) {
+      net::post(g.executor, [self = state_, payload, subscribers = g.subscribers]() {
+        for (const auto& sub : *subscribers) {
+          self->enqueue(sub, payload);
+        }
+      });
+    }
+  }
+
+  /** Get statistics about the messages sent.
+   *
+   * @return The current statistics.
+   */
+  broadcast_statistics statistics() const {
+    broadcast_statistics result;
+    result.published = state_->published;
+    result.delivered = state_->delivered;
+    result.bytes_delivered = state_->bytes_delivered;
+    result.dropped = state_->dropped;
+    result.failed = state_->failed;
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    for (const auto& g : state_->groups) {
+      result.subscribers += g.subscribers->size();
+    }
+    return result;
+  }
+
+private:
+  using executor_type = typename Stream::executor_type;
+
+  struct subscriber {
+    explicit subscriber(Stream& s)
+      : stream(s) {
+    }
+
+    Stream& stream;
+    // Only accessed from the executor of the stream
+    std::deque<payload_type> queue;
+    std::atomic<bool> removed{false};
+    // Guarded by the mutex of the state
+    bool writing = false;
+  };
+
+  using subscriber_list = std::vector<std::shared_ptr<subscriber>>;
+
+  struct group {
+    executor_type executor;
+    // Replaced instead of modified as it is shared with the pending
+    // deliveries
+    std::shared_ptr<const subscriber_list> subscribers;
+  };
+
+  // Shared with the pending operations, which may complete after the
+  // broadcaster is gone
+  struct state : std::enable_shared_from_this<state> {
+    state(std::size_t max, removal_handler handler)
+      : max_queued(max)
+      , on_removed(std::move(handler)) {
+    }
+
+    void enqueue(const std::shared_ptr<subscriber>& sub, const payload_type& payload) {
+      if (sub->removed) {
+        return;
+      }
+      if (sub->queue.size() >= max_queued) {
+        ++dropped;
+        fail(sub, net::error::no_buffer_space);
+        return;
+      }
+      sub->queue.push_back(payload);
+      if (sub->queue.size() == 1) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (sub->removed) {
+            sub->queue.clear();
+            return;
+          }
+          sub->writing = true;
+        }
+        write(sub);
+      }
+    }
+
+    void write(const std::shared_ptr<subscriber>& sub) {
+      const auto& payload = sub->queue.front();
+      net::async_write(sub->stream,
+                       net::buffer(*payload),
+                       [self = this->shared_from_this(), sub](const boost::system::error_code& ec, std::size_t size) {
+                         self->bytes_delivered += size;
+                         if (!ec) {
+                           ++self->delivered;
+                           sub->queue.pop_front();
+                           if (!sub->removed && !sub->queue.empty()) {
+                             self->write(sub);
+                             return;
+                           }
+                         }
+                         self->write_done(sub, ec);
+                       });
+    }
+
+    // Called from the executor of the stream when no more messages
+    // are written to it for now
+    void write_done(const std::shared_ptr<subscriber>& sub, const boost::system::error_code& ec) {
+      bool failed_now = false;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        sub->writing = false;
+        if (sub->removed) {
+          sub->queue.clear();
+          auto it = find_draining(&sub->stream);
+          if (it != draining.end()) {
+            draining.erase(it);
+          }
+        } else if (ec) {
+          remove(&sub->stream);
+          failed_now = true;
+        }
+      }
+      if (failed_now) {
+        ++failed;
+        if (on_removed) {
+          on_removed(sub->stream, ec);
+        }
+      }
+    }
+
+    void fail(const std::shared_ptr<subscriber>& sub, const boost::system::error_code& ec) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        remove(&sub->stream);
+      }
+      if (on_removed) {
+        on_removed(sub->stream, ec);
+      }
+    }
+
+    // Must be called with the mutex locked
+    std::shared_ptr<subscriber> find(const Stream* stream) const {
+      for (const auto& g : groups) {
+        for (const auto& sub : *g.subscribers) {
+          if (&sub->stream == stream) {
+            return sub;
+          }
+        }
+      }
+      return nullptr;
+    }
+
+    // Must be called with the mutex locked
+    typename subscriber_list::iterator find_draining(const Stream* stream) {
+      return std::find_if(draining.begin(), draining.end(), [stream](const std::shared_ptr<subscriber>& sub) {
+        return &sub->stream == stream;
+      });
+    }
+
+    // Must be called with the mutex locked
+    void remove(const Stream* stream) {
+      for (auto& g : groups) {
+        auto it = std::find_if(g.subscribers->begin(), g.subscribers->end(), [stream](const std::shared_ptr<subscriber>& sub) {
+          return &sub->stream == stream;
+        });
+        if (it != g.subscribers->end()) {
+          (*it)->removed = true;
+          if ((*it)->writing) {
+            draining.push_back(*it);
+          }
+          auto subscribers = std::make_shared<subscriber_list>();
+          subscribers->reserve(g.subscribers->size() - 1);
+          std::copy(g.subscribers->begin(), it, std::back_inserter(*subscribers));
+          std::copy(std::next(it), g.subscribers->end(), std::back_inserter(*subscribers));
+          g.subscribers = std::move(subscribers);
+          return;
+        }
+      }
+    }
+
+    const std::size_t max_queued;
+    const removal_handler on_removed;
+    mutable std::mutex mutex;
+    std::vector<group> groups;
+    // Removed subscribers which are still being written to
+    subscriber_list draining;
+    std::atomic<std::uint64_t> published{0};
+    std::atomic<std::uint64_t> delivered{0};
+    std::atomic<std::uint64_t> bytes_delivered{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<std::uint64_t> failed{0};
+  };
+
+  std::shared_ptr<state> state_;
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_BROADCASTER_HPP
@@ -11,37 +11,20 @@
 #include <boost/wintls/error.hpp>
 #include <boost/wintls/file_format.hpp>
 
+#include <boost/wintls/detail/pem.hpp>
 #include <boost/wintls/detail/win32_crypto.hpp>
 
+#include <boost/asio/buffer.hpp>
+#include <boost/assert.hpp>
+
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace boost {
 namespace wintls {
 
-namespace detail {
-struct crypt_context {
-  crypt_context(const std::string& name) {
-    if (!CryptAcquireContextA(&ptr, name.c_str(), nullptr, PROV_RSA_FULL, CRYPT_NEWKEYSET | CRYPT_SILENT)) {
-      detail::throw_last_error("CryptAcquireContextA");
-    }
-  }
-
-  ~crypt_context() {
-    CryptReleaseContext(ptr, 0);
-  }
-
-  HCRYPTPROV ptr = 0;
-};
-
-struct crypt_key {
-  ~crypt_key() {
-    CryptDestroyKey(ptr);
-  }
-
-  HCRYPTKEY ptr = 0;
-};
-
-}
 /**
  * @verbatim embed:rst:leading-asterisk
  * Custom std::unique_ptr for managing a `CERT_CONTEXT`_
@@ -63,18 +46,7 @@ using cert_context_ptr = std::unique_ptr<const CERT_CONTEXT, decltype(&CertFreeC
  * @throws boost::system::system_error Thrown on failure.
  *
  */
-inline cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file_format format) {
-  // TODO: Support DER format
-  BOOST_VERIFY_MSG(format == file_format::pem, "Only PEM format currently implemented");
-
-  auto data = detail::crypt_string_to_binary(x509);
-  auto cert = CertCreateCertificateContext(X509_ASN_ENCODING, data.data(), static_cast<DWORD>(data.size()));
-  if (!cert) {
-    detail::throw_last_error("CertCreateCertificateContext");
-  }
-
-  return cert_context_ptr{cert, &CertFreeCertificateContext};
-}
+BOOST_WINTLS_DECL cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file_format format);
 
 /**
  * @verbatim embed:rst:leading-asterisk
@@ -90,15 +62,59 @@ inline cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file
  * @return A managed cert_context.
  *
  */
-inline cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file_format format, boost::system::error_code& ec) {
-  ec = {};
-  try {
-    return x509_to_cert_context(x509, format);
-  } catch (const boost::system::system_error& e) {
-    ec = e.code();
-    return cert_context_ptr{nullptr, &CertFreeCertificateContext};
-  }
-}
+BOOST_WINTLS_DECL cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file_format format, boost::system::error_code& ec);
+
+/**
+ * @verbatim embed:rst:leading-asterisk
+ * Import a certificate and its private key from PKCS#12 data to a Windows `CERT_CONTEXT`_.
+ * @endverbatim
+ *
+ * The certificate and any intermediate certificates are imported
+ * into an in-memory certificate store owned by the returned
+ * certificate. The private key is persisted in the key store of the
+ * current user, as Schannel cannot use ephemeral keys for server
+ * credentials. There is no need to call @ref import_private_key or
+ * @ref assign_private_key, so the returned certificate can be used
+ * directly by eg. @ref context::use_certificate.
+ *
+ * Each call persists a new key, which is kept until deleted with
+ * @ref delete_private_key once the certificate is no longer used.
+ *
+ * @param pkcs12 Buffer holding the PKCS#12 (PFX) data in ASN.1 DER format.
+ *
+ * @param password The password protecting the PKCS#12 data.
+ *
+ * @return A managed cert_context for the certificate holding the private key.
+ *
+ * @throws boost::system::system_error Thrown on failure.
+ */
+BOOST_WINTLS_DECL cert_context_ptr pkcs12_to_cert_context(const net::const_buffer& pkcs12, const std::string& password);
+
+/**
+ * @verbatim embed:rst:leading-asterisk
+ * Import a certificate and its private key from PKCS#12 data to a Windows `CERT_CONTEXT`_.
+ * @endverbatim
+ *
+ * The certificate and any intermediate certificates are imported
+ * into an in-memory certificate store owned by the returned
+ * certificate. The private key is persisted in the key store of the
+ * current user, as Schannel cannot use ephemeral keys for server
+ * credentials. There is no need to call @ref import_private_key or
+ * @ref assign_private_key, so the returned certificate can be used
+ * directly by eg. @ref context::use_certificate.
+ *
+ * Each call persists a new key, which is kept until deleted with
+ * @ref delete_private_key once the certificate is no longer used.
+ *
+ * @param pkcs12 Buffer holding the PKCS#12 (PFX) data in ASN.1 DER format.
+ *
+ * @param password The password protecting the PKCS#12 data.
+ *
+ * @param ec Set to indicate what error occurred, if any.
+ *
+ * @return A managed cert_context for the certificate holding the private key.
+ */
+BOOST_WINTLS_DECL cert_context_ptr pkcs12_to_cert_context(const net::const_buffer& pkcs12, const std::string& password, boost::system::error_code& ec);
 
 /**
  * Import a private key into the default cryptographic provider using the given name.
@@ -118,29 +134,7 @@ inline cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file
  *
  * @note Currently only RSA keys are supported.
  */
-inline void import_private_key(const net::const_buffer& private_key, file_format format, const std::string& name) {
-  // TODO: Handle ASN.1 DER format
-  BOOST_VERIFY_MSG(format == file_format::pem, "Only PEM format currently implemented");
-  auto data = detail::crypt_decode_object_ex(net::buffer(detail::crypt_string_to_binary(private_key)), PKCS_PRIVATE_KEY_INFO);
-  auto private_key_info = reinterpret_cast<CRYPT_PRIVATE_KEY_INFO*>(data.data());
-
-  // TODO: Set proper error code instead of asserting
-  BOOST_VERIFY_MSG(strcmp(private_key_info->Algorithm.pszObjId, szOID_RSA_RSA) == 0, "Only RSA keys supported");
-  auto rsa_private_key = detail::crypt_decode_object_ex(net::buffer(private_key_info->PrivateKey.pbData,
-                                                                    private_key_info->PrivateKey.cbData),
-                                                        PKCS_RSA_PRIVATE_KEY);
-
-  detail::crypt_context ctx(name);
-  detail::crypt_key key;
-  if (!CryptImportKey(ctx.ptr,
-                      rsa_private_key.data(),
-                      static_cast<DWORD>(rsa_private_key.size()),
-                      0,
-                      0,
-                      &key.ptr)) {
-    detail::throw_last_error("CryptImportKey");
-  }
-}
+BOOST_WINTLS_DECL void import_private_key(const net::const_buffer& private_key, file_format format, const std::string& name);
 
 /**
  * Import a private key into the default cryptographic provider using the given name.
@@ -160,14 +154,7 @@ inline void import_private_key(const net::const_buffer& private_key, file_format
  *
  * @note Currently only RSA keys are supported.
  */
-inline void import_private_key(const net::const_buffer& private_key, file_format format, const std::string& name, boost::system::error_code& ec) {
-  ec = {};
-  try {
-    import_private_key(private_key, format, name);
-  } catch (const boost::system::system_error& e) {
-    ec = e.code();
-  }
-}
+BOOST_WINTLS_DECL void import_private_key(const net::const_buffer& private_key, file_format format, const std::string& name, boost::system::error_code& ec);
 
 /**
  * Delete a private key from the default cryptographic provider.
@@ -177,13 +164,7 @@ inline void import_private_key(const net::const_buffer& private_key, file_format
  * @throws boost::system::system_error Thrown on failure.
  *
  */
-inline void delete_private_key(const std::string& name) {
-  HCRYPTKEY ptr = 0;
-  if (!CryptAcquireContextA(&ptr, name.c_str(), nullptr, PROV_RSA_FULL, CRYPT_DELETEKEYSET)) {
-
-    throw boost::system::system_error(GetLastError(), boost::system::system_category());
-  }
-}
+BOOST_WINTLS_DECL void delete_private_key(const std::string& name);
 
 /**
  * Delete a private key from the default cryptographic provider.
@@ -193,14 +174,43 @@ inline void delete_private_key(const std::string& name) {
  * @param ec Set to indicate what error occurred, if any.
  *
  */
-inline void delete_private_key(const std::string& name, boost::system::error_code& ec) {
-  ec = {};
-  try {
-    delete_private_key(name);
-  } catch (const boost::system::system_error& e) {
-    ec = e.code();
-  }
-}
+BOOST_WINTLS_DECL void delete_private_key(const std::string& name, boost::system::error_code& ec);
+
+/**
+ * Delete the private key of a certificate from its cryptographic provider.
+ *
+ * This function can be used to delete the private key persisted by
+ * @ref pkcs12_to_cert_context, or assigned by @ref
+ * assign_private_key, when the certificate is no longer needed.
+ * Otherwise the key is kept in the key store of the user, also after
+ * the process has exited.
+ *
+ * The certificate, and any copies of it used by a @ref context, can
+ * no longer be used for handshakes afterwards.
+ *
+ * @param cert The certificate whose private key to delete.
+ *
+ * @throws boost::system::system_error Thrown on failure.
+ */
+BOOST_WINTLS_DECL void delete_private_key(const CERT_CONTEXT* cert);
+
+/**
+ * Delete the private key of a certificate from its cryptographic provider.
+ *
+ * This function can be used to delete the private key persisted by
+ * @ref pkcs12_to_cert_context, or assigned by @ref
+ * assign_private_key, when the certificate is no longer needed.
+ * Otherwise the key is kept in the key store of the user, also after
+ * the process has exited.
+ *
+ * The certificate, and any copies of it used by a @ref context, can
+ * no longer be used for handshakes afterwards.
+ *
+ * @param cert The certificate whose private key to delete.
+ *
+ * @param ec Set to indicate what error occurred, if any.
+ */
+BOOST_WINTLS_DECL void delete_private_key(const CERT_CONTEXT* cert, boost::system::error_code& ec);
 
 /**
  * @verbatim embed:rst:leading-asterisk
@@ -224,24 +234,7 @@ inline void delete_private_key(const std::string& name, boost::system::error_cod
  *
  * @throws boost::system::system_error Thrown on failure.
  */
-inline void assign_private_key(const CERT_CONTEXT* cert, const std::string& name) {
-  // TODO: Move to utility function
-  const auto size = name.size() + 1;
-  auto wname = std::make_unique<WCHAR[]>(size);
-  const auto size_converted = mbstowcs(wname.get(), name.c_str(), size);
-  BOOST_VERIFY_MSG(size_converted == name.size(), "mbstowcs");
-
-  CRYPT_KEY_PROV_INFO keyProvInfo{};
-  keyProvInfo.pwszContainerName = wname.get();
-  keyProvInfo.pwszProvName = nullptr;
-  keyProvInfo.dwFlags = CERT_SET_KEY_PROV_HANDLE_PROP_ID | CERT_SET_KEY_CONTEXT_PROP_ID;
-  keyProvInfo.dwProvType = PROV_RSA_FULL;
-  keyProvInfo.dwKeySpec = AT_KEYEXCHANGE;
-
-  if (!CertSetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, 0, &keyProvInfo)) {
-    detail::throw_last_error("CertSetCertificateContextProperty");
-  }
-}
+BOOST_WINTLS_DECL void assign_private_key(const CERT_CONTEXT* cert, const std::string& name);
 
 /**
  * @verbatim embed:rst:leading-asterisk
@@ -265,16 +258,13 @@ inline void assign_private_key(const CERT_CONTEXT* cert, const std::string& name
  *
  * @param ec Set to indicate what error occurred, if any.
  */
-inline void assign_private_key(const CERT_CONTEXT* cert, const std::string& name, boost::system::error_code& ec) {
-  ec = {};
-  try {
-    assign_private_key(cert, name);
-  } catch (const boost::system::system_error& e) {
-    ec = e.code();
-  }
-}
+BOOST_WINTLS_DECL void assign_private_key(const CERT_CONTEXT* cert, const std::string& name, boost::system::error_code& ec);
 
 } // namespace wintls
 } // namespace boost
 
+#if defined(BOOST_WINTLS_HEADER_ONLY)
+#include <boost/wintls/impl/certificate.ipp>
+#endif
+
 #endif
@@ -8,18 +8,46 @@
 #ifndef BOOST_WINTLS_CONTEXT_HPP
 #define BOOST_WINTLS_CONTEXT_HPP
 
+#include <boost/wintls/handshake_type.hpp>
+#include <boost/wintls/initialize.hpp>
 #include <boost/wintls/method.hpp>
+#include <boost/wintls/trust_store.hpp>
 
 #include <boost/wintls/detail/config.hpp>
 #include <boost/wintls/detail/context_certificates.hpp>
+#include <boost/wintls/detail/context_snapshot.hpp>
+#include <boost/wintls/detail/decode_certificates.hpp>
+#include <boost/wintls/detail/mapped_file.hpp>
+#include <boost/wintls/detail/ocsp.hpp>
+
+#include <string>
+#include <vector>
 
 namespace boost {
 namespace wintls {
 
 namespace detail {
 class sspi_handshake;
+class sspi_stream;
 }
 
+class ocsp_stapler;
+
+/** Holds certificates and options shared by one or more streams.
+ *
+ * A context is shared by reference by every @ref stream constructed
+ * with it and must outlive those streams.
+ *
+ * @par Thread Safety
+ * @e Distinct @e objects: Safe.@n
+ * @e Shared @e objects: Safe.
+ *
+ * The configuration of a context may be changed while streams using
+ * it are performing handshakes on other threads. Each handshake uses
+ * the configuration of the context at the time the handshake was
+ * started, so changes only apply to handshakes started after the
+ * change. Handshakes never wait for changes to the configuration.
+ */
 class context {
 public:
   /** Construct a context.
@@ -27,8 +55,7 @@ public:
    * @param connection_method The @ref method to use for connections.
    */
   explicit context(method connection_method)
-    : method_(connection_method)
-    , verify_server_certificate_(false) {
+    : snapshot_(connection_method) {
   }
 
   context(context&&) = delete;
@@ -39,12 +66,17 @@ public:
    * This function is used to add one trusted certification authority
    * to the contexts certificate store used for certificate validation
    *
+   * The certificate store is copied for each call, so adding many
+   * certificates is faster using @ref add_certificate_authorities.
+   *
    * @param cert The certficate to add to the certificate store
    *
    * @throws boost::system::system_error Thrown on failure.
    */
   void add_certificate_authority(const CERT_CONTEXT* cert) {
-    ctx_certs_.add_certificate_authority(cert);
+    snapshot_.update([cert](detail::context_snapshot& snapshot) {
+      snapshot.certificates.add_certificate_authority(cert);
+    });
   }
 
   /** Add certification authority for performing verification.
@@ -58,12 +90,112 @@ public:
    */
   void add_certificate_authority(const CERT_CONTEXT* cert, boost::system::error_code& ec) {
     try {
-      ctx_certs_.add_certificate_authority(cert);
+      add_certificate_authority(cert);
+    } catch (const boost::system::system_error& e) {
+      ec = e.code();
+    }
+  }
+
+  /** Add certification authorities from a PEM bundle.
+   *
+   * This function is used to add all certificates in a buffer holding
+   * any number of PEM encoded certificates, like a CA bundle, to the
+   * contexts certificate store used for certificate validation.
+   *
+   * Large bundles are decoded in parallel and all certificates are
+   * added at once, so handshakes started meanwhile either see all or
+   * none of them.
+   *
+   * @param pem_bundle The buffer holding the PEM encoded certificates.
+   *
+   * @throws boost::system::system_error Thrown on failure. If any of
+   * the certificates cannot be decoded, none of them are added.
+   */
+  void add_certificate_authorities(const net::const_buffer& pem_bundle) {
+    const auto certs = detail::decode_certificates(pem_bundle);
+    snapshot_.update([&certs](detail::context_snapshot& snapshot) {
+      snapshot.certificates.add_certificate_authorities(certs);
+    });
+  }
+
+  /** Add certification authorities from a PEM bundle.
+   *
+   * This function is used to add all certificates in a buffer holding
+   * any number of PEM encoded certificates, like a CA bundle, to the
+   * contexts certificate store used for certificate validation.
+   *
+   * Large bundles are decoded in parallel and all certificates are
+   * added at once, so handshakes started meanwhile either see all or
+   * none of them.
+   *
+   * @param pem_bundle The buffer holding the PEM encoded certificates.
+   *
+   * @param ec Set to indicate what error occurred, if any. If any of
+   * the certificates cannot be decoded, none of them are added.
+   */
+  void add_certificate_authorities(const net::const_buffer& pem_bundle, boost::system::error_code& ec) {
+    try {
+      add_certificate_authorities(pem_bundle);
+    } catch (const boost::system::system_error& e) {
+      ec = e.code();
+    }
+  }
+
+  /** Load certification authorities from a PEM file.
+   *
+   * This function is used to add all certificates in a file holding
+   * any number of PEM encoded certificates, like a CA bundle, to the
+   * contexts certificate store used for certificate validation.
+   *
+   * The file is mapped into memory instead of being read.
+   *
+   * @param filename The name of the file holding the PEM encoded certificates.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  void load_verify_file(const std::string& filename) {
+    detail::mapped_file file(filename);
+    add_certificate_authorities(file.buffer());
+  }
+
+  /** Load certification authorities from a PEM file.
+   *
+   * This function is used to add all certificates in a file holding
+   * any number of PEM encoded certificates, like a CA bundle, to the
+   * contexts certificate store used for certificate validation.
+   *
+   * The file is mapped into memory instead of being read.
+   *
+   * @param filename The name of the file holding the PEM encoded certificates.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   */
+  void load_verify_file(const std::string& filename, boost::system::error_code& ec) {
+    try {
+      load_verify_file(filename);
     } catch (const boost::system::system_error& e) {
       ec = e.code();
     }
   }
 
+  /** Use a shared trust store for performing verification.
+   *
+   * This function is used to trust the certification authorities in
+   * a @ref trust_store shared with other contexts. Certification
+   * authorities added to this context are trusted in addition to the
+   * ones in the trust store.
+   *
+   * Only one trust store can be used at a time. Using another trust
+   * store replaces the previous one.
+   *
+   * @param store The trust store to use.
+   */
+  void use_trust_store(const trust_store& store) {
+    snapshot_.update([&store](detail::context_snapshot& snapshot) {
+      snapshot.certificates.use_shared_store(store.state_);
+    });
+  }
+
   /** Enables/disables remote server certificate verification
    *
    * This function may be used to enable clients to verify the
@@ -74,7 +206,25 @@ public:
    * verified
    */
   void verify_server_certificate(bool verify) {
-    verify_server_certificate_ = verify;
+    snapshot_.update([verify](detail::context_snapshot& snapshot) {
+      snapshot.verify_server_certificate = verify;
+    });
+  }
+
+  /** Enables/disables remote client certificate verification
+   *
+   * This function may be used to make servers request a certificate
+   * from clients and verify it with the known trusted certificates,
+   * the same way clients verify server certificates. Handshakes with
+   * clients not presenting a trusted certificate fail.
+   *
+   * @param verify True if a certificate should be requested from
+   * clients and verified
+   */
+  void verify_client_certificate(bool verify) {
+    snapshot_.update([verify](detail::context_snapshot& snapshot) {
+      snapshot.verify_client_certificate = verify;
+    });
   }
 
   /** Use the default operating system certificates
@@ -91,7 +241,9 @@ public:
    * certificates should be used for verification.
    */
   void use_default_certificates(bool use_system_certs) {
-    ctx_certs_.use_default_cert_store = use_system_certs;
+    snapshot_.update([use_system_certs](detail::context_snapshot& snapshot) {
+      snapshot.certificates.use_default_cert_store = use_system_certs;
+    });
   }
 
   /** Set the certificate to use when operating as a server
@@ -99,6 +251,16 @@ public:
    * This function sets the certficate to use when using a @ref stream
    * as server.
    *
+   * The certificate can be replaced on a context already used by a
+   * running server, e.g. when rotating certificates. The credentials
+   * for the new certificate are acquired in the background, after
+   * which handshakes started use the new certificate, so neither the
+   * caller nor any handshake has to wait for that. Handshakes started
+   * before keep using the previous certificate, as do already
+   * established streams. Use @ref warm_up for waiting until the new
+   * certificate is used. The first certificate set is used right
+   * away.
+   *
    * @param cert The certificate with an associated private the
    * @ref stream will use for encrypting messages when operating as a
    * server.
@@ -107,26 +269,318 @@ public:
    * doing so will result in unexpected behavior.
    */
   void use_certificate(const CERT_CONTEXT* cert) {
-    ctx_certs_.server_cert = cert_context_ptr{CertDuplicateCertificateContext(cert), &CertFreeCertificateContext};
+    snapshot_.update_server_certificate([cert](detail::context_snapshot& snapshot) {
+      snapshot.certificates.server_cert = cert_context_ptr{CertDuplicateCertificateContext(cert), &CertFreeCertificateContext};
+      snapshot.certificates.server_chain.clear();
+    });
   }
 
-private:
-  DWORD verify_certificate(const CERT_CONTEXT* cert) {
-    if (!verify_server_certificate_) {
-      return ERROR_SUCCESS;
+  /** Set the certificate and intermediate certificates to use when operating as a server
+   *
+   * This function works like @ref use_certificate, but also makes
+   * sure the given intermediate certificates are sent to clients
+   * along with the certificate.
+   *
+   * Without this, only the intermediate certificates found in the
+   * certificate stores of the machine are sent. Clients not having
+   * the missing intermediate certificates themselves have to fetch
+   * them, if they are able to at all, which delays their handshake.
+   *
+   * @param cert The certificate with an associated private the
+   * @ref stream will use for encrypting messages when operating as a
+   * server.
+   *
+   * @param intermediates The certificates between the certificate and
+   * the root certification authority. The root certificate itself is
+   * not needed, as clients have to trust it already.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   *
+   * @note The certificate must be associated with a private key. Not
+   * doing so will result in unexpected behavior.
+   */
+  void use_certificate_chain(const CERT_CONTEXT* cert, const std::vector<const CERT_CONTEXT*>& intermediates) {
+    snapshot_.update_server_certificate([cert, &intermediates](detail::context_snapshot& snapshot) {
+      std::vector<cert_context_ptr> chain;
+      for (const auto* intermediate : intermediates) {
+        chain.emplace_back(CertDuplicateCertificateContext(intermediate), &CertFreeCertificateContext);
+      }
+      snapshot.certificates.server_cert = detail::copy_with_chain(cert, chain);
+      snapshot.certificates.server_chain = std::move(chain);
+    });
+  }
+
+  /** Set the certificate and intermediate certificates to use when operating as a server
+   *
+   * This function works like @ref use_certificate, but also makes
+   * sure the given intermediate certificates are sent to clients
+   * along with the certificate.
+   *
+   * Without this, only the intermediate certificates found in the
+   * certificate stores of the machine are sent. Clients not having
+   * the missing intermediate certificates themselves have to fetch
+   * them, if they are able to at all, which delays their handshake.
+   *
+   * @param cert The certificate with an associated private the
+   * @ref stream will use for encrypting messages when operating as a
+   * server.
+   *
+   * @param intermediates The certificates between the certificate and
+   * the root certification authority. The root certificate itself is
+   * not needed, as clients have to trust it already.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @note The certificate must be associated with a private key. Not
+   * doing so will result in unexpected behavior.
+   */
+  void use_certificate_chain(const CERT_CONTEXT* cert,
+                             const std::vector<const CERT_CONTEXT*>& intermediates,
+                             boost::system::error_code& ec) {
+    ec = {};
+    try {
+      use_certificate_chain(cert, intermediates);
+    } catch (const boost::system::system_error& e) {
+      ec = e.code();
+    }
+  }
+
+  /** Set the certificate to use when operating as a client
+   *
+   * This function sets the certificate a @ref stream presents when
+   * operating as a client and the server requests a certificate,
+   * e.g. when using mutual TLS authentication.
+   *
+   * The certificate is part of the credentials shared by all
+   * clients using the context, so handshakes do not have to look for
+   * a certificate when requested by the server. Without a
+   * certificate, clients never send one.
+   *
+   * @param cert The certificate with an associated private key the
+   * @ref stream will use for authenticating itself when operating as
+   * a client.
+   *
+   * @note The certificate must be associated with a private key. Not
+   * doing so will result in unexpected behavior.
+   */
+  void use_client_certificate(const CERT_CONTEXT* cert) {
+    snapshot_.update([cert](detail::context_snapshot& snapshot) {
+      snapshot.certificates.client_cert = cert_context_ptr{CertDuplicateCertificateContext(cert), &CertFreeCertificateContext};
+      snapshot.credentials.reset(handshake_type::client);
+      // Any error acquiring the credentials is reported by the
+      // handshakes using them instead
+      SECURITY_STATUS sc;
+      snapshot.credentials_handle(handshake_type::client, sc);
+    });
+  }
+
+  /** Staple an OCSP response to the server certificate
+   *
+   * This function attaches an OCSP response to the certificate set
+   * with @ref use_certificate, which is then sent to clients during
+   * the handshake. Clients checking the revocation status of the
+   * certificate can use the stapled response instead of contacting
+   * the OCSP responder themselves.
+   *
+   * Like with @ref use_certificate, handshakes started after this
+   * function returns use the new response. Setting another
+   * certificate removes the response, see @ref ocsp_stapler for
+   * keeping a response attached and up to date.
+   *
+   * @param response The DER encoded OCSP response for the server
+   * certificate. The response is copied.
+   *
+   * @throws boost::system::system_error Thrown on failure, including
+   * when no server certificate is set or when the response is not a
+   * successful response for the server certificate.
+   */
+  void use_ocsp_response(const net::const_buffer& response) {
+    // The response is for the certificate being replaced, if any
+    snapshot_.wait();
+    snapshot_.update([&response](detail::context_snapshot& snapshot) {
+      const auto* cert = snapshot.certificates.server_cert.get();
+      if (cert == nullptr) {
+        detail::throw_error(error::make_error_code(SEC_E_NO_CREDENTIALS), "use_ocsp_response");
+      }
+      detail::parse_ocsp_response(response, cert);
+      snapshot.certificates.server_cert = detail::staple_ocsp_response(cert, response, snapshot.certificates.server_chain);
+      snapshot.credentials.reset(handshake_type::server);
+      SECURITY_STATUS sc;
+      snapshot.credentials_handle(handshake_type::server, sc);
+    });
+  }
+
+  /** Staple an OCSP response to the server certificate
+   *
+   * This function attaches an OCSP response to the certificate set
+   * with @ref use_certificate, which is then sent to clients during
+   * the handshake. Clients checking the revocation status of the
+   * certificate can use the stapled response instead of contacting
+   * the OCSP responder themselves.
+   *
+   * Like with @ref use_certificate, handshakes started after this
+   * function returns use the new response. Setting another
+   * certificate removes the response, see @ref ocsp_stapler for
+   * keeping a response attached and up to date.
+   *
+   * @param response The DER encoded OCSP response for the server
+   * certificate. The response is copied.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   */
+  void use_ocsp_response(const net::const_buffer& response, boost::system::error_code& ec) {
+    ec = {};
+    try {
+      use_ocsp_response(response);
+    } catch (const boost::system::system_error& e) {
+      ec = e.code();
+    }
+  }
+
+  /** Enables/disables revocation checking of the server certificate
+   *
+   * This function may be used to make clients verifying the server
+   * certificate also check that it has not been revoked. An OCSP
+   * response stapled by the server is used if available, otherwise
+   * the revocation status is retrieved from the location given by
+   * the certificate.
+   *
+   * Only has an effect if @ref verify_server_certificate is enabled.
+   *
+   * @param check True if the revocation status of the server
+   * certificate should be checked.
+   */
+  void check_certificate_revocation(bool check) {
+    snapshot_.update([check](detail::context_snapshot& snapshot) {
+      snapshot.certificates.check_revocation = check;
+    });
+  }
+
+  /** Enables/disables sharing read buffers between streams
+   *
+   * Each @ref stream otherwise holds on to a buffer of 128 KiB for
+   * reading and decrypting data for as long as the session lasts,
+   * even while just waiting for more data.
+   *
+   * With this enabled streams take a buffer from a pool shared by all
+   * streams when data is available and return it once all of the
+   * data has been read. Asynchronous reads on a next layer able to
+   * wait for data to become available, like a socket, only take a
+   * buffer when that happens, so servers with a large number of
+   * mostly idle connections only need buffers for the ones actually
+   * sending data. The buffer for the messages received during the
+   * handshake, which is freed once the handshake is done, is taken
+   * from a pool as well.
+   *
+   * Only streams created afterwards are affected.
+   *
+   * @param use True if read buffers should be shared between streams.
+   */
+  void use_buffer_pool(bool use) {
+    snapshot_.update([use](detail::context_snapshot& snapshot) {
+      snapshot.use_buffer_pool = use;
+    });
+  }
+
+  /** Prepare the context for handshakes.
+   *
+   * The first handshake using a context otherwise has to acquire the
+   * credentials and create the certificate chain engine used for
+   * verification. This function does so up front after calling @ref
+   * initialize, so that latency is moved away from the first
+   * connection.
+   *
+   * Credentials are only acquired for the roles the context is set up
+   * for. Server credentials are acquired if a certificate has been set
+   * with @ref use_certificate. Client credentials are acquired unless
+   * the method is for servers only, or a server certificate is set
+   * without a client certificate or verification of server
+   * certificates. Any replacement of the certificate in progress is
+   * waited for first. Changing the configuration of
+   * the context afterwards may require calling this function again.
+   *
+   * @return The time spent on each step performed by this call. The
+   * steps of @ref initialize are only included if this call was the
+   * one initializing the libraries.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  std::vector<initialization_step> warm_up() {
+    bool initialized;
+    const auto& initialize_steps = detail::initialize_once(initialized);
+    std::vector<initialization_step> steps;
+    if (initialized) {
+      steps = initialize_steps;
+    }
+    snapshot_.wait();
+    const auto current = snapshot();
+
+    auto acquire = [&current](handshake_type type) {
+      SECURITY_STATUS sc = SEC_E_OK;
+      if (!current->credentials_handle(type, sc)) {
+        detail::throw_error(error::make_error_code(sc), "AcquireCredentialsHandleW");
+      }
+    };
+    if (current->configured_for(handshake_type::client)) {
+      detail::timed_step(steps, "AcquireCredentialsHandleW (client)", [&acquire] {
+        acquire(handshake_type::client);
+      });
+    }
+    if (current->configured_for(handshake_type::server)) {
+      detail::timed_step(steps, "AcquireCredentialsHandleW (server)", [&acquire] {
+        acquire(handshake_type::server);
+      });
     }
-    return ctx_certs_.verify_certificate(cert);
+
+    detail::timed_step(steps, "CertCreateCertificateChainEngine", [&current] {
+      current->certificates.warm_up();
+    });
+    return steps;
   }
 
-  const CERT_CONTEXT* server_cert() const {
-    return ctx_certs_.server_cert.get();
+  /** Prepare the context for handshakes.
+   *
+   * The first handshake using a context otherwise has to acquire the
+   * credentials and create the certificate chain engine used for
+   * verification. This function does so up front after calling @ref
+   * initialize, so that latency is moved away from the first
+   * connection.
+   *
+   * Credentials are only acquired for the roles the context is set up
+   * for. Server credentials are acquired if a certificate has been set
+   * with @ref use_certificate. Client credentials are acquired unless
+   * the method is for servers only, or a server certificate is set
+   * without a client certificate or verification of server
+   * certificates. Any replacement of the certificate in progress is
+   * waited for first. Changing the configuration of
+   * the context afterwards may require calling this function again.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @return The time spent on each step performed by this call. The
+   * steps of @ref initialize are only included if this call was the
+   * one initializing the libraries.
+   */
+  std::vector<initialization_step> warm_up(boost::system::error_code& ec) {
+    ec = {};
+    try {
+      return warm_up();
+    } catch (const boost::system::system_error& e) {
+      ec = e.code();
+      return {};
+    }
+  }
+
+private:
+  std::shared_ptr<const detail::context_snapshot> snapshot() const {
+    return snapshot_.load();
   }
 
   friend class detail::sspi_handshake;
+  friend class detail::sspi_stream;
+  friend class ocsp_stapler;
 
-  detail::context_certificates ctx_certs_;
-  method method_;
-  bool verify_server_certificate_;
+  detail::context_snapshot_ptr snapshot_;
 };
 
 } // namespace wintls
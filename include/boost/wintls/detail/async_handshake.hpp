@@ -11,8 +11,10 @@
 #include <boost/wintls/handshake_type.hpp>
 
 #include <boost/wintls/detail/sspi_handshake.hpp>
+#include <boost/wintls/detail/stream_deadline.hpp>
 
 #include <boost/asio/coroutine.hpp>
+#include <boost/asio/write.hpp>
 
 namespace boost {
 namespace wintls {
@@ -20,9 +22,10 @@ namespace detail {
 
 template <typename NextLayer>
 struct async_handshake : boost::asio::coroutine {
-  async_handshake(NextLayer& next_layer, detail::sspi_handshake& handshake, handshake_type type)
+  async_handshake(NextLayer& next_layer, detail::sspi_handshake& handshake, handshake_type type, deadline_scope deadline = {})
     : next_layer_(next_layer)
     , handshake_(handshake)
+    , deadline_(std::move(deadline))
     , entry_count_(0)
     , state_(state::idle) {
     handshake_(type);
@@ -31,7 +34,7 @@ struct async_handshake : boost::asio::coroutine {
   template <typename Self>
   void operator()(Self& self, boost::system::error_code ec = {}, std::size_t length = 0) {
     if (ec) {
-      self.complete(ec);
+      self.complete(deadline_.complete(ec));
       return;
     }
 
@@ -79,7 +82,7 @@ struct async_handshake : boost::asio::coroutine {
               net::post(e, [self = std::move(self), ec, length]() mutable { self(ec, length); });
             }
           }
-          self.complete(handshake_.last_error());
+          self.complete(deadline_.complete(handshake_.last_error()));
           return;
         }
       }
@@ -91,13 +94,14 @@ struct async_handshake : boost::asio::coroutine {
         }
       }
       BOOST_ASSERT(!handshake_.last_error());
-      self.complete(handshake_.last_error());
+      self.complete(deadline_.complete(handshake_.last_error()));
     }
   }
 
 private:
   NextLayer& next_layer_;
   detail::sspi_handshake& handshake_;
+  deadline_scope deadline_;
   int entry_count_;
   std::vector<char> input_;
   enum class state {
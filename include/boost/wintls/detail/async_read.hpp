@@ -9,26 +9,110 @@
 #define BOOST_WINTLS_DETAIL_ASYNC_READ_HPP
 
 #include <boost/wintls/detail/sspi_decrypt.hpp>
+#include <boost/wintls/detail/stream_deadline.hpp>
 
+#include <boost/asio/compose.hpp>
 #include <boost/asio/coroutine.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/assert.hpp>
+
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 namespace boost {
 namespace wintls {
 namespace detail {
 
+// Whether the stream can wait for data to become available without
+// reading it, like sockets can
+template <class Stream, class = void>
+struct can_wait_readable : std::false_type {};
+
+template <class Stream>
+struct can_wait_readable<Stream, decltype(std::declval<Stream&>().async_wait(net::socket_base::wait_read,
+                                                                             std::declval<void (*)(boost::system::error_code)>()),
+                                          void())> : std::true_type {};
+
+template <class Stream, class Handler>
+void async_wait_readable(Stream& stream, Handler&& handler, std::true_type) {
+  stream.async_wait(net::socket_base::wait_read, std::forward<Handler>(handler));
+}
+
+template <class Stream, class Handler>
+void async_wait_readable(Stream&, Handler&&, std::false_type) {
+  BOOST_ASSERT_MSG(false, "stream cannot wait for data to become available");
+}
+
+// Reads more encrypted data from the next layer, after waiting for the
+// rate limit and, if the stream is idle, for data to become available
+// so a buffer is only taken once there is something to read into it.
+// Shared by the operations decrypting data.
+template <typename NextLayer>
+struct async_read_input : boost::asio::coroutine {
+  async_read_input(NextLayer& next_layer, detail::sspi_decrypt& decrypt)
+    : next_layer_(next_layer)
+    , decrypt_(decrypt) {
+  }
+
+  template <typename Self>
+  void operator()(Self& self, boost::system::error_code ec = {}, std::size_t size_read = 0) {
+    if (ec) {
+      self.complete(ec, size_read);
+      return;
+    }
+
+    BOOST_ASIO_CORO_REENTER(*this) {
+      if (decrypt_.rate_limit.delay(token_bucket::clock_type::now()) > token_bucket::clock_type::duration::zero()) {
+        BOOST_ASIO_CORO_YIELD {
+          timer_ = std::make_unique<net::steady_timer>(next_layer_.get_executor());
+          timer_->expires_after(decrypt_.rate_limit.delay(token_bucket::clock_type::now()));
+          timer_->async_wait(std::move(self));
+        }
+      }
+      if (can_wait_readable<NextLayer>::value && decrypt_.idle()) {
+        BOOST_ASIO_CORO_YIELD {
+          async_wait_readable(next_layer_, std::move(self), can_wait_readable<NextLayer>{});
+        }
+      }
+      BOOST_ASIO_CORO_YIELD {
+        next_layer_.async_read_some(decrypt_.input_buffer(), std::move(self));
+      }
+      decrypt_.size_read(size_read);
+      self.complete(ec, size_read);
+    }
+  }
+
+private:
+  NextLayer& next_layer_;
+  detail::sspi_decrypt& decrypt_;
+  std::unique_ptr<net::steady_timer> timer_;
+};
+
+template <typename NextLayer, typename Self>
+void read_input(NextLayer& next_layer, detail::sspi_decrypt& decrypt, Self&& self) {
+  net::async_compose<typename std::decay<Self>::type, void(boost::system::error_code, std::size_t)>(
+      async_read_input<NextLayer>{next_layer, decrypt}, self, next_layer);
+}
+
 template <typename NextLayer, typename MutableBufferSequence>
 struct async_read : boost::asio::coroutine {
-  async_read(NextLayer& next_layer, const MutableBufferSequence& buffers, detail::sspi_decrypt& decrypt)
+  async_read(NextLayer& next_layer,
+             const MutableBufferSequence& buffers,
+             detail::sspi_decrypt& decrypt,
+             deadline_scope deadline = {})
     : next_layer_(next_layer)
     , buffers_(buffers)
     , decrypt_(decrypt)
+    , deadline_(std::move(deadline))
     , entry_count_(0) {
   }
 
   template <typename Self>
   void operator()(Self& self, boost::system::error_code ec = {}, std::size_t size_read = 0) {
     if (ec) {
-      self.complete(ec, size_read);
+      self.complete(deadline_.complete(ec), size_read);
       return;
     }
 
@@ -41,9 +125,8 @@ struct async_read : boost::asio::coroutine {
     BOOST_ASIO_CORO_REENTER(*this) {
       while((state = decrypt_(buffers_)) == detail::sspi_decrypt::state::data_needed) {
         BOOST_ASIO_CORO_YIELD {
-          next_layer_.async_read_some(decrypt_.input_buffer, std::move(self));
+          read_input(next_layer_, decrypt_, std::move(self));
         }
-        decrypt_.size_read(size_read);
         continue;
       }
 
@@ -55,11 +138,11 @@ struct async_read : boost::asio::coroutine {
           }
         }
         ec = decrypt_.last_error();
-        self.complete(ec, 0);
+        self.complete(deadline_.complete(ec), 0);
         return;
       }
 
-      self.complete(boost::system::error_code{}, decrypt_.size_decrypted);
+      self.complete(deadline_.complete({}), decrypt_.size_decrypted);
     }
   }
 
@@ -67,6 +150,7 @@ private:
   NextLayer& next_layer_;
   MutableBufferSequence buffers_;
   detail::sspi_decrypt& decrypt_;
+  deadline_scope deadline_;
   int entry_count_;
 };
 
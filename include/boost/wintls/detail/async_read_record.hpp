@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_ASYNC_READ_RECORD_HPP
+#define BOOST_WINTLS_DETAIL_ASYNC_READ_RECORD_HPP
+
+#include <boost/wintls/record_buffer.hpp>
+
+#include <boost/wintls/detail/async_read.hpp>
+#include <boost/wintls/detail/sspi_decrypt.hpp>
+#include <boost/wintls/detail/stream_deadline.hpp>
+
+#include <boost/asio/coroutine.hpp>
+
+#include <utility>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+template <typename NextLayer>
+struct async_read_record : boost::asio::coroutine {
+  async_read_record(NextLayer& next_layer, detail::sspi_decrypt& decrypt, deadline_scope deadline = {})
+    : next_layer_(next_layer)
+    , decrypt_(decrypt)
+    , deadline_(std::move(deadline))
+    , entry_count_(0) {
+  }
+
+  template <typename Self>
+  void operator()(Self& self, boost::system::error_code ec = {}, std::size_t size_read = 0) {
+    if (ec) {
+      self.complete(deadline_.complete(ec), record_buffer{});
+      return;
+    }
+
+    ++entry_count_;
+    auto is_continuation = [this] {
+      return entry_count_ > 1;
+    };
+
+    detail::sspi_decrypt::state state;
+    BOOST_ASIO_CORO_REENTER(*this) {
+      while((state = decrypt_(record_)) == detail::sspi_decrypt::state::data_needed) {
+        BOOST_ASIO_CORO_YIELD {
+          read_input(next_layer_, decrypt_, std::move(self));
+        }
+        continue;
+      }
+
+      if (state == detail::sspi_decrypt::state::error) {
+        if (!is_continuation()) {
+          BOOST_ASIO_CORO_YIELD {
+            auto e = self.get_executor();
+            net::post(e, [self = std::move(self), ec, size_read]() mutable { self(ec, size_read); });
+          }
+        }
+        ec = decrypt_.last_error();
+        self.complete(deadline_.complete(ec), record_buffer{});
+        return;
+      }
+
+      self.complete(deadline_.complete({}), std::move(record_));
+    }
+  }
+
+private:
+  NextLayer& next_layer_;
+  detail::sspi_decrypt& decrypt_;
+  deadline_scope deadline_;
+  record_buffer record_;
+  int entry_count_;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_ASYNC_READ_RECORD_HPP
@@ -0,0 +1,175 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_ASYNC_RELAY_HPP
+#define BOOST_WINTLS_DETAIL_ASYNC_RELAY_HPP
+
+#include <boost/wintls/record_buffer.hpp>
+#include <boost/wintls/relay_statistics.hpp>
+
+#include <boost/wintls/detail/async_shutdown.hpp>
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <utility>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Relays records in both directions between two streams. Each
+// direction reads records from its source while fewer than the
+// maximum number of bytes are waiting to be written to its sink, so a
+// slow sink stops the reads from its source.
+template <class StreamA, class StreamB, class Handler>
+class async_relay : public std::enable_shared_from_this<async_relay<StreamA, StreamB, Handler>> {
+public:
+  async_relay(StreamA& a, StreamB& b, std::size_t max_in_flight, Handler&& handler)
+    : a_to_b_(a, b, statistics_.a_to_b)
+    , b_to_a_(b, a, statistics_.b_to_a)
+    , max_in_flight_(max_in_flight)
+    , handler_(std::move(handler)) {
+  }
+
+  void start() {
+    read(a_to_b_);
+    read(b_to_a_);
+  }
+
+private:
+  template <class Source, class Sink>
+  struct direction {
+    direction(Source& src, Sink& snk, relay_statistics::direction& stats)
+      : source(src)
+      , sink(snk)
+      , statistics(stats) {
+    }
+
+    Source& source;
+    Sink& sink;
+    relay_statistics::direction& statistics;
+    std::deque<record_buffer> queue;
+    std::size_t in_flight = 0;
+    bool reading = false;
+    bool writing = false;
+    bool end_of_file = false;
+    bool closing = false;
+    bool done = false;
+  };
+
+  template <class Direction>
+  void read(Direction& dir) {
+    if (ec_ || dir.reading || dir.end_of_file || dir.in_flight >= max_in_flight_) {
+      return;
+    }
+    dir.reading = true;
+    ++pending_;
+    dir.source.async_read_record([self = this->shared_from_this(), &dir](const boost::system::error_code& ec, record_buffer record) {
+      --self->pending_;
+      dir.reading = false;
+      if (ec == net::error::eof) {
+        dir.end_of_file = true;
+      } else if (ec) {
+        self->fail(ec);
+      } else if (!record.empty()) {
+        ++dir.statistics.records;
+        dir.in_flight += record.size();
+        dir.queue.push_back(std::move(record));
+      }
+      self->write(dir);
+      self->read(dir);
+      self->finish();
+    });
+  }
+
+  template <class Direction>
+  void write(Direction& dir) {
+    if (ec_ || dir.writing) {
+      return;
+    }
+    if (dir.queue.empty()) {
+      close(dir);
+      return;
+    }
+    dir.writing = true;
+    ++pending_;
+    net::async_write(dir.sink, net::buffer(dir.queue.front().data()),
+                     [self = this->shared_from_this(), &dir](const boost::system::error_code& ec, std::size_t size) {
+                       --self->pending_;
+                       dir.writing = false;
+                       dir.statistics.bytes += size;
+                       dir.in_flight -= dir.queue.front().size();
+                       dir.queue.pop_front();
+                       if (ec) {
+                         self->fail(ec);
+                       }
+                       self->write(dir);
+                       self->read(dir);
+                       self->finish();
+                     });
+  }
+
+  // Passes on the end of the data from the source to the sink once
+  // everything received has been written, leaving the other direction
+  // running
+  template <class Direction>
+  void close(Direction& dir) {
+    if (!dir.end_of_file || dir.closing) {
+      return;
+    }
+    dir.closing = true;
+    ++pending_;
+    dir.sink.async_shutdown([self = this->shared_from_this(), &dir](const boost::system::error_code& ec) {
+      --self->pending_;
+      dir.done = true;
+      if (ec) {
+        self->fail(ec);
+      }
+      self->finish();
+    });
+  }
+
+  void fail(const boost::system::error_code& ec) {
+    if (ec_) {
+      return;
+    }
+    ec_ = ec;
+    cancel_next_layer(a_to_b_.source, priority<4>{});
+    cancel_next_layer(b_to_a_.source, priority<4>{});
+  }
+
+  void finish() {
+    if (pending_ != 0 || completed_ || !(ec_ || (a_to_b_.done && b_to_a_.done))) {
+      return;
+    }
+    completed_ = true;
+    auto ex = net::get_associated_executor(handler_, a_to_b_.source.get_executor());
+    net::post(ex, [handler = std::move(handler_), ec = ec_, statistics = statistics_]() mutable {
+      handler(ec, statistics);
+    });
+  }
+
+  relay_statistics statistics_;
+  direction<StreamA, StreamB> a_to_b_;
+  direction<StreamB, StreamA> b_to_a_;
+  std::size_t max_in_flight_;
+  Handler handler_;
+  boost::system::error_code ec_;
+  int pending_ = 0;
+  bool completed_ = false;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_ASYNC_RELAY_HPP
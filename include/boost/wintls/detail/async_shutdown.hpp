@@ -8,61 +8,173 @@
 #ifndef BOOST_WINTLS_DETAIL_ASYNC_SHUTDOWN_HPP
 #define BOOST_WINTLS_DETAIL_ASYNC_SHUTDOWN_HPP
 
-#include <boost/wintls/detail/sspi_shutdown.hpp>
+#include <boost/wintls/shutdown_mode.hpp>
+
+#include <boost/wintls/detail/priority.hpp>
+#include <boost/wintls/detail/sspi_stream.hpp>
+#include <boost/wintls/detail/stream_deadline.hpp>
 
 #include <boost/asio/coroutine.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <utility>
 
 namespace boost {
 namespace wintls {
 namespace detail {
 
+// Aborts any pending operation on the next layer, preferring to
+// cancel the operations over closing the stream
+template <typename Stream>
+auto cancel_next_layer(Stream& stream, priority<4>)
+  -> decltype(stream.cancel(std::declval<boost::system::error_code&>()), void()) {
+  boost::system::error_code ec;
+  stream.cancel(ec);
+}
+
+// E.g. beast::basic_stream which only has a non-throwing cancel()
+template <typename Stream>
+auto cancel_next_layer(Stream& stream, priority<3>) -> decltype(stream.cancel(), void()) {
+  stream.cancel();
+}
+
+template <typename Stream>
+auto cancel_next_layer(Stream& stream, priority<2>)
+  -> decltype(stream.lowest_layer().cancel(std::declval<boost::system::error_code&>()), void()) {
+  boost::system::error_code ec;
+  stream.lowest_layer().cancel(ec);
+}
+
+template <typename Stream>
+auto cancel_next_layer(Stream& stream, priority<1>) -> decltype(stream.next_layer(), void()) {
+  cancel_next_layer(stream.next_layer(), priority<4>{});
+}
+
+template <typename Stream>
+auto cancel_next_layer(Stream& stream, priority<0>) -> decltype(stream.close(), void()) {
+  stream.close();
+}
+
 template <typename NextLayer>
 struct async_shutdown : boost::asio::coroutine {
-  async_shutdown(NextLayer& next_layer, detail::sspi_shutdown& shutdown)
+  async_shutdown(NextLayer& next_layer,
+                 detail::sspi_stream& stream,
+                 shutdown_mode mode = shutdown_mode::close_notify,
+                 std::chrono::steady_clock::duration timeout = std::chrono::steady_clock::duration::max(),
+                 deadline_scope deadline = {})
     : next_layer_(next_layer)
-    , shutdown_(shutdown)
+    , stream_(stream)
+    , mode_(mode)
+    , timeout_(timeout)
+    , deadline_(std::move(deadline))
     , entry_count_(0) {
   }
 
   template <typename Self>
-  void operator()(Self& self, boost::system::error_code ec = {}, std::size_t size_written = 0) {
-    if (ec) {
-      self.complete(ec);
-      return;
-    }
-
+  void operator()(Self& self, boost::system::error_code ec = {}, std::size_t size = 0) {
     ++entry_count_;
     auto is_continuation = [this] {
       return entry_count_ > 1;
     };
 
-    ec = shutdown_();
-
+    detail::sspi_decrypt::state state;
     BOOST_ASIO_CORO_REENTER(*this) {
-      if (!ec) {
-        BOOST_ASIO_CORO_YIELD {
-          net::async_write(next_layer_, shutdown_.buffer(), std::move(self));
-        }
-        shutdown_.size_written(size_written);
-        self.complete({});
-        return;
+      if (mode_ == shutdown_mode::fast) {
+        stream_.release();
       } else {
+        ec = stream_.shutdown();
+      }
+      if (mode_ == shutdown_mode::fast || ec) {
         if (!is_continuation()) {
           BOOST_ASIO_CORO_YIELD {
             auto e = self.get_executor();
-            net::post(e, [self = std::move(self), ec, size_written]() mutable { self(ec, size_written); });
+            net::post(e, [self = std::move(self), ec, size]() mutable { self(ec, size); });
           }
         }
-        self.complete(ec);
+        self.complete(deadline_.complete(ec));
+        return;
+      }
+
+      BOOST_ASIO_CORO_YIELD {
+        net::async_write(next_layer_, stream_.shutdown.buffer(), std::move(self));
+      }
+      if (ec) {
+        self.complete(deadline_.complete(ec));
         return;
       }
+      stream_.shutdown.size_written(size);
+      stream_.close_notify_sent();
+
+      if (mode_ == shutdown_mode::close_notify) {
+        self.complete(deadline_.complete({}));
+        return;
+      }
+
+      if (timeout_ != std::chrono::steady_clock::duration::max()) {
+        timeout_state_ = std::make_shared<timeout_state>();
+        timeout_state_->next_layer = &next_layer_;
+        timer_ = std::make_unique<net::steady_timer>(next_layer_.get_executor(), timeout_);
+        timer_->async_wait([state = timeout_state_](const boost::system::error_code& error) {
+          // The handler may already be queued when the shutdown
+          // completes, in which case the stream may be gone
+          if (!error && state->next_layer) {
+            state->timed_out = true;
+            cancel_next_layer(*state->next_layer, priority<4>{});
+          }
+        });
+      }
+
+      // Discard any data until the close_notify alert from the peer
+      while ((state = stream_.decrypt(net::buffer(discarded_))) != detail::sspi_decrypt::state::error) {
+        if (state == detail::sspi_decrypt::state::data_needed) {
+          BOOST_ASIO_CORO_YIELD {
+            next_layer_.async_read_some(stream_.decrypt.input_buffer(), std::move(self));
+          }
+          if (ec) {
+            break;
+          }
+          stream_.decrypt.size_read(size);
+        }
+      }
+
+      if (timer_) {
+        timeout_state_->next_layer = nullptr;
+        timer_->cancel();
+      }
+      if (timeout_state_ && timeout_state_->timed_out) {
+        ec = net::error::timed_out;
+      } else if (!ec) {
+        ec = stream_.decrypt.last_error();
+        if (ec == net::error::eof) {
+          ec = {};
+          stream_.release();
+        }
+      }
+      self.complete(deadline_.complete(ec));
     }
   }
 
 private:
+  // Shared with the timeout handler, which only touches the next
+  // layer while the shutdown is still in progress
+  struct timeout_state {
+    NextLayer* next_layer = nullptr;
+    bool timed_out = false;
+  };
+
   NextLayer& next_layer_;
-  detail::sspi_shutdown& shutdown_;
+  detail::sspi_stream& stream_;
+  shutdown_mode mode_;
+  std::chrono::steady_clock::duration timeout_;
+  deadline_scope deadline_;
   int entry_count_;
+  std::unique_ptr<net::steady_timer> timer_;
+  std::shared_ptr<timeout_state> timeout_state_;
+  std::array<char, 1024> discarded_;
 };
 
 } // namespace detail
@@ -11,8 +11,9 @@
 #include <boost/wintls/detail/sspi_encrypt.hpp>
 
 #include <boost/asio/coroutine.hpp>
+#include <boost/asio/steady_timer.hpp>
 
-#include <boost/core/ignore_unused.hpp>
+#include <memory>
 
 namespace boost {
 namespace wintls {
@@ -20,17 +21,38 @@ namespace detail {
 
 template <typename NextLayer, typename ConstBufferSequence>
 struct async_write : boost::asio::coroutine {
-  async_write(NextLayer& next_layer, const ConstBufferSequence& buffer, detail::sspi_encrypt& encrypt)
+  async_write(NextLayer& next_layer, const ConstBufferSequence& buffer, detail::sspi_encrypt& encrypt, std::size_t record_limit = 0)
     : next_layer_(next_layer)
     , buffer_(buffer)
-    , encrypt_(encrypt) {
+    , encrypt_(encrypt)
+    , record_limit_(record_limit) {
   }
 
   template <typename Self>
   void operator()(Self& self, boost::system::error_code ec = {}, std::size_t length = 0) {
-    boost::ignore_unused(length);
     BOOST_ASIO_CORO_REENTER(*this) {
-      bytes_consumed_ = encrypt_(buffer_, ec);
+      if (encrypt_.buffers.rate_limit.delay(token_bucket::clock_type::now()) > token_bucket::clock_type::duration::zero()) {
+        BOOST_ASIO_CORO_YIELD {
+          timer_ = std::make_unique<net::steady_timer>(next_layer_.get_executor());
+          timer_->expires_after(encrypt_.buffers.rate_limit.delay(token_bucket::clock_type::now()));
+          timer_->async_wait(std::move(self));
+        }
+        if (ec) {
+          self.complete(ec, 0);
+          return;
+        }
+      }
+
+      if (encrypt_.offloaded) {
+        BOOST_ASIO_CORO_YIELD {
+          next_layer_.async_write_some(buffer_, std::move(self));
+        }
+        encrypt_.buffers.rate_limit.consume(length, token_bucket::clock_type::now());
+        self.complete(ec, length);
+        return;
+      }
+
+      bytes_consumed_ = encrypt_(buffer_, ec, record_limit_);
       if (ec) {
         self.complete(ec, 0);
         return;
@@ -47,7 +69,9 @@ private:
   NextLayer& next_layer_;
   ConstBufferSequence buffer_;
   detail::sspi_encrypt& encrypt_;
+  std::size_t record_limit_;
   size_t bytes_consumed_{0};
+  std::unique_ptr<net::steady_timer> timer_;
 };
 
 } // detail
@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_BUFFER_POOL_HPP
+#define BOOST_WINTLS_DETAIL_BUFFER_POOL_HPP
+
+#include <boost/wintls/detail/config.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Process wide pool of buffers shared by all streams.
+//
+// Streams only take a buffer from the pool while they actually have
+// data to process and return it afterwards, so a large number of
+// mostly idle streams only needs as many buffers as are in use at
+// the same time. A limited number of returned buffers is kept for
+// reuse, any more are freed.
+template <class T>
+class buffer_pool {
+public:
+  static constexpr std::size_t max_cached = 64;
+
+  static buffer_pool& instance() {
+    static buffer_pool pool;
+    return pool;
+  }
+
+  std::unique_ptr<T> acquire() {
+    std::unique_ptr<T> buffer;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++outstanding_;
+      if (!cached_.empty()) {
+        buffer = std::move(cached_.back());
+        cached_.pop_back();
+      }
+    }
+    if (!buffer) {
+      buffer = std::make_unique<T>();
+    }
+    return buffer;
+  }
+
+  void release(std::unique_ptr<T> buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --outstanding_;
+    if (cached_.size() < max_cached) {
+      cached_.push_back(std::move(buffer));
+    }
+  }
+
+  // The number of buffers currently taken from the pool
+  std::size_t outstanding() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return outstanding_;
+  }
+
+private:
+  buffer_pool() = default;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<T>> cached_;
+  std::size_t outstanding_ = 0;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_BUFFER_POOL_HPP
@@ -0,0 +1,142 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_CERT_CHAIN_HPP
+#define BOOST_WINTLS_DETAIL_CERT_CHAIN_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/error.hpp>
+
+#include <boost/wintls/certificate.hpp>
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+using cert_store_ptr = std::unique_ptr<std::remove_pointer_t<HCERTSTORE>, std::function<void(HCERTSTORE)>>;
+
+inline cert_store_ptr open_cert_store(LPCSTR provider) {
+  cert_store_ptr store{
+    CertOpenStore(provider, 0, 0, 0, nullptr),
+    [](HCERTSTORE store) { CertCloseStore(store, 0); }
+  };
+  if (!store) {
+    throw_last_error("CertOpenStore");
+  }
+  return store;
+}
+
+// Returns a copy of the certificate in a new in-memory store also
+// holding the given intermediate certificates. Besides the system
+// stores, Schannel looks for the certificates to send along with a
+// server certificate in the store of that certificate.
+inline cert_context_ptr copy_with_chain(const CERT_CONTEXT* cert, const std::vector<cert_context_ptr>& intermediates) {
+  // The store is kept open by the copied certificate
+  auto store = open_cert_store(CERT_STORE_PROV_MEMORY);
+  for (const auto& intermediate : intermediates) {
+    if (!CertAddCertificateContextToStore(store.get(), intermediate.get(), CERT_STORE_ADD_USE_EXISTING, nullptr)) {
+      throw_last_error("CertAddCertificateContextToStore");
+    }
+  }
+  const CERT_CONTEXT* copy = nullptr;
+  if (!CertAddCertificateContextToStore(store.get(), cert, CERT_STORE_ADD_ALWAYS, &copy)) {
+    throw_last_error("CertAddCertificateContextToStore");
+  }
+  return cert_context_ptr{copy, &CertFreeCertificateContext};
+}
+
+// A chain engine trusting only the certificates in the given store.
+// Chain engines are thread safe, so one engine can be used for
+// verifying certificates on any number of threads.
+class cert_chain_engine {
+public:
+  explicit cert_chain_engine(HCERTSTORE exclusive_root) {
+    CERT_CHAIN_ENGINE_CONFIG chain_engine_config{};
+    chain_engine_config.cbSize = sizeof(chain_engine_config);
+    chain_engine_config.hExclusiveRoot = exclusive_root;
+
+    if (!CertCreateCertificateChainEngine(&chain_engine_config, &engine_)) {
+      throw_last_error("CertCreateCertificateChainEngine");
+    }
+  }
+
+  cert_chain_engine(const cert_chain_engine&) = delete;
+  cert_chain_engine& operator=(const cert_chain_engine&) = delete;
+
+  ~cert_chain_engine() {
+    CertFreeCertificateChainEngine(engine_);
+  }
+
+  HCERTCHAINENGINE get() const {
+    return engine_;
+  }
+
+private:
+  HCERTCHAINENGINE engine_ = nullptr;
+};
+
+// Verifies the certificate using the given chain engine or the
+// default system certificate store if the engine is a NULL pointer.
+// The authentication type tells whether the certificate was received
+// from a server (AUTHTYPE_SERVER) or a client (AUTHTYPE_CLIENT).
+//
+// When checking revocation an OCSP response stapled by the server,
+// which Schannel attaches to the remote certificate, is used instead
+// of contacting the responder.
+inline HRESULT verify_certificate_chain(const CERT_CONTEXT* cert,
+                                        HCERTCHAINENGINE engine,
+                                        DWORD auth_type = AUTHTYPE_SERVER,
+                                        bool check_revocation = false) {
+  CERT_CHAIN_PARA chain_parameters{};
+  chain_parameters.cbSize = sizeof(chain_parameters);
+
+  const CERT_CHAIN_CONTEXT* chain_ctx_ptr;
+  if(!CertGetCertificateChain(engine,
+                              cert,
+                              nullptr,
+                              cert->hCertStore,
+                              &chain_parameters,
+                              check_revocation ? CERT_CHAIN_REVOCATION_CHECK_END_CERT : 0,
+                              nullptr,
+                              &chain_ctx_ptr)) {
+    return GetLastError();
+  }
+
+  std::unique_ptr<const CERT_CHAIN_CONTEXT, decltype(&CertFreeCertificateChain)>
+    scoped_chain_ctx{chain_ctx_ptr, &CertFreeCertificateChain};
+
+  HTTPSPolicyCallbackData https_policy{};
+  https_policy.cbStruct = sizeof(https_policy);
+  https_policy.dwAuthType = auth_type;
+
+  CERT_CHAIN_POLICY_PARA policy_params{};
+  policy_params.cbSize = sizeof(policy_params);
+  policy_params.pvExtraPolicyPara = &https_policy;
+
+  CERT_CHAIN_POLICY_STATUS policy_status{};
+  policy_status.cbSize = sizeof(policy_status);
+
+  if(!CertVerifyCertificateChainPolicy(CERT_CHAIN_POLICY_SSL,
+                                       scoped_chain_ctx.get(),
+                                       &policy_params,
+                                       &policy_status)) {
+    return GetLastError();
+  }
+
+  return policy_status.dwError;
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_CERT_CHAIN_HPP
@@ -11,9 +11,22 @@
 #include <boost/wintls/detail/wtypes.h>
 
 #include <boost/config.hpp>
-#include <boost/asio.hpp>
+
+// Define BOOST_WINTLS_SEPARATE_COMPILATION to compile the non template
+// parts of the library once in the translation unit including
+// <boost/wintls/impl/src.hpp> instead of in every translation unit
+// using the library.
+#if defined(BOOST_WINTLS_SEPARATE_COMPILATION)
+#define BOOST_WINTLS_DECL
+#else
+#define BOOST_WINTLS_HEADER_ONLY
+#define BOOST_WINTLS_DECL inline
+#endif
 
 namespace boost {
+namespace asio {
+} // namespace asio
+
 namespace wintls {
 
 namespace net = boost::asio;
@@ -9,120 +9,72 @@
 #define BOOST_WINTLS_DETAIL_CONTEXT_CERTIFICATES_HPP
 
 #include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/cert_chain.hpp>
 
 #include <boost/wintls/certificate.hpp>
 #include <boost/wintls/error.hpp>
+#include <boost/wintls/trust_store.hpp>
 
-#include <functional>
 #include <memory>
+#include <mutex>
 #include <type_traits>
+#include <vector>
 
 namespace boost {
 namespace wintls {
 namespace detail {
 
-using cert_store_ptr = std::unique_ptr<std::remove_pointer_t<HCERTSTORE>, std::function<void(HCERTSTORE)>>;
-
 class context_certificates {
 public:
-  void add_certificate_authority(const CERT_CONTEXT* cert) {
-    if (!cert_store_) {
-      cert_store_ = cert_store_ptr{
-        CertOpenStore(CERT_STORE_PROV_MEMORY, 0, 0, 0, nullptr),
-        [](HCERTSTORE store) { CertCloseStore(store, 0); }
-      };
-      if (!cert_store_) {
-        throw_last_error("CertOpenStore");
-      }
-    }
-    if(!CertAddCertificateContextToStore(cert_store_.get(),
-                                         cert,
-                                         CERT_STORE_ADD_ALWAYS,
-                                         nullptr)) {
-      throw_last_error("CertAddCertificateContextToStore");
-    }
-  }
-
-  HRESULT verify_certificate(const CERT_CONTEXT* cert) {
-    HRESULT status = CERT_E_UNTRUSTEDROOT;
-
-    if (cert_store_) {
-      CERT_CHAIN_ENGINE_CONFIG chain_engine_config{};
-      chain_engine_config.cbSize = sizeof(chain_engine_config);
-      chain_engine_config.hExclusiveRoot = cert_store_.get();
-
-      struct cert_chain_engine {
-        ~cert_chain_engine() {
-          CertFreeCertificateChainEngine(ptr);
-        }
-        HCERTCHAINENGINE ptr = nullptr;
-      } chain_engine;
-
-      if (!CertCreateCertificateChainEngine(&chain_engine_config, &chain_engine.ptr)) {
-        return GetLastError();
-      }
-
-      status = verify_certificate_chain(cert, chain_engine.ptr);
-    }
-
-    if (status != ERROR_SUCCESS && use_default_cert_store) {
-      // Calling CertGetCertificateChain with a NULL pointer engine uses
-      // the default system certificate store
-      status = verify_certificate_chain(cert, nullptr);
-    }
-
-    return status;
-  }
+  context_certificates() = default;
+  BOOST_WINTLS_DECL context_certificates(const context_certificates& other);
+  context_certificates& operator=(const context_certificates&) = delete;
+
+  BOOST_WINTLS_DECL void add_certificate_authority(const CERT_CONTEXT* cert);
+  BOOST_WINTLS_DECL void add_certificate_authorities(const std::vector<cert_context_ptr>& certs);
+  BOOST_WINTLS_DECL void use_shared_store(std::shared_ptr<const trust_store_state> store);
+  // Verifies a certificate received from a server or, given
+  // AUTHTYPE_CLIENT, from a client
+  BOOST_WINTLS_DECL HRESULT verify_certificate(const CERT_CONTEXT* cert, DWORD auth_type = AUTHTYPE_SERVER) const;
+
+  // Creates the chain engine used for verification up front
+  BOOST_WINTLS_DECL void warm_up() const;
 
   bool use_default_cert_store = false;
+  bool check_revocation = false;
   cert_context_ptr server_cert{nullptr, &CertFreeCertificateContext};
+  std::vector<cert_context_ptr> server_chain;
+  cert_context_ptr client_cert{nullptr, &CertFreeCertificateContext};
 
 private:
-  HRESULT verify_certificate_chain(const CERT_CONTEXT* cert, HCERTCHAINENGINE engine) {
-    CERT_CHAIN_PARA chain_parameters{};
-    chain_parameters.cbSize = sizeof(chain_parameters);
-
-    const CERT_CHAIN_CONTEXT* chain_ctx_ptr;
-    if(!CertGetCertificateChain(engine,
-                                cert,
-                                nullptr,
-                                cert->hCertStore,
-                                &chain_parameters,
-                                0,
-                                nullptr,
-                                &chain_ctx_ptr)) {
-      return GetLastError();
-    }
-
-    std::unique_ptr<const CERT_CHAIN_CONTEXT, decltype(&CertFreeCertificateChain)>
-      scoped_chain_ctx{chain_ctx_ptr, &CertFreeCertificateChain};
-
-    HTTPSPolicyCallbackData https_policy{};
-    https_policy.cbStruct = sizeof(https_policy);
-    https_policy.dwAuthType = AUTHTYPE_SERVER;
-
-    CERT_CHAIN_POLICY_PARA policy_params{};
-    policy_params.cbSize = sizeof(policy_params);
-    policy_params.pvExtraPolicyPara = &https_policy;
-
-    CERT_CHAIN_POLICY_STATUS policy_status{};
-    policy_status.cbSize = sizeof(policy_status);
-
-    if(!CertVerifyCertificateChainPolicy(CERT_CHAIN_POLICY_SSL,
-                                         scoped_chain_ctx.get(),
-                                         &policy_params,
-                                         &policy_status)) {
-      return GetLastError();
-    }
-
-    return policy_status.dwError;
-  }
-
-  cert_store_ptr cert_store_;
+  using shared_cert_store = std::shared_ptr<std::remove_pointer_t<HCERTSTORE>>;
+
+  // The chain engine trusting the certificate authorities, created on
+  // first use
+  struct verification_engine {
+    std::mutex mutex;
+    cert_store_ptr roots;
+    std::unique_ptr<cert_chain_engine> engine;
+  };
+
+  BOOST_WINTLS_DECL HCERTCHAINENGINE chain_engine() const;
+  BOOST_WINTLS_DECL shared_cert_store copy_cert_store() const;
+
+  // Shared by all copies until certificates are added, which is done
+  // to a copy of the store as the copies may already be in use. The
+  // same goes for the engine, which is replaced when the certificate
+  // authorities change.
+  shared_cert_store cert_store_;
+  std::shared_ptr<const trust_store_state> shared_store_;
+  std::shared_ptr<verification_engine> engine_ = std::make_shared<verification_engine>();
 };
 
 } // namespace detail
 } // namespace wintls
 } // namespace boost
 
+#if defined(BOOST_WINTLS_HEADER_ONLY)
+#include <boost/wintls/detail/impl/context_certificates.ipp>
+#endif
+
 #endif // BOOST_WINTLS_DETAIL_CONTEXT_CERTIFICATES_HPP
@@ -18,6 +18,7 @@ constexpr DWORD client_context_flags =
   ISC_REQ_CONFIDENTIALITY | // Encrypt messages
   ISC_RET_EXTENDED_ERROR | // When errors occur, the remote party will be notified
   ISC_REQ_ALLOCATE_MEMORY | // Allocate buffers. Free them with FreeContextBuffer
+  ISC_REQ_USE_SUPPLIED_CREDS | // Only use the client certificate from the credentials, if any
   ISC_REQ_STREAM; // Support a stream-oriented connection
 
 constexpr DWORD server_context_flags =
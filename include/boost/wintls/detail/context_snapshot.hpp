@@ -0,0 +1,176 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_CONTEXT_SNAPSHOT_HPP
+#define BOOST_WINTLS_DETAIL_CONTEXT_SNAPSHOT_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/context_certificates.hpp>
+#include <boost/wintls/detail/sspi_credentials.hpp>
+
+#include <boost/wintls/handshake_type.hpp>
+#include <boost/wintls/method.hpp>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/system_executor.hpp>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// The configuration of a context at a given point in time.
+//
+// Once published a snapshot is never modified, so it can be read by
+// any number of handshakes concurrently without locking. Changing the
+// configuration is done by copying the current snapshot, modifying the
+// copy and publishing that instead.
+struct context_snapshot {
+  explicit context_snapshot(method m)
+    : connection_method(m) {
+  }
+
+  std::shared_ptr<cred_handle> credentials_handle(handshake_type type, SECURITY_STATUS& sc) const {
+    const auto& cert = type == handshake_type::server ? certificates.server_cert : certificates.client_cert;
+    return credentials.get(connection_method, type, cert.get(), sc);
+  }
+
+  // Whether the context is set up for handshakes of the given kind.
+  // A context with a server certificate is taken to be used by servers
+  // only, unless it also has a client certificate or verifies server
+  // certificates.
+  bool configured_for(handshake_type type) const {
+    const auto protocols = static_cast<DWORD>(connection_method);
+    if (type == handshake_type::server) {
+      constexpr DWORD server_protocols = SP_PROT_SSL3_SERVER | SP_PROT_TLS1_SERVER | SP_PROT_TLS1_1_SERVER | SP_PROT_TLS1_2_SERVER;
+      return (protocols == 0 || (protocols & server_protocols) != 0) && certificates.server_cert != nullptr;
+    }
+    constexpr DWORD client_protocols = SP_PROT_SSL3_CLIENT | SP_PROT_TLS1_CLIENT | SP_PROT_TLS1_1_CLIENT | SP_PROT_TLS1_2_CLIENT;
+    return (protocols == 0 || (protocols & client_protocols) != 0) &&
+      (!certificates.server_cert || certificates.client_cert || verify_server_certificate);
+  }
+
+  const method connection_method;
+  context_certificates certificates;
+  sspi_credentials credentials;
+  bool verify_server_certificate = false;
+  bool verify_client_certificate = false;
+  bool use_buffer_pool = false;
+};
+
+class context_snapshot_ptr {
+public:
+  explicit context_snapshot_ptr(method m)
+    : snapshot_(std::make_shared<const context_snapshot>(m)) {
+  }
+
+  ~context_snapshot_ptr() {
+    wait();
+  }
+
+  std::shared_ptr<const context_snapshot> load() const {
+    return std::atomic_load(&snapshot_);
+  }
+
+  // Serialize writers with each other only. Readers always see either
+  // the previous or the new snapshot, never a partially modified one.
+  template <class Function>
+  void update(Function&& f) {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    auto next = std::make_shared<context_snapshot>(*load());
+    f(*next);
+    std::atomic_store(&snapshot_, std::shared_ptr<const context_snapshot>{std::move(next)});
+  }
+
+  // Replaces the server certificate with the one set by the given
+  // function, which is called right away. The credentials for the new
+  // certificate are acquired on the system thread pool and the new
+  // certificate is only published once they are, so neither the
+  // caller nor any handshake has to wait for that. Changes made
+  // meanwhile are kept.
+  //
+  // The first certificate is published right away with its
+  // credentials as there is no previous one to keep using meanwhile.
+  template <class Function>
+  void update_server_certificate(Function&& f) {
+    std::lock_guard<std::mutex> lock(background_mutex_);
+    if (background_.valid()) {
+      background_.get();
+    }
+
+    auto prepared = std::make_shared<context_snapshot>(*load());
+    f(*prepared);
+    if (!load()->certificates.server_cert) {
+      update([&prepared](context_snapshot& snapshot) {
+        snapshot.certificates.server_cert = std::move(prepared->certificates.server_cert);
+        snapshot.certificates.server_chain = std::move(prepared->certificates.server_chain);
+        snapshot.credentials.reset(handshake_type::server);
+        SECURITY_STATUS sc;
+        snapshot.credentials_handle(handshake_type::server, sc);
+      });
+      return;
+    }
+    // Posted through a lambda as Boost.Asio treats a packaged_task
+    // passed directly as a completion token
+    auto task = std::make_shared<std::packaged_task<void()>>([this, prepared] {
+      try {
+        // Any error acquiring the credentials is reported by the
+        // handshakes using them instead
+        auto handle = std::make_shared<cred_handle>();
+        if (acquire_credentials_handle(prepared->connection_method,
+                                       handshake_type::server,
+                                       prepared->certificates.server_cert.get(),
+                                       *handle) != SEC_E_OK) {
+          handle.reset();
+        }
+        update([&prepared, &handle](context_snapshot& snapshot) {
+          snapshot.certificates.server_cert = std::move(prepared->certificates.server_cert);
+          snapshot.certificates.server_chain = std::move(prepared->certificates.server_chain);
+          // The credentials are only valid for the method they were
+          // acquired for
+          if (snapshot.connection_method == prepared->connection_method) {
+            snapshot.credentials.set(handshake_type::server, std::move(handle));
+          } else {
+            snapshot.credentials.reset(handshake_type::server);
+          }
+        });
+      } catch (...) {
+        // Nobody to report to, so the previous certificate stays in
+        // use rather than terminating the process
+      }
+    });
+    background_ = task->get_future();
+    net::post(net::system_executor{}, [task] {
+      (*task)();
+    });
+  }
+
+  // Waits for any replacement of the server certificate in progress
+  void wait() {
+    std::lock_guard<std::mutex> lock(background_mutex_);
+    if (background_.valid()) {
+      background_.get();
+    }
+  }
+
+private:
+  std::shared_ptr<const context_snapshot> snapshot_;
+  std::mutex update_mutex_;
+  std::mutex background_mutex_;
+  std::future<void> background_;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_CONTEXT_SNAPSHOT_HPP
@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_DECODE_CERTIFICATES_HPP
+#define BOOST_WINTLS_DETAIL_DECODE_CERTIFICATES_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/pem.hpp>
+
+#include <boost/wintls/certificate.hpp>
+#include <boost/wintls/error.hpp>
+#include <boost/wintls/file_format.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Decodes all certificates in a PEM bundle. Large bundles are decoded
+// by several threads as each certificate can be decoded independently.
+inline std::vector<cert_context_ptr> decode_certificates(const net::const_buffer& pem_bundle) {
+  // Not worth starting a thread for less than this
+  constexpr std::size_t certificates_per_thread = 16;
+
+  const auto pem_certificates = pem_split(pem_bundle, "CERTIFICATE");
+  if (pem_certificates.empty()) {
+    throw_error(error::make_error_code(CRYPT_E_NOT_FOUND), "No certificates found");
+  }
+
+  std::vector<const CERT_CONTEXT*> decoded(pem_certificates.size(), nullptr);
+  std::atomic<std::size_t> next{0};
+  std::exception_ptr first_error;
+  std::mutex error_mutex;
+
+  auto decode = [&]() {
+    std::size_t i;
+    while ((i = next++) < decoded.size()) {
+      try {
+        decoded[i] = x509_to_cert_context(pem_certificates[i], file_format::pem).release();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!first_error) {
+          first_error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  const auto thread_count = std::min<std::size_t>(std::thread::hardware_concurrency(),
+                                                  decoded.size() / certificates_per_thread);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < thread_count; ++i) {
+    try {
+      threads.emplace_back(decode);
+    } catch (const std::system_error&) {
+      // Just continue with the threads already started
+      break;
+    }
+  }
+  decode();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<cert_context_ptr> certificates;
+  certificates.reserve(decoded.size());
+  for (auto cert : decoded) {
+    certificates.emplace_back(cert, &CertFreeCertificateContext);
+  }
+  if (first_error) {
+    std::rethrow_exception(first_error);
+  }
+  return certificates;
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_DECODE_CERTIFICATES_HPP
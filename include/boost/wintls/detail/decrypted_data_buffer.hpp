@@ -10,6 +10,8 @@
 
 #include <boost/wintls/detail/config.hpp>
 
+#include <boost/asio/buffer.hpp>
+
 #include <array>
 #include <cassert>
 #include <cstddef>
@@ -25,6 +27,10 @@ public:
     return available_data_.size() == 0;
   }
 
+  std::size_t size() const {
+    return available_data_.size();
+  }
+
   template <class MutableBufferSequence>
   std::size_t get(const MutableBufferSequence& buffer) {
     const auto size = net::buffer_copy(buffer, available_data_);
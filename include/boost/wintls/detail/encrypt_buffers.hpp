@@ -11,6 +11,7 @@
 #include <boost/wintls/detail/sspi_buffer_sequence.hpp>
 #include <boost/wintls/detail/sspi_functions.hpp>
 #include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/token_bucket.hpp>
 
 namespace boost {
 namespace wintls {
@@ -28,16 +29,28 @@ public:
     , ctxt_handle_(ctxt_handle) {
   }
 
-  template <typename ConstBufferSequence> std::size_t operator()(const ConstBufferSequence& buffers, SECURITY_STATUS& sc) {
-    if (data_.empty()) {
-      sc = sspi_functions::QueryContextAttributes(ctxt_handle_.get(), SECPKG_ATTR_STREAM_SIZES, &stream_sizes_);
-      if (sc != SEC_E_OK) {
-        return 0;
-      }
-      data_.resize(stream_sizes_.cbHeader + stream_sizes_.cbMaximumMessage + stream_sizes_.cbTrailer);
+  // Prepares a record from the buffers. If a record size limit is
+  // given, less data is used if needed for the whole record to fit
+  // within that limit, e.g. the data size of the records of a TLS
+  // stream this stream is layered on top of.
+  template <typename ConstBufferSequence>
+  std::size_t operator()(const ConstBufferSequence& buffers, SECURITY_STATUS& sc, std::size_t record_limit = 0) {
+    if (!query_stream_sizes(sc)) {
+      return 0;
     }
 
-    const auto size_consumed = std::min(net::buffer_size(buffers), static_cast<size_t>(stream_sizes_.cbMaximumMessage));
+    auto max_message = static_cast<size_t>(stream_sizes_.cbMaximumMessage);
+    const auto overhead = static_cast<size_t>(stream_sizes_.cbHeader + stream_sizes_.cbTrailer);
+    if (record_limit > overhead) {
+      max_message = std::min(max_message, record_limit - overhead);
+    }
+    if (rate_limit.limited()) {
+      // Records no larger than a burst, so a throttled stream sends
+      // small records at a steady pace instead of bursts of full ones
+      const auto burst_size = rate_limit.burst_size();
+      max_message = std::min(max_message, burst_size > overhead ? burst_size - overhead : std::size_t{1});
+    }
+    const auto size_consumed = std::min(net::buffer_size(buffers), max_message);
 
     buffers_[0].pvBuffer = data_.data();
     buffers_[0].cbBuffer = stream_sizes_.cbHeader;
@@ -49,10 +62,43 @@ public:
     buffers_[2].pvBuffer = data_.data() + stream_sizes_.cbHeader + size_consumed;
     buffers_[2].cbBuffer = stream_sizes_.cbTrailer;
 
+    rate_limit.consume(overhead + size_consumed, token_bucket::clock_type::now());
     return size_consumed;
   }
 
+  // Limits the rate of the records produced. Writes must wait for
+  // the delay of the bucket before producing a record.
+  token_bucket rate_limit;
+
+  // Frees the buffer. It is allocated again if needed.
+  void release() {
+    std::vector<char>().swap(data_);
+  }
+
+  // The number of bytes held by the buffer
+  std::size_t buffer_memory() const {
+    return data_.capacity();
+  }
+
+  // The maximum size of the data in a record or zero if not known,
+  // e.g. before the handshake is done
+  std::size_t max_message_size() {
+    SECURITY_STATUS sc = SEC_E_OK;
+    return query_stream_sizes(sc) ? stream_sizes_.cbMaximumMessage : 0;
+  }
+
 private:
+  bool query_stream_sizes(SECURITY_STATUS& sc) {
+    if (data_.empty()) {
+      sc = sspi_functions::QueryContextAttributes(ctxt_handle_.get(), SECPKG_ATTR_STREAM_SIZES, &stream_sizes_);
+      if (sc != SEC_E_OK) {
+        return false;
+      }
+      data_.resize(stream_sizes_.cbHeader + stream_sizes_.cbMaximumMessage + stream_sizes_.cbTrailer);
+    }
+    return true;
+  }
+
   ctxt_handle& ctxt_handle_;
   std::vector<char> data_;
   SecPkgContext_StreamSizes stream_sizes_{0, 0, 0, 0, 0};
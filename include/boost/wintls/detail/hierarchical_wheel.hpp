@@ -0,0 +1,202 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_HIERARCHICAL_WHEEL_HPP
+#define BOOST_WINTLS_DETAIL_HIERARCHICAL_WHEEL_HPP
+
+#include <boost/assert.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+struct wheel_link {
+  wheel_link* prev = nullptr;
+  wheel_link* next = nullptr;
+};
+
+// An entry in a hierarchical_wheel, owned by the user of the wheel
+struct wheel_entry : wheel_link {
+  bool linked() const {
+    return next != nullptr;
+  }
+
+  std::uint64_t tick = 0;
+  std::function<void()> on_expiry;
+};
+
+// Hierarchical timing wheel with four levels of 64 slots each.
+//
+// Level 0 has a slot per tick and every slot of a higher level covers
+// a whole turn of the level below. Adding and removing an entry only
+// links or unlinks it from the list of a slot. An entry on a higher
+// level is moved one level down when the level below has turned
+// around to the ticks covered by its slot, so each entry is moved at
+// most three times before it expires.
+//
+// Expiry ticks further ahead than the levels cover are kept on the
+// highest level until they are in range.
+class hierarchical_wheel {
+public:
+  static constexpr unsigned slot_bits = 6;
+  static constexpr unsigned levels = 4;
+  static constexpr std::size_t slots = std::size_t{1} << slot_bits;
+
+  hierarchical_wheel() {
+    for (auto& head : heads_) {
+      head.prev = &head;
+      head.next = &head;
+    }
+  }
+
+  hierarchical_wheel(const hierarchical_wheel&) = delete;
+  hierarchical_wheel& operator=(const hierarchical_wheel&) = delete;
+
+  // The number of entries in the wheel
+  std::size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // The next tick to be processed by advance()
+  std::uint64_t next_tick() const {
+    return next_tick_;
+  }
+
+  // Moves the wheel to the given tick without processing the ticks
+  // in between. Only possible when empty.
+  void reset(std::uint64_t tick) {
+    BOOST_ASSERT(empty());
+    next_tick_ = tick;
+  }
+
+  // Adds an entry expiring at the given tick. Ticks already processed
+  // expire at the next tick.
+  void add(wheel_entry& entry, std::uint64_t tick) {
+    BOOST_ASSERT(!entry.linked());
+    entry.tick = tick;
+    link(slot_for(tick), entry);
+    ++size_;
+  }
+
+  // Removes an entry if it is in the wheel
+  void remove(wheel_entry& entry) {
+    if (!entry.linked()) {
+      return;
+    }
+    unlink(entry);
+    --size_;
+  }
+
+  // Processes all ticks up to and including the given tick, removing
+  // the entries expiring and passing them to the function, which must
+  // not add or remove entries
+  template <class Function>
+  void advance(std::uint64_t tick, Function&& expired) {
+    while (next_tick_ <= tick) {
+      const auto index = next_tick_ & (slots - 1);
+      if (index == 0) {
+        for (unsigned level = 1; level < levels && cascade(level) == 0; ++level) {
+        }
+      }
+
+      auto& head = heads_[index];
+      while (head.next != &head) {
+        auto& entry = static_cast<wheel_entry&>(*head.next);
+        unlink(entry);
+        if (entry.tick > next_tick_) {
+          // Was out of range when added
+          link(slot_for(entry.tick), entry);
+          continue;
+        }
+        --size_;
+        expired(entry);
+      }
+      ++next_tick_;
+    }
+  }
+
+private:
+  static constexpr std::uint64_t range = std::uint64_t{1} << (slot_bits * levels);
+
+  wheel_link& slot_for(std::uint64_t tick) {
+    if (tick <= next_tick_) {
+      return heads_[next_tick_ & (slots - 1)];
+    }
+    const auto delta = tick - next_tick_;
+    if (delta >= range) {
+      tick = next_tick_ + range - 1;
+    }
+    unsigned level = 0;
+    while (level + 1 < levels && delta >= (std::uint64_t{1} << (slot_bits * (level + 1)))) {
+      ++level;
+    }
+    return heads_[level * slots + ((tick >> (slot_bits * level)) & (slots - 1))];
+  }
+
+  // Moves the entries of the current slot of a level to the levels
+  // below, returning the index of that slot
+  std::size_t cascade(unsigned level) {
+    const auto index = static_cast<std::size_t>((next_tick_ >> (slot_bits * level)) & (slots - 1));
+    auto& head = heads_[level * slots + index];
+    wheel_link pending;
+    pending.prev = &pending;
+    pending.next = &pending;
+    splice(head, pending);
+    while (pending.next != &pending) {
+      auto& entry = static_cast<wheel_entry&>(*pending.next);
+      unlink(entry);
+      link(slot_for(entry.tick), entry);
+    }
+    return index;
+  }
+
+  static void link(wheel_link& head, wheel_link& entry) {
+    entry.prev = head.prev;
+    entry.next = &head;
+    head.prev->next = &entry;
+    head.prev = &entry;
+  }
+
+  static void unlink(wheel_link& entry) {
+    entry.prev->next = entry.next;
+    entry.next->prev = entry.prev;
+    entry.prev = nullptr;
+    entry.next = nullptr;
+  }
+
+  // Moves all entries of one list to another, empty, list
+  static void splice(wheel_link& from, wheel_link& to) {
+    if (from.next == &from) {
+      return;
+    }
+    to.next = from.next;
+    to.prev = from.prev;
+    to.next->prev = &to;
+    to.prev->next = &to;
+    from.prev = &from;
+    from.next = &from;
+  }
+
+  std::array<wheel_link, levels * slots> heads_;
+  std::uint64_t next_tick_ = 0;
+  std::size_t size_ = 0;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_HIERARCHICAL_WHEEL_HPP
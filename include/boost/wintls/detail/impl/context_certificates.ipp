@@ -0,0 +1,139 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_IMPL_CONTEXT_CERTIFICATES_IPP
+#define BOOST_WINTLS_DETAIL_IMPL_CONTEXT_CERTIFICATES_IPP
+
+#include <boost/wintls/detail/context_certificates.hpp>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+BOOST_WINTLS_DECL context_certificates::context_certificates(const context_certificates& other)
+  : use_default_cert_store(other.use_default_cert_store)
+  , check_revocation(other.check_revocation)
+  , cert_store_(other.cert_store_)
+  , shared_store_(other.shared_store_)
+  , engine_(other.engine_) {
+  if (other.server_cert) {
+    server_cert = cert_context_ptr{CertDuplicateCertificateContext(other.server_cert.get()), &CertFreeCertificateContext};
+  }
+  if (other.client_cert) {
+    client_cert = cert_context_ptr{CertDuplicateCertificateContext(other.client_cert.get()), &CertFreeCertificateContext};
+  }
+  for (const auto& cert : other.server_chain) {
+    server_chain.emplace_back(CertDuplicateCertificateContext(cert.get()), &CertFreeCertificateContext);
+  }
+}
+
+BOOST_WINTLS_DECL void context_certificates::add_certificate_authority(const CERT_CONTEXT* cert) {
+  auto store = copy_cert_store();
+  if(!CertAddCertificateContextToStore(store.get(),
+                                       cert,
+                                       CERT_STORE_ADD_ALWAYS,
+                                       nullptr)) {
+    throw_last_error("CertAddCertificateContextToStore");
+  }
+  cert_store_ = std::move(store);
+  engine_ = std::make_shared<verification_engine>();
+}
+
+BOOST_WINTLS_DECL void context_certificates::add_certificate_authorities(const std::vector<cert_context_ptr>& certs) {
+  // Copies the store once for all the certificates
+  auto store = copy_cert_store();
+  for (const auto& cert : certs) {
+    if(!CertAddCertificateContextToStore(store.get(),
+                                         cert.get(),
+                                         CERT_STORE_ADD_ALWAYS,
+                                         nullptr)) {
+      throw_last_error("CertAddCertificateContextToStore");
+    }
+  }
+  cert_store_ = std::move(store);
+  engine_ = std::make_shared<verification_engine>();
+}
+
+BOOST_WINTLS_DECL void context_certificates::use_shared_store(std::shared_ptr<const trust_store_state> store) {
+  shared_store_ = std::move(store);
+  engine_ = std::make_shared<verification_engine>();
+}
+
+BOOST_WINTLS_DECL HRESULT context_certificates::verify_certificate(const CERT_CONTEXT* cert, DWORD auth_type) const {
+  HRESULT status = CERT_E_UNTRUSTEDROOT;
+
+  if (cert_store_ || shared_store_) {
+    HCERTCHAINENGINE engine = nullptr;
+    try {
+      engine = chain_engine();
+    } catch (const boost::system::system_error& e) {
+      return e.code().value();
+    }
+    status = verify_certificate_chain(cert, engine, auth_type, check_revocation);
+  }
+
+  if (status != ERROR_SUCCESS && use_default_cert_store) {
+    // Calling CertGetCertificateChain with a NULL pointer engine uses
+    // the default system certificate store
+    status = verify_certificate_chain(cert, nullptr, auth_type, check_revocation);
+  }
+
+  return status;
+}
+
+BOOST_WINTLS_DECL void context_certificates::warm_up() const {
+  if (cert_store_ || shared_store_) {
+    chain_engine();
+  }
+}
+
+// The certificates are never modified once they are used for
+// verification, so the chain engine is created on first use and
+// reused after that, also by copies made before the certificate
+// authorities are changed.
+BOOST_WINTLS_DECL HCERTCHAINENGINE context_certificates::chain_engine() const {
+  if (!cert_store_) {
+    return shared_store_->engine->get();
+  }
+
+  std::lock_guard<std::mutex> lock(engine_->mutex);
+  if (!engine_->engine) {
+    HCERTSTORE roots = cert_store_.get();
+    if (shared_store_) {
+      // Trust the certificates from both stores without copying the
+      // certificates from the shared store
+      engine_->roots = open_cert_store(CERT_STORE_PROV_COLLECTION);
+      if (!CertAddStoreToCollection(engine_->roots.get(), shared_store_->store.get(), 0, 0) ||
+          !CertAddStoreToCollection(engine_->roots.get(), cert_store_.get(), 0, 0)) {
+        throw_last_error("CertAddStoreToCollection");
+      }
+      roots = engine_->roots.get();
+    }
+    engine_->engine = std::make_unique<cert_chain_engine>(roots);
+  }
+  return engine_->engine->get();
+}
+
+BOOST_WINTLS_DECL context_certificates::shared_cert_store context_certificates::copy_cert_store() const {
+  shared_cert_store store = open_cert_store(CERT_STORE_PROV_MEMORY);
+  if (cert_store_) {
+    const CERT_CONTEXT* cert = nullptr;
+    while ((cert = CertEnumCertificatesInStore(cert_store_.get(), cert)) != nullptr) {
+      if (!CertAddCertificateContextToStore(store.get(), cert, CERT_STORE_ADD_ALWAYS, nullptr)) {
+        CertFreeCertificateContext(cert);
+        throw_last_error("CertAddCertificateContextToStore");
+      }
+    }
+  }
+  return store;
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_IMPL_CONTEXT_CERTIFICATES_IPP
@@ -0,0 +1,229 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_IMPL_SSPI_DECRYPT_IPP
+#define BOOST_WINTLS_DETAIL_IMPL_SSPI_DECRYPT_IPP
+
+#include <boost/wintls/detail/sspi_decrypt.hpp>
+#include <boost/wintls/detail/trace.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+BOOST_WINTLS_DECL sspi_decrypt::state sspi_decrypt::operator()(record_buffer& record) {
+  if (decrypted_data_ && !decrypted_data_->empty()) {
+    // Data left over from reading part of a record is not in place
+    // anymore, so that is handed out as a copy
+    auto copy = std::make_shared<std::vector<char>>(decrypted_data_->size());
+    size_decrypted = decrypted_data_->get(net::buffer(*copy));
+    record = record_buffer{copy, net::buffer(*copy)};
+    release_if_idle();
+    return state::data_available;
+  }
+
+  net::const_buffer data;
+  const auto result = decrypt_message(data);
+  if (result != state::data_available) {
+    return result;
+  }
+
+  // The record stays where it was decrypted and the buffer is shared
+  // with the record buffer, so nothing is copied
+  size_decrypted = data.size();
+  record = record_buffer{storage_, data};
+  consume_input();
+  release_if_idle();
+  return state::data_available;
+}
+
+BOOST_WINTLS_DECL net::mutable_buffer sspi_decrypt::input_buffer() {
+  if (closed_) {
+    return {};
+  }
+  if (!storage_) {
+    acquire_storage();
+  } else {
+    make_room();
+  }
+  const auto end = storage_->encrypted_data.data() + buffer_size;
+  const auto begin = static_cast<char*>(buffers_[0].pvBuffer) + buffers_[0].cbBuffer;
+  const auto free = net::buffer(begin, static_cast<std::size_t>(end - begin));
+  offered_ = adaptive_read_size ? read_ahead_.next(free.size(), missing_) : free.size();
+  if (rate_limit.limited()) {
+    offered_ = std::min(offered_, rate_limit.burst_size());
+  }
+  return net::buffer(free.data(), offered_);
+}
+
+BOOST_WINTLS_DECL void sspi_decrypt::size_read(std::size_t size) {
+  buffers_[0].cbBuffer += static_cast<unsigned long>(size);
+  read_ahead_.update(offered_, size, missing_, buffer_size);
+  missing_ = 0;
+  rate_limit.consume(size, token_bucket::clock_type::now());
+  ++statistics_.reads;
+  statistics_.bytes_read += size;
+}
+
+BOOST_WINTLS_DECL void sspi_decrypt::release() {
+  closed_ = true;
+  release_storage();
+  decrypted_data_.reset();
+}
+
+BOOST_WINTLS_DECL sspi_decrypt::state sspi_decrypt::decrypt_message(net::const_buffer& data) {
+  if (closed_) {
+    return state::error;
+  }
+
+  if (!storage_) {
+    if (use_buffer_pool) {
+      // A buffer is taken from the pool when there is data to read
+      return state::data_needed;
+    }
+    acquire_storage();
+  }
+
+  if (buffers_[0].cbBuffer == 0) {
+    return state::data_needed;
+  }
+
+  buffers_[0].BufferType = SECBUFFER_DATA;
+  buffers_[1].BufferType = SECBUFFER_EMPTY;
+  buffers_[2].BufferType = SECBUFFER_EMPTY;
+  buffers_[3].BufferType = SECBUFFER_EMPTY;
+
+  if (offloaded) {
+    data = net::const_buffer(buffers_[0].pvBuffer, buffers_[0].cbBuffer);
+    return state::data_available;
+  }
+
+  const auto input = buffers_[0].pvBuffer;
+  const auto size = buffers_[0].cbBuffer;
+  last_error_ = detail::sspi_functions::DecryptMessage(ctxt_handle_.get(), buffers_, 0, nullptr);
+
+  if (last_error_ == SEC_E_INCOMPLETE_MESSAGE) {
+    buffers_[0].cbBuffer = size;
+    missing_ = 0;
+    for (std::size_t i = 1; i < 4; ++i) {
+      if (buffers_[i].BufferType == SECBUFFER_MISSING) {
+        missing_ = buffers_[i].cbBuffer;
+      }
+    }
+    BOOST_WINTLS_TRACE_INCOMPLETE_MESSAGE(&ctxt_handle_, size, missing_);
+    return state::data_needed;
+  }
+
+  if (last_error_ == SEC_I_CONTEXT_EXPIRED) {
+    // The peer sent a close_notify alert, so nothing more will be
+    // decrypted. The security context is still needed for sending a
+    // close_notify alert in return, unless that has been sent already.
+    release();
+    if (close_notify_sent) {
+      ctxt_handle_.reset();
+    }
+    return state::error;
+  }
+
+  if (last_error_ != SEC_E_OK) {
+    return state::error;
+  }
+  ++statistics_.records;
+
+  // The first buffer now refers to the record header only, the input
+  // is needed again to know what has been consumed
+  buffers_[0].pvBuffer = input;
+  buffers_[0].cbBuffer = size;
+
+  data = net::const_buffer{};
+  if (buffers_[1].BufferType == SECBUFFER_DATA) {
+    data = net::const_buffer(buffers_[1].pvBuffer, buffers_[1].cbBuffer);
+  }
+  BOOST_WINTLS_TRACE_RECORD_DECRYPTED(&ctxt_handle_,
+                                      data.size(),
+                                      buffers_[3].BufferType == SECBUFFER_EXTRA ? size - buffers_[3].cbBuffer : size);
+  return state::data_available;
+}
+
+BOOST_WINTLS_DECL void sspi_decrypt::consume_input() {
+  // Any data received after the record is decrypted where it is, it is
+  // only moved when more room is needed
+  if (buffers_[3].BufferType == SECBUFFER_EXTRA) {
+    buffers_[0].pvBuffer = buffers_[3].pvBuffer;
+    buffers_[0].cbBuffer = buffers_[3].cbBuffer;
+  } else {
+    buffers_[0].pvBuffer = static_cast<char*>(buffers_[0].pvBuffer) + buffers_[0].cbBuffer;
+    buffers_[0].cbBuffer = 0;
+  }
+}
+
+BOOST_WINTLS_DECL void sspi_decrypt::acquire_storage() {
+  if (use_buffer_pool) {
+    // Returned to the pool when neither the stream nor any record
+    // buffer refers to it anymore
+    storage_ = std::shared_ptr<storage>{storage_pool::instance().acquire().release(), [](storage* s) {
+      storage_pool::instance().release(std::unique_ptr<storage>{s});
+    }};
+  } else {
+    storage_ = std::make_shared<storage>();
+  }
+  buffers_[0].pvBuffer = storage_->encrypted_data.data();
+  buffers_[0].cbBuffer = 0;
+}
+
+BOOST_WINTLS_DECL void sspi_decrypt::release_storage() {
+  storage_.reset();
+  buffers_[0].pvBuffer = nullptr;
+  buffers_[0].cbBuffer = 0;
+}
+
+BOOST_WINTLS_DECL void sspi_decrypt::release_if_idle() {
+  if (use_buffer_pool && buffers_[0].cbBuffer == 0 && (!decrypted_data_ || decrypted_data_->empty())) {
+    release_storage();
+    decrypted_data_.reset();
+  }
+}
+
+BOOST_WINTLS_DECL void sspi_decrypt::make_room() {
+  const auto begin = storage_->encrypted_data.data();
+  const auto input = static_cast<char*>(buffers_[0].pvBuffer);
+  const auto used = static_cast<std::size_t>(input - begin) + buffers_[0].cbBuffer;
+  if (input == begin) {
+    return;
+  }
+  if (buffers_[0].cbBuffer == 0 && storage_.use_count() == 1) {
+    buffers_[0].pvBuffer = begin;
+    return;
+  }
+  if (buffer_size - used >= std::max(std::size_t{max_record_size}, missing_)) {
+    return;
+  }
+
+  // The data not decrypted yet is moved to the front, at most once per
+  // read. Records still referred to by record buffers must stay where
+  // they are, so if there are any it is moved to a new buffer instead.
+  const auto input_size = buffers_[0].cbBuffer;
+  if (storage_.use_count() == 1) {
+    std::memmove(begin, input, input_size);
+    buffers_[0].pvBuffer = begin;
+  } else {
+    const auto previous = std::move(storage_);
+    acquire_storage();
+    std::memcpy(storage_->encrypted_data.data(), input, input_size);
+    buffers_[0].cbBuffer = input_size;
+  }
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_IMPL_SSPI_DECRYPT_IPP
@@ -0,0 +1,286 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_IMPL_SSPI_HANDSHAKE_IPP
+#define BOOST_WINTLS_DETAIL_IMPL_SSPI_HANDSHAKE_IPP
+
+#include <boost/wintls/detail/sspi_handshake.hpp>
+#include <boost/wintls/detail/trace.hpp>
+
+#include <boost/wintls/context.hpp>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+BOOST_WINTLS_DECL void sspi_handshake::operator()(handshake_type type) {
+  switch(type) {
+    case handshake_type::client:
+      start_client();
+      break;
+    case handshake_type::server:
+      start_server();
+      break;
+  }
+}
+
+BOOST_WINTLS_DECL void sspi_handshake::start_client() {
+  BOOST_WINTLS_TRACE_HANDSHAKE_START(&ctxt_handle_, false);
+  if (!acquire_credentials(handshake_type::client)) {
+    BOOST_WINTLS_TRACE_HANDSHAKE_FAILED(&ctxt_handle_, last_error_);
+    return;
+  }
+
+  DWORD out_flags = 0;
+  handshake_output_buffers buffers;
+  last_error_ = detail::sspi_functions::InitializeSecurityContext(cred_handle_->get(),
+                                                                  nullptr,
+                                                                  server_hostname_.get(),
+                                                                  client_context_flags,
+                                                                  0,
+                                                                  SECURITY_NATIVE_DREP,
+                                                                  nullptr,
+                                                                  0,
+                                                                  ctxt_handle_.get(),
+                                                                  buffers,
+                                                                  &out_flags,
+                                                                  nullptr);
+  BOOST_WINTLS_TRACE_HANDSHAKE_STEP(&ctxt_handle_, last_error_, 0, buffers[0].cbBuffer);
+  if (last_error_ != SEC_I_CONTINUE_NEEDED) {
+    BOOST_WINTLS_TRACE_HANDSHAKE_FAILED(&ctxt_handle_, last_error_);
+  } else {
+    acquire_input();
+  }
+  if (buffers[0].cbBuffer != 0 && buffers[0].pvBuffer != nullptr) {
+    out_buffer_ = sspi_context_buffer{buffers[0].pvBuffer, buffers[0].cbBuffer};
+  }
+}
+
+BOOST_WINTLS_DECL void sspi_handshake::start_server() {
+  BOOST_WINTLS_TRACE_HANDSHAKE_START(&ctxt_handle_, true);
+  if (!acquire_credentials(handshake_type::server)) {
+    BOOST_WINTLS_TRACE_HANDSHAKE_FAILED(&ctxt_handle_, last_error_);
+    return;
+  }
+  acquire_input();
+  last_error_ = SEC_I_CONTINUE_NEEDED;
+}
+
+BOOST_WINTLS_DECL sspi_handshake::state sspi_handshake::operator()() {
+  switch(handshake_type_) {
+    case handshake_type::client:
+      return client_step();
+    case handshake_type::server:
+      return server_step();
+  }
+  return state::error;
+}
+
+BOOST_WINTLS_DECL sspi_handshake::state sspi_handshake::client_step() {
+  state pending;
+  if (!ready(pending)) {
+    return pending;
+  }
+
+  handshake_output_buffers out_buffers;
+  DWORD out_flags = 0;
+  last_error_ = detail::sspi_functions::InitializeSecurityContext(cred_handle_->get(),
+                                                                  ctxt_handle_.get(),
+                                                                  server_hostname_.get(),
+                                                                  client_context_flags,
+                                                                  0,
+                                                                  SECURITY_NATIVE_DREP,
+                                                                  input_buffers_,
+                                                                  0,
+                                                                  nullptr,
+                                                                  out_buffers,
+                                                                  &out_flags,
+                                                                  nullptr);
+  BOOST_WINTLS_TRACE_HANDSHAKE_STEP(&ctxt_handle_, last_error_, input_buffers_[0].cbBuffer, out_buffers[0].cbBuffer);
+  return step_result(out_buffers);
+}
+
+BOOST_WINTLS_DECL sspi_handshake::state sspi_handshake::server_step() {
+  state pending;
+  if (!ready(pending)) {
+    return pending;
+  }
+
+  handshake_output_buffers out_buffers;
+  DWORD out_flags = 0;
+  TimeStamp expiry;
+  last_error_ = detail::sspi_functions::AcceptSecurityContext(cred_handle_->get(),
+                                                              ctxt_handle_ ? ctxt_handle_.get() : nullptr,
+                                                              input_buffers_,
+                                                              snapshot_->verify_client_certificate
+                                                                ? server_context_flags | ASC_REQ_MUTUAL_AUTH
+                                                                : server_context_flags,
+                                                              SECURITY_NATIVE_DREP,
+                                                              ctxt_handle_.get(),
+                                                              out_buffers,
+                                                              &out_flags,
+                                                              &expiry);
+  BOOST_WINTLS_TRACE_HANDSHAKE_STEP(&ctxt_handle_, last_error_, input_buffers_[0].cbBuffer, out_buffers[0].cbBuffer);
+  return step_result(out_buffers);
+}
+
+BOOST_WINTLS_DECL bool sspi_handshake::acquire_credentials(handshake_type type) {
+  handshake_type_ = type;
+  // Keep using the configuration of the context at the time the
+  // handshake was started even if the context is modified meanwhile
+  snapshot_ = context_.snapshot();
+
+  cred_handle_ = snapshot_->credentials_handle(handshake_type_, last_error_);
+  return last_error_ == SEC_E_OK;
+}
+
+BOOST_WINTLS_DECL bool sspi_handshake::ready(state& pending) {
+  if (last_error_ != SEC_I_CONTINUE_NEEDED && last_error_ != SEC_E_INCOMPLETE_MESSAGE) {
+    pending = state::error;
+    return false;
+  }
+  if (!out_buffer_.empty()) {
+    pending = state::data_available;
+    return false;
+  }
+  if (input_buffers_[0].cbBuffer == 0) {
+    pending = state::data_needed;
+    return false;
+  }
+
+  input_buffers_[1].BufferType = SECBUFFER_EMPTY;
+  input_buffers_[1].pvBuffer = nullptr;
+  input_buffers_[1].cbBuffer = 0;
+  return true;
+}
+
+BOOST_WINTLS_DECL sspi_handshake::state sspi_handshake::step_result(handshake_output_buffers& out_buffers) {
+  // Traced here as all ways of performing the handshake end up here
+  const auto result = next_state(out_buffers);
+  if (result == state::done) {
+    BOOST_WINTLS_TRACE_HANDSHAKE_DONE(&ctxt_handle_);
+    release();
+  } else if (result == state::error) {
+    BOOST_WINTLS_TRACE_HANDSHAKE_FAILED(&ctxt_handle_, last_error_);
+    release();
+  }
+  return result;
+}
+
+BOOST_WINTLS_DECL sspi_handshake::state sspi_handshake::next_state(handshake_output_buffers& out_buffers) {
+  if (input_buffers_[1].BufferType == SECBUFFER_EXTRA) {
+    // Some data needs to be reused for the next call, move that to the front for reuse
+    const auto previous_size = input_buffers_[0].cbBuffer;
+    const auto extra_size = input_buffers_[1].cbBuffer;
+    const auto extra_data_begin = input_data_->data.begin() + previous_size - extra_size;
+    const auto extra_data_end = input_data_->data.begin() + previous_size;
+
+    std::move(extra_data_begin, extra_data_end, input_data_->data.begin());
+    input_buffers_[0].cbBuffer = extra_size;
+    in_buffer_ = net::buffer(input_data_->data) + extra_size;
+
+    BOOST_ASSERT_MSG(in_buffer_.size() > 0, "buffer not large enough for tls handshake message");
+    return state::data_needed;
+  } else if (last_error_ == SEC_E_INCOMPLETE_MESSAGE) {
+    BOOST_WINTLS_TRACE_INCOMPLETE_MESSAGE(&ctxt_handle_,
+                                          input_buffers_[0].cbBuffer,
+                                          input_buffers_[1].BufferType == SECBUFFER_MISSING ? input_buffers_[1].cbBuffer : 0);
+    BOOST_ASSERT_MSG(in_buffer_.size() > 0, "buffer not large enough for tls handshake message");
+    return state::data_needed;
+  } else {
+    input_buffers_[0].cbBuffer = 0;
+    in_buffer_ = net::buffer(input_data_->data);
+  }
+
+  if (out_buffers[0].cbBuffer != 0 && out_buffers[0].pvBuffer != nullptr) {
+    out_buffer_ = sspi_context_buffer{out_buffers[0].pvBuffer, out_buffers[0].cbBuffer};
+    return state::data_available;
+  }
+
+  switch (last_error_) {
+    case SEC_I_CONTINUE_NEEDED:
+      return state::data_needed;
+
+    case SEC_E_OK: {
+      const bool is_server = handshake_type_ == handshake_type::server;
+      if (is_server ? snapshot_->verify_client_certificate : snapshot_->verify_server_certificate) {
+        const CERT_CONTEXT* ctx_ptr = nullptr;
+        last_error_ = detail::sspi_functions::QueryContextAttributes(ctxt_handle_.get(), SECPKG_ATTR_REMOTE_CERT_CONTEXT, &ctx_ptr);
+        if (last_error_ != SEC_E_OK) {
+          return state::error;
+        }
+
+        cert_context_ptr remote_cert{ctx_ptr, &CertFreeCertificateContext};
+
+        last_error_ = snapshot_->certificates.verify_certificate(remote_cert.get(),
+                                                                 is_server ? AUTHTYPE_CLIENT : AUTHTYPE_SERVER);
+        BOOST_WINTLS_TRACE_HANDSHAKE_VERIFY(&ctxt_handle_, last_error_);
+        if (last_error_ != SEC_E_OK) {
+          return state::error;
+        }
+      }
+
+      done_ = true;
+      return state::done;
+    }
+
+    // Not expected as any client certificate is part of the
+    // credentials and Schannel is told to use only those
+    case SEC_I_INCOMPLETE_CREDENTIALS:
+      return state::error;
+
+    case SEC_I_RENEGOTIATE:
+      BOOST_ASSERT_MSG(false, "renegotiation not implemented");
+
+    default:
+      return state::error;
+  }
+}
+
+BOOST_WINTLS_DECL void sspi_handshake::size_written(std::size_t size) {
+  BOOST_VERIFY(size == out_buffer_.size());
+  out_buffer_ = sspi_context_buffer{};
+}
+
+BOOST_WINTLS_DECL void sspi_handshake::size_read(std::size_t size) {
+  input_buffers_[0].cbBuffer += static_cast<ULONG>(size);
+  in_buffer_ = net::buffer(input_data_->data) + input_buffers_[0].cbBuffer;
+}
+
+BOOST_WINTLS_DECL void sspi_handshake::set_server_hostname(const std::string& hostname) {
+  const auto size = hostname.size() + 1;
+  server_hostname_ = std::make_unique<WCHAR[]>(size);
+  const auto size_converted = mbstowcs(server_hostname_.get(), hostname.c_str(), size);
+  BOOST_VERIFY_MSG(size_converted == hostname.size(), "mbstowcs");
+}
+
+BOOST_WINTLS_DECL void sspi_handshake::release() {
+  input_data_.reset();
+  input_buffers_[0].pvBuffer = nullptr;
+  input_buffers_[0].cbBuffer = 0;
+  in_buffer_ = net::mutable_buffer{};
+  out_buffer_ = sspi_context_buffer{};
+}
+
+BOOST_WINTLS_DECL void sspi_handshake::acquire_input() {
+  if (use_buffer_pool) {
+    input_data_ = std::shared_ptr<input_storage>{input_pool::instance().acquire().release(), [](input_storage* s) {
+      input_pool::instance().release(std::unique_ptr<input_storage>{s});
+    }};
+  } else {
+    input_data_ = std::make_shared<input_storage>();
+  }
+  input_buffers_[0].pvBuffer = input_data_->data.data();
+  input_buffers_[0].cbBuffer = 0;
+  in_buffer_ = net::buffer(input_data_->data);
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_IMPL_SSPI_HANDSHAKE_IPP
@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_MAKE_TRAFFIC_SECRET_HPP
+#define BOOST_WINTLS_DETAIL_MAKE_TRAFFIC_SECRET_HPP
+
+#include <boost/wintls/traffic_keys.hpp>
+
+#include <cstddef>
+#include <string>
+
+// Does not depend on any Windows headers, so it can be built and
+// tested on any platform
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// The algorithm identifiers are NUL terminated wide strings of ASCII
+// characters
+template <std::size_t N>
+std::string algorithm_id(const wchar_t (&id)[N]) {
+  std::string result;
+  for (std::size_t i = 0; i < N && id[i] != L'\0'; ++i) {
+    result.push_back(static_cast<char>(id[i]));
+  }
+  return result;
+}
+
+// Converts the traffic secret of one direction as returned by
+// Schannel. Taking any structure with the same members allows using
+// secrets from elsewhere, e.g. a stand-in when Schannel does not
+// provide them.
+template <class TrafficSecrets>
+traffic_secret make_traffic_secret(const TrafficSecrets& secrets) {
+  traffic_secret result;
+  result.cipher = algorithm_id(secrets.SymmetricAlgId);
+  result.chaining_mode = algorithm_id(secrets.ChainingMode);
+  result.hash = algorithm_id(secrets.HashAlgId);
+  result.key_size = secrets.KeySize;
+  result.iv_size = secrets.IvSize;
+  result.sequence_number = secrets.MsgSequenceStart;
+  result.secret.assign(secrets.TrafficSecret, secrets.TrafficSecret + secrets.TrafficSecretSize);
+  return result;
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_MAKE_TRAFFIC_SECRET_HPP
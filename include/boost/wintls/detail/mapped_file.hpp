@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_MAPPED_FILE_HPP
+#define BOOST_WINTLS_DETAIL_MAPPED_FILE_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/error.hpp>
+
+#include <boost/asio/buffer.hpp>
+
+#include <string>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// A read only view of a whole file mapped into memory
+class mapped_file {
+public:
+  explicit mapped_file(const std::string& filename) {
+    file_ = CreateFileA(filename.c_str(),
+                        GENERIC_READ,
+                        FILE_SHARE_READ,
+                        nullptr,
+                        OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL,
+                        nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      throw_last_error("CreateFileA");
+    }
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file_, &size)) {
+      fail("GetFileSizeEx");
+    }
+
+    // Mapping an empty file is not possible and not needed either
+    if (size.QuadPart == 0) {
+      return;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr) {
+      fail("CreateFileMappingA");
+    }
+
+    view_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (view_ == nullptr) {
+      fail("MapViewOfFile");
+    }
+    size_ = static_cast<std::size_t>(size.QuadPart);
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file() {
+    close();
+  }
+
+  net::const_buffer buffer() const {
+    return net::const_buffer(view_, size_);
+  }
+
+private:
+  void fail(const char* what) {
+    const auto ec = get_last_error();
+    close();
+    throw_error(ec, what);
+  }
+
+  void close() {
+    if (view_ != nullptr) {
+      UnmapViewOfFile(view_);
+    }
+    if (mapping_ != nullptr) {
+      CloseHandle(mapping_);
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(file_);
+    }
+  }
+
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+  LPVOID view_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_MAPPED_FILE_HPP
@@ -0,0 +1,108 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_OCSP_HPP
+#define BOOST_WINTLS_DETAIL_OCSP_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/cert_chain.hpp>
+#include <boost/wintls/detail/error.hpp>
+#include <boost/wintls/detail/win32_crypto.hpp>
+
+#include <boost/wintls/certificate.hpp>
+#include <boost/wintls/error.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// The validity period of an OCSP response for a single certificate.
+// The next update is the maximum time point if the responder did not
+// include one, meaning newer information is available at any time.
+struct ocsp_validity {
+  std::chrono::system_clock::time_point this_update;
+  std::chrono::system_clock::time_point next_update;
+};
+
+inline std::chrono::system_clock::time_point filetime_to_time_point(const FILETIME& ft) {
+  // FILETIME counts 100 nanosecond intervals since January 1, 1601
+  using filetime_duration = std::chrono::duration<std::int64_t, std::ratio<1, 10000000>>;
+  constexpr std::int64_t unix_epoch = 116444736000000000;
+  const auto ticks = static_cast<std::int64_t>(static_cast<std::uint64_t>(ft.dwHighDateTime) << 32 | ft.dwLowDateTime);
+  return std::chrono::system_clock::time_point{
+    std::chrono::duration_cast<std::chrono::system_clock::duration>(filetime_duration{ticks - unix_epoch})};
+}
+
+// Checks that the buffer holds a successful DER encoded OCSP response
+// for the given certificate and returns its validity period. The
+// signature of the response is not verified, that is left to the
+// clients it is stapled for.
+inline ocsp_validity parse_ocsp_response(const net::const_buffer& response, const CERT_CONTEXT* cert) {
+  const auto response_data = crypt_decode_object_ex(response, OCSP_RESPONSE);
+  const auto response_info = reinterpret_cast<const OCSP_RESPONSE_INFO*>(response_data.data());
+  if (response_info->dwStatus != OCSP_SUCCESSFUL_RESPONSE) {
+    throw_error(error::make_error_code(CRYPT_E_REVOCATION_OFFLINE), "OCSP response status");
+  }
+
+  const auto signed_data = crypt_decode_object_ex(net::buffer(response_info->Value.pbData, response_info->Value.cbData),
+                                                  OCSP_BASIC_SIGNED_RESPONSE);
+  const auto signed_info = reinterpret_cast<const OCSP_BASIC_SIGNED_RESPONSE_INFO*>(signed_data.data());
+
+  const auto basic_data = crypt_decode_object_ex(net::buffer(signed_info->ToBeSigned.pbData, signed_info->ToBeSigned.cbData),
+                                                 OCSP_BASIC_RESPONSE);
+  const auto basic_info = reinterpret_cast<const OCSP_BASIC_RESPONSE_INFO*>(basic_data.data());
+
+  const auto& serial = cert->pCertInfo->SerialNumber;
+  for (DWORD i = 0; i < basic_info->cResponseEntry; ++i) {
+    const auto& entry = basic_info->rgResponseEntry[i];
+    if (entry.CertId.SerialNumber.cbData != serial.cbData ||
+        std::memcmp(entry.CertId.SerialNumber.pbData, serial.pbData, serial.cbData) != 0) {
+      continue;
+    }
+    if (entry.dwCertStatus == OCSP_BASIC_REVOKED_CERT_STATUS) {
+      throw_error(error::make_error_code(CRYPT_E_REVOKED), "OCSP certificate status");
+    }
+    ocsp_validity validity;
+    validity.this_update = filetime_to_time_point(entry.ThisUpdate);
+    validity.next_update = entry.NextUpdate.dwLowDateTime == 0 && entry.NextUpdate.dwHighDateTime == 0
+      ? std::chrono::system_clock::time_point::max()
+      : filetime_to_time_point(entry.NextUpdate);
+    return validity;
+  }
+  throw_error(error::make_error_code(CRYPT_E_NOT_FOUND), "OCSP response for certificate");
+  BOOST_UNREACHABLE_RETURN(ocsp_validity{});
+}
+
+// Returns a copy of the certificate with the OCSP response attached,
+// which Schannel staples to the handshake when the certificate is used
+// as server certificate. The response is set on a copy as properties
+// are shared by all duplicates of a certificate context, and those
+// may still be used by other handshakes.
+inline cert_context_ptr staple_ocsp_response(const CERT_CONTEXT* cert,
+                                             const net::const_buffer& response,
+                                             const std::vector<cert_context_ptr>& intermediates) {
+  auto stapled = copy_with_chain(cert, intermediates);
+
+  CRYPT_DATA_BLOB blob{};
+  blob.cbData = static_cast<DWORD>(response.size());
+  blob.pbData = reinterpret_cast<BYTE*>(const_cast<void*>(response.data()));
+  if (!CertSetCertificateContextProperty(stapled.get(), CERT_OCSP_RESPONSE_PROP_ID, 0, &blob)) {
+    throw_last_error("CertSetCertificateContextProperty");
+  }
+  return stapled;
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_OCSP_HPP
@@ -0,0 +1,295 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_PEM_HPP
+#define BOOST_WINTLS_DETAIL_PEM_HPP
+
+#include <boost/wintls/detail/config.hpp>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/assert.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The vectorized base64 decoder is built on any x86 target and used
+// if the processor supports SSSE3, which is checked at run time unless
+// the compiler targets it anyway. Define BOOST_WINTLS_DISABLE_SSSE3 to
+// only build the scalar decoder.
+#if !defined(BOOST_WINTLS_DISABLE_SSSE3) && \
+  (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define BOOST_WINTLS_BASE64_SSSE3
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(BOOST_WINTLS_BASE64_SSSE3) && !defined(_MSC_VER)
+#define BOOST_WINTLS_SSSE3_TARGET __attribute__((target("ssse3")))
+#else
+#define BOOST_WINTLS_SSSE3_TARGET
+#endif
+
+// Everything in here is plain C++ without any dependencies on the
+// Windows API, so it can be tested and benchmarked on any platform.
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+namespace base64 {
+
+enum : std::uint8_t {
+  invalid = 0xff,
+  whitespace = 0xfe,
+  padding = 0xfd
+};
+
+struct decode_table {
+  decode_table() {
+    std::fill(std::begin(values), std::end(values), invalid);
+    const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (std::uint8_t i = 0; i < 64; ++i) {
+      values[static_cast<unsigned char>(alphabet[i])] = i;
+    }
+    for (auto c : {' ', '\t', '\r', '\n'}) {
+      values[static_cast<unsigned char>(c)] = whitespace;
+    }
+    values['='] = padding;
+  }
+
+  std::uint8_t values[256];
+};
+
+inline const decode_table& table() {
+  static const decode_table instance;
+  return instance;
+}
+
+[[noreturn]] inline void throw_invalid() {
+  throw boost::system::system_error(boost::system::errc::make_error_code(boost::system::errc::illegal_byte_sequence),
+                                    "base64_decode");
+}
+
+#ifdef BOOST_WINTLS_BASE64_SSSE3
+inline bool cpu_has_ssse3() {
+#if defined(__SSSE3__) || defined(__AVX__)
+  return true;
+#elif defined(_MSC_VER)
+  static const bool result = [] {
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+  }();
+  return result;
+#else
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+// Decodes 16 base64 characters into 12 bytes, but writes 16 bytes to
+// the output. Returns false without writing anything if any of the
+// characters are not part of the base64 alphabet, which includes
+// whitespace and padding.
+//
+// See: Wojciech Muła, Daniel Lemire, "Faster Base64 Encoding and
+// Decoding Using AVX2 Instructions"
+BOOST_WINTLS_SSSE3_TARGET inline bool decode_block(const char* in, std::uint8_t* out) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                       0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                         0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+  __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+
+  const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+  const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+  const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) {
+    return false;
+  }
+
+  // Translate the characters to their 6 bit values
+  const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+  const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+  str = _mm_add_epi8(str, roll);
+
+  // Pack the 6 bit values into 24 bit groups in big endian order
+  str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+  str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+  str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), str);
+  return true;
+}
+
+// Decodes as many whole blocks as possible starting at in[i] into
+// out[o], advancing both. The block decoder writes a few bytes more
+// than it decodes, so room is left for that at the end.
+BOOST_WINTLS_SSSE3_TARGET inline void decode_blocks(const char* in,
+                                                    std::size_t size,
+                                                    std::uint8_t* out,
+                                                    std::size_t out_size,
+                                                    std::size_t& i,
+                                                    std::size_t& o) {
+  while (size - i >= 16 && out_size - o >= 16 && decode_block(in + i, out + o)) {
+    i += 16;
+    o += 12;
+  }
+}
+#endif // BOOST_WINTLS_BASE64_SSSE3
+
+} // namespace base64
+
+// Upper bound of the number of bytes decoded from the given number of
+// base64 characters.
+inline std::size_t base64_decoded_size(std::size_t size) {
+  return (size + 3) / 4 * 3;
+}
+
+// Decodes base64 data ignoring any whitespace into the given buffer
+// which must be at least base64_decoded_size() bytes. Returns the
+// number of bytes decoded.
+//
+// Throws on invalid input.
+inline std::size_t base64_decode(const net::const_buffer& input, const net::mutable_buffer& output) {
+  const auto& table = base64::table().values;
+  const auto in = reinterpret_cast<const char*>(input.data());
+  const auto out = reinterpret_cast<std::uint8_t*>(output.data());
+  const auto size = input.size();
+  BOOST_ASSERT(output.size() >= base64_decoded_size(size));
+
+  std::size_t i = 0;
+  std::size_t o = 0;
+  std::uint32_t quad = 0;
+  std::size_t count = 0;
+  std::size_t padding = 0;
+#ifdef BOOST_WINTLS_BASE64_SSSE3
+  const bool vectorized = base64::cpu_has_ssse3();
+#endif
+  while (i < size) {
+#ifdef BOOST_WINTLS_BASE64_SSSE3
+    // Whole blocks between line breaks
+    if (vectorized && count == 0 && padding == 0) {
+      base64::decode_blocks(in, size, out, output.size(), i, o);
+      if (i == size) {
+        break;
+      }
+    }
+#endif
+    const auto value = table[static_cast<unsigned char>(in[i++])];
+    if (value == base64::whitespace) {
+      continue;
+    }
+    if (value == base64::padding) {
+      ++padding;
+      continue;
+    }
+    if (value == base64::invalid || padding != 0) {
+      base64::throw_invalid();
+    }
+    quad = quad << 6 | value;
+    if (++count == 4) {
+      out[o++] = static_cast<std::uint8_t>(quad >> 16);
+      out[o++] = static_cast<std::uint8_t>(quad >> 8);
+      out[o++] = static_cast<std::uint8_t>(quad);
+      quad = 0;
+      count = 0;
+    }
+  }
+
+  switch (count) {
+    case 0:
+      if (padding != 0) {
+        base64::throw_invalid();
+      }
+      break;
+    case 2:
+      if (padding != 0 && padding != 2) {
+        base64::throw_invalid();
+      }
+      out[o++] = static_cast<std::uint8_t>(quad >> 4);
+      break;
+    case 3:
+      if (padding != 0 && padding != 1) {
+        base64::throw_invalid();
+      }
+      out[o++] = static_cast<std::uint8_t>(quad >> 10);
+      out[o++] = static_cast<std::uint8_t>(quad >> 2);
+      break;
+    default:
+      base64::throw_invalid();
+  }
+  return o;
+}
+
+// Splits a buffer holding any number of PEM encoded objects with the
+// given label (e.g. "CERTIFICATE") into one buffer per object
+// including the header and footer lines. Anything outside the
+// objects, like comments in a CA bundle, is ignored.
+inline std::vector<net::const_buffer> pem_split(const net::const_buffer& pem, const std::string& label) {
+  const std::string header = "-----BEGIN " + label + "-----";
+  const std::string footer = "-----END " + label + "-----";
+
+  std::vector<net::const_buffer> objects;
+  const auto begin = reinterpret_cast<const char*>(pem.data());
+  const auto end = begin + pem.size();
+  auto it = begin;
+  while (true) {
+    const auto object_begin = std::search(it, end, header.begin(), header.end());
+    if (object_begin == end) {
+      break;
+    }
+    const auto footer_begin = std::search(object_begin + header.size(), end, footer.begin(), footer.end());
+    if (footer_begin == end) {
+      break;
+    }
+    it = footer_begin + footer.size();
+    objects.emplace_back(object_begin, static_cast<std::size_t>(it - object_begin));
+  }
+  return objects;
+}
+
+// Decodes the first PEM encoded object in the buffer regardless of
+// its label. Any headers between the BEGIN line and the base64 data,
+// like the ones used by encrypted keys, are not supported.
+inline std::vector<std::uint8_t> pem_decode(const net::const_buffer& pem) {
+  static const char begin_marker[] = "-----BEGIN ";
+  static const char end_marker[] = "-----END ";
+
+  const auto begin = reinterpret_cast<const char*>(pem.data());
+  const auto end = begin + pem.size();
+  auto header = std::search(begin, end, begin_marker, begin_marker + sizeof(begin_marker) - 1);
+  if (header == end) {
+    base64::throw_invalid();
+  }
+  const auto body = std::find(header, end, '\n');
+  const auto footer = std::search(body, end, end_marker, end_marker + sizeof(end_marker) - 1);
+  if (footer == end) {
+    base64::throw_invalid();
+  }
+
+  const auto base64_size = static_cast<std::size_t>(footer - body);
+  std::vector<std::uint8_t> data(base64_decoded_size(base64_size));
+  data.resize(base64_decode(net::buffer(body, base64_size), net::buffer(data)));
+  return data;
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_PEM_HPP
@@ -0,0 +1,30 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_PRIORITY_HPP
+#define BOOST_WINTLS_DETAIL_PRIORITY_HPP
+
+#include <cstddef>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Tag for selecting between overloads depending on which operations
+// a stream supports, preferring the overload with the highest
+// priority
+template <std::size_t N>
+struct priority : priority<N - 1> {};
+
+template <>
+struct priority<0> {};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_PRIORITY_HPP
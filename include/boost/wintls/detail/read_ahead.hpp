@@ -0,0 +1,68 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_READ_AHEAD_HPP
+#define BOOST_WINTLS_DETAIL_READ_AHEAD_HPP
+
+#include <algorithm>
+#include <cstddef>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Decides how much to read from the next layer at a time.
+//
+// Reads filling all of the space offered indicate more data is
+// waiting, as with bulk transfers, so the size is doubled to need
+// fewer reads. Reads returning less, as with interactive traffic,
+// shrink it towards twice the average size actually read, so data is
+// left in the next layer until the application asks for it. The
+// remainder of a partially received record is always read in one go,
+// which does not count as a full read.
+class read_ahead {
+public:
+  static constexpr std::size_t min_size = 0x400;
+  static constexpr std::size_t initial_size = 0x1000;
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // The number of bytes to read given the free space of the buffer
+  // and the number of bytes known to be missing from the current
+  // record, if any
+  std::size_t next(std::size_t available, std::size_t missing) const {
+    return std::min(available, std::max(size_, missing));
+  }
+
+  // Adjusts the size after reading the given number of bytes of the
+  // ones offered by next() with the same number of missing bytes
+  void update(std::size_t offered, std::size_t read, std::size_t missing, std::size_t max_size) {
+    // Exponential moving average weighing the latest read by 1/8
+    average_ = average_ - average_ / 8 + read / 8;
+    // Reading all of the remainder of a record says nothing about
+    // whether more data is waiting
+    const bool sized_by_record = missing > size_;
+    if (read == offered && offered >= size_ && !sized_by_record) {
+      size_ = std::min(size_ * 2, max_size);
+    } else if (read < offered) {
+      const auto observed = std::min(size_, average_ * 2);
+      size_ = observed < min_size ? min_size : observed;
+    }
+  }
+
+private:
+  std::size_t size_ = initial_size;
+  std::size_t average_ = initial_size;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_READ_AHEAD_HPP
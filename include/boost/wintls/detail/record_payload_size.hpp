@@ -0,0 +1,45 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_RECORD_PAYLOAD_SIZE_HPP
+#define BOOST_WINTLS_DETAIL_RECORD_PAYLOAD_SIZE_HPP
+
+#include <boost/wintls/detail/priority.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Whether the stream sends data in records of its own, as when
+// running TLS through a TLS tunnel
+template <typename Stream, typename = void>
+struct has_record_payload_size : std::false_type {};
+
+template <typename Stream>
+struct has_record_payload_size<Stream, decltype(std::declval<Stream&>().record_payload_size(), void())> : std::true_type {};
+
+// The maximum size of the data in a record of the stream, or zero if
+// the stream does not send records or the size is not known yet
+template <typename Stream>
+auto record_payload_size(Stream& stream, priority<1>) -> decltype(stream.record_payload_size()) {
+  return stream.record_payload_size();
+}
+
+template <typename Stream>
+std::size_t record_payload_size(Stream&, priority<0>) {
+  return 0;
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_RECORD_PAYLOAD_SIZE_HPP
@@ -11,6 +11,8 @@
 #include <boost/wintls/detail/sspi_functions.hpp>
 #include <boost/wintls/detail/config.hpp>
 
+#include <boost/asio/buffer.hpp>
+
 namespace boost {
 namespace wintls {
 namespace detail {
@@ -29,8 +31,11 @@ public:
   }
 
   sspi_context_buffer& operator=(sspi_context_buffer&& other) {
-    buffer_ = other.buffer_;
-    other.buffer_ = net::const_buffer{};
+    if (this != &other) {
+      detail::sspi_functions::FreeContextBuffer(const_cast<void*>(buffer_.data()));
+      buffer_ = other.buffer_;
+      other.buffer_ = net::const_buffer{};
+    }
     return *this;
   }
 
@@ -0,0 +1,135 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_SSPI_CREDENTIALS_HPP
+#define BOOST_WINTLS_DETAIL_SSPI_CREDENTIALS_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/sspi_functions.hpp>
+#include <boost/wintls/detail/sspi_sec_handle.hpp>
+
+#include <boost/wintls/handshake_type.hpp>
+#include <boost/wintls/method.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+inline SECURITY_STATUS acquire_credentials_handle(method connection_method,
+                                                  handshake_type type,
+                                                  const CERT_CONTEXT* cert,
+                                                  cred_handle& handle) {
+  SCHANNEL_CRED creds{};
+  creds.dwVersion = SCHANNEL_CRED_VERSION;
+  creds.grbitEnabledProtocols = static_cast<int>(connection_method);
+  creds.dwFlags = SCH_CRED_MANUAL_CRED_VALIDATION;
+
+  auto usage = [type]() {
+    switch (type) {
+      case handshake_type::client:
+        return SECPKG_CRED_OUTBOUND;
+      case handshake_type::server:
+        return SECPKG_CRED_INBOUND;
+    }
+    BOOST_UNREACHABLE_RETURN(0);
+  }();
+
+  // Clients never look for a certificate to send on their own. Any
+  // certificate has to be included in the credentials up front.
+  if (type == handshake_type::client) {
+    creds.dwFlags |= SCH_CRED_NO_DEFAULT_CREDS;
+  }
+
+  if (cert != nullptr) {
+    creds.cCreds = 1;
+    creds.paCred = &cert;
+  }
+
+  TimeStamp expiry;
+  return detail::sspi_functions::AcquireCredentialsHandle(nullptr,
+                                                          const_cast<LPWSTR>(UNISP_NAME),
+                                                          usage,
+                                                          nullptr,
+                                                          &creds,
+                                                          nullptr,
+                                                          nullptr,
+                                                          handle.get(),
+                                                          &expiry);
+}
+
+// Credentials handles for a given configuration of a context.
+//
+// Acquiring credentials is expensive, so the handles are acquired once
+// and shared by all handshakes using the same configuration. A stream
+// keeps a reference to the handle used for its handshake, so replacing
+// the credentials does not affect already established streams.
+class sspi_credentials {
+public:
+  sspi_credentials() = default;
+
+  sspi_credentials(const sspi_credentials& other)
+    : client_(std::atomic_load(&other.client_))
+    , server_(std::atomic_load(&other.server_)) {
+  }
+
+  sspi_credentials& operator=(const sspi_credentials&) = delete;
+
+  std::shared_ptr<cred_handle> get(method connection_method,
+                                   handshake_type type,
+                                   const CERT_CONTEXT* cert,
+                                   SECURITY_STATUS& sc) const {
+    auto& slot = type == handshake_type::client ? client_ : server_;
+    sc = SEC_E_OK;
+
+    auto handle = std::atomic_load(&slot);
+    if (handle) {
+      return handle;
+    }
+
+    // Only the first handshake of a given type has to wait for the
+    // credentials to be acquired
+    std::lock_guard<std::mutex> lock(mutex_);
+    handle = std::atomic_load(&slot);
+    if (handle) {
+      return handle;
+    }
+
+    handle = std::make_shared<cred_handle>();
+    sc = acquire_credentials_handle(connection_method, type, cert, *handle);
+    if (sc != SEC_E_OK) {
+      return nullptr;
+    }
+    std::atomic_store(&slot, handle);
+    return handle;
+  }
+
+  void reset(handshake_type type) {
+    set(type, nullptr);
+  }
+
+  // Uses credentials acquired elsewhere, e.g. before publishing the
+  // configuration they belong to
+  void set(handshake_type type, std::shared_ptr<cred_handle> handle) {
+    auto& slot = type == handshake_type::client ? client_ : server_;
+    std::atomic_store(&slot, std::move(handle));
+  }
+
+private:
+  mutable std::mutex mutex_;
+  mutable std::shared_ptr<cred_handle> client_;
+  mutable std::shared_ptr<cred_handle> server_;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_SSPI_CREDENTIALS_HPP
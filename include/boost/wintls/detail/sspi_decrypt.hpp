@@ -8,20 +8,46 @@
 #ifndef BOOST_WINTLS_DETAIL_SSPI_DECRYPT_HPP
 #define BOOST_WINTLS_DETAIL_SSPI_DECRYPT_HPP
 
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/buffer_pool.hpp>
 #include <boost/wintls/detail/sspi_functions.hpp>
 #include <boost/wintls/detail/decrypt_buffers.hpp>
 #include <boost/wintls/detail/decrypted_data_buffer.hpp>
+#include <boost/wintls/detail/read_ahead.hpp>
 #include <boost/wintls/detail/sspi_sec_handle.hpp>
+#include <boost/wintls/detail/token_bucket.hpp>
+
+#include <boost/wintls/record_buffer.hpp>
+#include <boost/wintls/stream_statistics.hpp>
+
+#include <boost/asio/error.hpp>
 
 #include <array>
 #include <cstdint>
+#include <memory>
 
 namespace boost {
 namespace wintls {
 namespace detail {
 
 class sspi_decrypt {
+  static constexpr std::size_t buffer_size = 0x10000;
+
+  // The largest TLS record including the header, which must always
+  // fit after the data not decrypted yet
+  static constexpr std::size_t max_record_size = 0x4000 + 0x800 + 5;
+
+  // Allocated when first needed and freed as soon as the session is
+  // over, so idle and closed streams do not hold on to them. Records
+  // are decrypted one after another in the same buffer, which is
+  // shared with the record buffers referring to them.
+  struct storage {
+    std::array<char, buffer_size> encrypted_data;
+  };
+
 public:
+  using storage_pool = buffer_pool<storage>;
+
   enum class state {
     data_needed,
     data_available,
@@ -30,86 +56,143 @@ public:
 
   sspi_decrypt(ctxt_handle& ctxt_handle)
     : size_decrypted(0)
-    , input_buffer(net::buffer(encrypted_data_))
     , ctxt_handle_(ctxt_handle)
     , last_error_(SEC_E_OK) {
-    buffers_[0].pvBuffer = encrypted_data_.data();
   }
 
   template <class MutableBufferSequence>
   state operator()(const MutableBufferSequence& output_buffers) {
-    if (!decrypted_data_.empty()) {
-      size_decrypted = decrypted_data_.get(output_buffers);
+    if (decrypted_data_ && !decrypted_data_->empty()) {
+      size_decrypted = decrypted_data_->get(output_buffers);
+      release_if_idle();
       return state::data_available;
     }
 
-    if (buffers_[0].cbBuffer == 0) {
-      input_buffer = net::buffer(encrypted_data_);
-      return state::data_needed;
+    net::const_buffer data;
+    const auto result = decrypt_message(data);
+    if (result != state::data_available) {
+      return result;
     }
 
-    buffers_[0].BufferType = SECBUFFER_DATA;
-    buffers_[1].BufferType = SECBUFFER_EMPTY;
-    buffers_[2].BufferType = SECBUFFER_EMPTY;
-    buffers_[3].BufferType = SECBUFFER_EMPTY;
-
-    input_buffer = net::buffer(encrypted_data_) + buffers_[0].cbBuffer;
-    const auto size = buffers_[0].cbBuffer;
-    last_error_ = detail::sspi_functions::DecryptMessage(ctxt_handle_.get(), buffers_, 0, nullptr);
-
-    if (last_error_ == SEC_E_INCOMPLETE_MESSAGE) {
-      buffers_[0].cbBuffer = size;
-      return state::data_needed;
+    size_decrypted = net::buffer_copy(output_buffers, data);
+    if (size_decrypted < data.size()) {
+      if (!decrypted_data_) {
+        decrypted_data_ = std::make_unique<decrypted_data_buffer<buffer_size>>();
+      }
+      decrypted_data_->fill(data + size_decrypted);
     }
 
-    if (last_error_ != SEC_E_OK) {
-      return state::error;
-    }
+    // Only done after copying the decrypted data as it is decrypted in
+    // place and may be overwritten by any extra data
+    consume_input();
+    release_if_idle();
+    return state::data_available;
+  }
 
-    if (buffers_[1].BufferType == SECBUFFER_DATA) {
-      const auto data_ptr = reinterpret_cast<const char*>(buffers_[1].pvBuffer);
-      const auto data_size = buffers_[1].cbBuffer;
-      size_decrypted = net::buffer_copy(output_buffers, net::buffer(data_ptr, data_size));
-      if (size_decrypted < data_size) {
-        decrypted_data_.fill(net::buffer(data_ptr + size_decrypted, data_size - size_decrypted));
-      }
-    }
+  // Decrypts the next record, handing over the buffer it was
+  // decrypted in to the record buffer instead of copying the data
+  BOOST_WINTLS_DECL state operator()(record_buffer& record);
+
+  // The buffer to read encrypted data into, taking one from the pool
+  // if none is held. Its size is decided by the read ahead policy.
+  BOOST_WINTLS_DECL net::mutable_buffer input_buffer();
+  BOOST_WINTLS_DECL void size_read(std::size_t size);
+
+  // True if no data is buffered and no buffer is held, in which case
+  // waiting for the next layer to become readable before reading
+  // keeps the stream from holding a buffer while idle. Only happens
+  // when using the buffer pool.
+  bool idle() const {
+    return !storage_ && !closed_;
+  }
 
-    if (buffers_[3].BufferType == SECBUFFER_EXTRA) {
-      const auto extra_size = buffers_[3].cbBuffer;
-      std::memmove(encrypted_data_.data(), buffers_[3].pvBuffer, extra_size);
-      buffers_[0].cbBuffer = extra_size;
-    } else {
-      buffers_[0].cbBuffer = 0;
-    }
+  // True once the peer has sent a close_notify alert
+  bool closed() const {
+    return closed_;
+  }
 
-    return state::data_available;
+  // True if data has been read from the next layer but not decrypted
+  // yet
+  bool buffered_input() const {
+    return storage_ && buffers_[0].cbBuffer != 0;
   }
 
-  void size_read(std::size_t size) {
-    buffers_[0].cbBuffer += static_cast<unsigned long>(size);
-    input_buffer = net::buffer(encrypted_data_) + buffers_[0].cbBuffer;
+  // Frees the buffers. Nothing can be decrypted afterwards.
+  BOOST_WINTLS_DECL void release();
+
+  // The number of bytes held by the buffers, including a buffer
+  // shared with record buffers
+  std::size_t buffer_memory() const {
+    return (storage_ ? sizeof(storage) : 0) + (decrypted_data_ ? sizeof(*decrypted_data_) : 0);
   }
 
   std::size_t size_decrypted;
-  net::mutable_buffer input_buffer;
 
+  // Take buffers from a pool shared by all streams when there is data
+  // to decrypt and return them as soon as all of it has been read
+  bool use_buffer_pool = false;
+
+  // Size reads from the next layer by the read ahead policy. Offering
+  // all of the free space instead suits a next layer delivering whole
+  // records, which would otherwise have to buffer what did not fit.
+  bool adaptive_read_size = true;
+
+  // Limits the rate of the reads from the next layer. Reads must wait
+  // for the delay of the bucket before reading and read no more than
+  // a burst.
+  token_bucket rate_limit;
+
+  // Set once the close_notify alert has been sent to the peer. The
+  // security context is released with the buffers when the peer sends
+  // its own as it is not needed for anything anymore.
+  bool close_notify_sent = false;
+
+  // Set when the next layer has taken over decrypting the records.
+  // The data read from it is handed out as is.
+  bool offloaded = false;
+
+  stream_statistics statistics() const {
+    auto result = statistics_;
+    result.read_size = read_ahead_.size();
+    return result;
+  }
+
+  // The peer closing the TLS channel is reported as end of file
   boost::system::error_code last_error() const {
+    if (closed_) {
+      return net::error::eof;
+    }
     return error::make_error_code(last_error_);
   }
 
 private:
-  static constexpr std::size_t buffer_size = 0x10000;
+  // Decrypts the received data in place. The decrypted data, if any,
+  // stays valid until consume_input() is called.
+  BOOST_WINTLS_DECL state decrypt_message(net::const_buffer& data);
+  BOOST_WINTLS_DECL void consume_input();
+  BOOST_WINTLS_DECL void acquire_storage();
+  BOOST_WINTLS_DECL void release_storage();
+  BOOST_WINTLS_DECL void release_if_idle();
+  BOOST_WINTLS_DECL void make_room();
 
   ctxt_handle& ctxt_handle_;
   SECURITY_STATUS last_error_;
+  bool closed_ = false;
+  read_ahead read_ahead_;
+  std::size_t offered_ = 0;
+  std::size_t missing_ = 0;
+  stream_statistics statistics_;
   decrypt_buffers buffers_;
-  std::array<char, buffer_size> encrypted_data_;
-  decrypted_data_buffer<buffer_size> decrypted_data_;
+  std::shared_ptr<storage> storage_;
+  std::unique_ptr<decrypted_data_buffer<buffer_size>> decrypted_data_;
 };
 
 } // namespace detail
 } // namespace wintls
 } // namespace boost
 
+#if defined(BOOST_WINTLS_HEADER_ONLY)
+#include <boost/wintls/detail/impl/sspi_decrypt.ipp>
+#endif
+
 #endif // BOOST_WINTLS_DETAIL_SSPI_DECRYPT_HPP
@@ -9,8 +9,11 @@
 #define BOOST_WINTLS_DETAIL_SSPI_ENCRYPT_HPP
 
 #include <boost/wintls/detail/encrypt_buffers.hpp>
+#include <boost/wintls/detail/trace.hpp>
 #include <boost/wintls/detail/sspi_sec_handle.hpp>
 
+#include <cstdint>
+
 namespace boost {
 namespace wintls {
 namespace detail {
@@ -23,10 +26,10 @@ public:
   }
 
   template <typename ConstBufferSequence>
-  std::size_t operator()(const ConstBufferSequence& buf, boost::system::error_code& ec) {
+  std::size_t operator()(const ConstBufferSequence& buf, boost::system::error_code& ec, std::size_t record_limit = 0) {
     SECURITY_STATUS sc = SEC_E_OK;
 
-    std::size_t size_encrypted = buffers(buf, sc);
+    std::size_t size_encrypted = buffers(buf, sc, record_limit);
     if (sc != SEC_E_OK) {
       ec = error::make_error_code(sc);
       return 0;
@@ -37,12 +40,26 @@ public:
       ec = error::make_error_code(sc);
       return 0;
     }
+    BOOST_WINTLS_TRACE_RECORD_ENCRYPTED(&ctxt_handle_, size_encrypted, net::buffer_size(buffers));
+    ++records;
 
     return size_encrypted;
   }
 
+  // The maximum size of the data in a record or zero if not known
+  std::size_t max_message_size() {
+    return buffers.max_message_size();
+  }
+
   encrypt_buffers buffers;
 
+  // The number of records encrypted
+  std::uint64_t records = 0;
+
+  // Set when the next layer has taken over encrypting the records.
+  // Data is written to the next layer as is.
+  bool offloaded = false;
+
 private:
   ctxt_handle& ctxt_handle_;
 };
@@ -10,6 +10,8 @@
 
 #include <boost/wintls/detail/sspi_types.hpp>
 
+#include <boost/assert.hpp>
+
 namespace boost {
 namespace wintls {
 namespace detail {
@@ -96,6 +98,10 @@ inline SECURITY_STATUS ApplyControlToken(PCtxtHandle phContext, PSecBufferDesc p
   return sspi_function_table()->ApplyControlToken(phContext, pInput);
 }
 
+inline SECURITY_STATUS QuerySecurityPackageInfo(SEC_WCHAR* pPackageName, PSecPkgInfoW* ppPackageInfo) {
+  return sspi_function_table()->QuerySecurityPackageInfoW(pPackageName, ppPackageInfo);
+}
+
 inline SECURITY_STATUS AcceptSecurityContext(PCredHandle phCredential,
                                              PCtxtHandle phContext,
                                              PSecBufferDesc pInput,
@@ -37,8 +37,13 @@ private:
 class ctxt_handle : public sspi_sec_handle<CtxtHandle> {
 public:
   ~ctxt_handle() {
+    reset();
+  }
+
+  void reset() {
     if (*this) {
       detail::sspi_functions::DeleteSecurityContext(get());
+      *get() = CtxtHandle{0, 0};
     }
   }
 };
@@ -14,8 +14,12 @@
 #include <boost/wintls/detail/shutdown_buffers.hpp>
 #include <boost/wintls/detail/sspi_context_buffer.hpp>
 #include <boost/wintls/detail/sspi_sec_handle.hpp>
+#include <boost/wintls/detail/trace.hpp>
 
 #include <boost/assert.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <memory>
 
 namespace boost {
 namespace wintls {
@@ -23,21 +27,42 @@ namespace detail {
 
 class sspi_shutdown {
 public:
-  sspi_shutdown(ctxt_handle& ctxt_handle, cred_handle& cred_handle)
+  sspi_shutdown(ctxt_handle& ctxt_handle, std::shared_ptr<cred_handle>& cred_handle)
     : ctxt_handle_(ctxt_handle)
     , cred_handle_(cred_handle) {
   }
 
   boost::system::error_code operator()() {
+    const auto sc = shutdown();
+    BOOST_WINTLS_TRACE_SHUTDOWN(&ctxt_handle_, sc);
+    return sc == SEC_E_OK ? boost::system::error_code{} : error::make_error_code(sc);
+  }
+
+  net::const_buffer buffer() {
+    return buffer_.asio_buffer();
+  }
+
+  void size_written(std::size_t size) {
+    BOOST_VERIFY(size == buffer_.size());
+    buffer_ = sspi_context_buffer{};
+  }
+
+private:
+  // Creates the close_notify alert to send
+  SECURITY_STATUS shutdown() {
     shutdown_buffers buffers;
 
     SECURITY_STATUS sc = detail::sspi_functions::ApplyControlToken(ctxt_handle_.get(), buffers);
     if (sc != SEC_E_OK) {
-      return error::make_error_code(sc);
+      return sc;
+    }
+
+    if (!cred_handle_) {
+      return SEC_E_NO_CREDENTIALS;
     }
 
     DWORD out_flags = 0;
-    sc = detail::sspi_functions::InitializeSecurityContext(cred_handle_.get(),
+    sc = detail::sspi_functions::InitializeSecurityContext(cred_handle_->get(),
                                                            ctxt_handle_.get(),
                                                            nullptr,
                                                            client_context_flags,
@@ -50,25 +75,15 @@ public:
                                                            &out_flags,
                                                            nullptr);
     if (sc != SEC_E_OK) {
-      return error::make_error_code(sc);
+      return sc;
     }
 
     buffer_ = sspi_context_buffer{buffers[0].pvBuffer, buffers[0].cbBuffer};
-    return {};
-  }
-
-  net::const_buffer buffer() {
-    return buffer_.asio_buffer();
+    return SEC_E_OK;
   }
 
-  void size_written(std::size_t size) {
-    BOOST_VERIFY(size == buffer_.size());
-    buffer_ = sspi_context_buffer{};
-  }
-
-private:
   ctxt_handle& ctxt_handle_;
-  cred_handle& cred_handle_;
+  std::shared_ptr<cred_handle>& cred_handle_;
   sspi_context_buffer buffer_;
 };
 
@@ -13,6 +13,12 @@
 #include <boost/wintls/detail/sspi_decrypt.hpp>
 #include <boost/wintls/detail/sspi_shutdown.hpp>
 #include <boost/wintls/detail/sspi_sec_handle.hpp>
+#include <boost/wintls/detail/stream_deadline.hpp>
+#include <boost/wintls/detail/traffic_secrets.hpp>
+
+#include <boost/wintls/context.hpp>
+
+#include <memory>
 
 namespace boost {
 namespace wintls {
@@ -25,20 +31,86 @@ public:
     , encrypt(ctxt_handle_)
     , decrypt(ctxt_handle_)
     , shutdown(ctxt_handle_, cred_handle_) {
+    handshake.use_buffer_pool = ctx.snapshot()->use_buffer_pool;
+    decrypt.use_buffer_pool = handshake.use_buffer_pool;
   }
 
   sspi_stream(sspi_stream&&) = delete;
   sspi_stream& operator=(sspi_stream&&) = delete;
 
+  // Frees the security context and all buffers of the stream once
+  // the session is over
+  void release() {
+    handshake.release();
+    decrypt.release();
+    encrypt.buffers.release();
+    ctxt_handle_.reset();
+  }
+
+  // Nothing more can be sent once the close_notify alert has been
+  // sent and nothing more can be received once the peer has sent its
+  // own, after which the session is over
+  void close_notify_sent() {
+    encrypt.buffers.release();
+    decrypt.close_notify_sent = true;
+    if (decrypt.closed()) {
+      release();
+    }
+  }
+
+  // Hands the processing of records over to the next layer. Only
+  // possible once all data read has been decrypted.
+  void offload() {
+    encrypt.offloaded = true;
+    encrypt.buffers.release();
+    decrypt.offloaded = true;
+  }
+
+  bool offloaded() const {
+    return encrypt.offloaded;
+  }
+
+  // The number of bytes held by the buffers of the stream
+  std::size_t buffer_memory() const {
+    return handshake.buffer_memory() + encrypt.buffers.buffer_memory() + decrypt.buffer_memory();
+  }
+
+  // The secrets and sequence numbers of the records in both
+  // directions. The sequence numbers are those reported by Schannel,
+  // which also counts records it protected itself, e.g. a session
+  // ticket sent at the end of the handshake. They only describe the
+  // next records until anything has been written or read.
+  traffic_keys export_traffic_keys(boost::system::error_code& ec) {
+    if (encrypt.records != 0 || decrypt.statistics().reads != 0) {
+      ec = net::error::in_progress;
+      return {};
+    }
+    const auto role = handshake.type();
+    const auto peer = role == handshake_type::client ? handshake_type::server : handshake_type::client;
+    traffic_keys keys;
+    keys.write = query_traffic_secret(ctxt_handle_, role, ec);
+    if (ec) {
+      return {};
+    }
+    keys.read = query_traffic_secret(ctxt_handle_, peer, ec);
+    if (ec) {
+      return {};
+    }
+    return keys;
+  }
+
 private:
   ctxt_handle ctxt_handle_;
-  cred_handle cred_handle_;
+  std::shared_ptr<cred_handle> cred_handle_;
 
 public:
   sspi_handshake handshake;
   sspi_encrypt encrypt;
   sspi_decrypt decrypt;
   sspi_shutdown shutdown;
+
+  // Set when using a timer wheel for the deadlines of operations
+  std::shared_ptr<stream_deadline> deadline;
 };
 
 } // namespace detail
@@ -0,0 +1,191 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_STREAM_DEADLINE_HPP
+#define BOOST_WINTLS_DETAIL_STREAM_DEADLINE_HPP
+
+#include <boost/wintls/stream_timeouts.hpp>
+#include <boost/wintls/timer_wheel.hpp>
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/hierarchical_wheel.hpp>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// The kinds of operations with a deadline. Operations of different
+// kinds may be in progress at the same time, e.g. a shutdown while a
+// read is pending.
+enum class deadline_kind {
+  handshake,
+  read,
+  shutdown
+};
+
+// The deadlines of the operations in progress on a stream, registered
+// with a timer wheel. Only accessed from the executor of the stream.
+//
+// Each kind of operation has its own deadline. Each operation gets a
+// new generation, so an expiry of an earlier operation delivered late
+// does not affect the current one.
+class stream_deadline : public std::enable_shared_from_this<stream_deadline> {
+public:
+  stream_deadline(timer_wheel& wheel, const stream_timeouts& timeouts)
+    : wheel_(wheel.state_)
+    , timeouts_(timeouts) {
+  }
+
+  stream_deadline(const stream_deadline&) = delete;
+  stream_deadline& operator=(const stream_deadline&) = delete;
+
+  ~stream_deadline() {
+    if (auto wheel = wheel_.lock()) {
+      for (auto& deadline : deadlines_) {
+        wheel->cancel(deadline.entry);
+      }
+    }
+  }
+
+  // The timeout of the given kind of operation
+  std::chrono::steady_clock::duration timeout(deadline_kind kind) const {
+    switch (kind) {
+      case deadline_kind::handshake:
+        return timeouts_.handshake;
+      case deadline_kind::read:
+        return timeouts_.read;
+      case deadline_kind::shutdown:
+        return timeouts_.shutdown;
+    }
+    return std::chrono::steady_clock::duration::max();
+  }
+
+  // Registers the deadline of a new operation. If it expires, the
+  // cancel function is called from the executor.
+  template <class Executor, class Cancel>
+  std::uint64_t start(deadline_kind kind, std::chrono::steady_clock::duration timeout, const Executor& ex, Cancel cancel) {
+    auto& deadline = deadlines_[static_cast<std::size_t>(kind)];
+    const auto generation = ++deadline.generation;
+    deadline.active = true;
+    deadline.expired = false;
+    auto wheel = wheel_.lock();
+    if (!wheel) {
+      return generation;
+    }
+    auto on_expiry = [self = std::weak_ptr<stream_deadline>(shared_from_this()), kind, generation, ex, cancel]() {
+      net::post(ex, [self, kind, generation, cancel]() mutable {
+        auto stream_deadline = self.lock();
+        if (!stream_deadline) {
+          return;
+        }
+        auto& deadline = stream_deadline->deadlines_[static_cast<std::size_t>(kind)];
+        if (deadline.active && deadline.generation == generation) {
+          deadline.active = false;
+          deadline.expired = true;
+          cancel();
+        }
+      });
+    };
+    const auto now = std::chrono::steady_clock::now();
+    const auto expiry = timeout < std::chrono::steady_clock::time_point::max() - now ? now + timeout : std::chrono::steady_clock::time_point::max();
+    wheel->schedule(deadline.entry, expiry, std::move(on_expiry));
+    return generation;
+  }
+
+  // Removes the deadline of an operation, returning whether it expired
+  bool finish(deadline_kind kind, std::uint64_t generation) {
+    auto& deadline = deadlines_[static_cast<std::size_t>(kind)];
+    if (generation != deadline.generation) {
+      return false;
+    }
+    deadline.active = false;
+    if (auto wheel = wheel_.lock()) {
+      wheel->cancel(deadline.entry);
+    }
+    return deadline.expired;
+  }
+
+private:
+  struct deadline {
+    wheel_entry entry;
+    std::uint64_t generation = 0;
+    bool active = false;
+    bool expired = false;
+  };
+
+  std::weak_ptr<timer_wheel::state> wheel_;
+  const stream_timeouts timeouts_;
+  std::array<deadline, 3> deadlines_;
+};
+
+// Held by an asynchronous operation for the duration of its deadline,
+// if any. Completing the operation removes the deadline and reports
+// an operation cancelled by its expiry as timed out.
+class deadline_scope {
+public:
+  deadline_scope() = default;
+
+  template <class Executor, class Cancel>
+  deadline_scope(std::shared_ptr<stream_deadline> deadline,
+                 deadline_kind kind,
+                 const Executor& ex,
+                 Cancel cancel)
+    : kind_(kind) {
+    const auto timeout = deadline ? deadline->timeout(kind) : std::chrono::steady_clock::duration::max();
+    if (timeout != std::chrono::steady_clock::duration::max()) {
+      generation_ = deadline->start(kind, timeout, ex, std::move(cancel));
+      deadline_ = std::move(deadline);
+    }
+  }
+
+  deadline_scope(deadline_scope&& other) noexcept
+    : deadline_(std::move(other.deadline_))
+    , kind_(other.kind_)
+    , generation_(other.generation_) {
+  }
+
+  deadline_scope& operator=(deadline_scope&&) = delete;
+
+  ~deadline_scope() {
+    if (deadline_) {
+      deadline_->finish(kind_, generation_);
+    }
+  }
+
+  boost::system::error_code complete(const boost::system::error_code& ec) {
+    if (!deadline_) {
+      return ec;
+    }
+    const auto expired = deadline_->finish(kind_, generation_);
+    deadline_.reset();
+    if (expired && ec) {
+      return net::error::timed_out;
+    }
+    return ec;
+  }
+
+private:
+  std::shared_ptr<stream_deadline> deadline_;
+  deadline_kind kind_ = deadline_kind::read;
+  std::uint64_t generation_ = 0;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_STREAM_DEADLINE_HPP
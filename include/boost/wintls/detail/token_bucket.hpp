@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_TOKEN_BUCKET_HPP
+#define BOOST_WINTLS_DETAIL_TOKEN_BUCKET_HPP
+
+#include <chrono>
+#include <cstddef>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Token bucket limiting the average number of bytes per second.
+//
+// The bucket fills at the given rate up to the burst size. Sending is
+// allowed whenever the bucket is not empty and the size sent is taken
+// from it afterwards, possibly leaving it in debt, so the size of
+// each send must be limited to the burst size to keep the bursts
+// small.
+class token_bucket {
+public:
+  using clock_type = std::chrono::steady_clock;
+
+  // Bursts default to a tenth of a second worth of data but no less
+  // than this
+  static constexpr std::size_t min_burst_size = 0x400;
+
+  // Not limited
+  token_bucket() = default;
+
+  token_bucket(std::size_t bytes_per_second, std::size_t burst_size, clock_type::time_point now = clock_type::now())
+    : rate_(static_cast<double>(bytes_per_second))
+    , burst_(burst_size != 0 ? burst_size : default_burst_size(bytes_per_second))
+    , tokens_(static_cast<double>(burst_))
+    , last_(now) {
+  }
+
+  bool limited() const {
+    return rate_ > 0;
+  }
+
+  std::size_t burst_size() const {
+    return burst_;
+  }
+
+  // The time to wait before sending more
+  clock_type::duration delay(clock_type::time_point now) {
+    if (!limited()) {
+      return clock_type::duration::zero();
+    }
+    refill(now);
+    if (tokens_ > 0) {
+      return clock_type::duration::zero();
+    }
+    // Rounded up to make sure the bucket is not empty after the wait
+    const std::chrono::duration<double> seconds{(1 - tokens_) / rate_};
+    return std::chrono::duration_cast<clock_type::duration>(seconds) + clock_type::duration{1};
+  }
+
+  void consume(std::size_t size, clock_type::time_point now) {
+    if (!limited()) {
+      return;
+    }
+    refill(now);
+    tokens_ -= static_cast<double>(size);
+  }
+
+private:
+  static std::size_t default_burst_size(std::size_t bytes_per_second) {
+    const auto size = bytes_per_second / 10;
+    return size < min_burst_size ? min_burst_size : size;
+  }
+
+  void refill(clock_type::time_point now) {
+    if (now > last_) {
+      tokens_ += rate_ * std::chrono::duration<double>(now - last_).count();
+      last_ = now;
+    }
+    const auto burst = static_cast<double>(burst_);
+    if (tokens_ > burst) {
+      tokens_ = burst;
+    }
+  }
+
+  double rate_ = 0;
+  std::size_t burst_ = 0;
+  double tokens_ = 0;
+  clock_type::time_point last_;
+};
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_TOKEN_BUCKET_HPP
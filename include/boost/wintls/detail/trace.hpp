@@ -0,0 +1,101 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_TRACE_HPP
+#define BOOST_WINTLS_DETAIL_TRACE_HPP
+
+// Static tracepoints at the handshake and record events of a stream.
+//
+// Define BOOST_WINTLS_TRACELOGGING_PROVIDER as the handle of a
+// TraceLogging provider declared with TRACELOGGING_DECLARE_PROVIDER
+// to write the events to ETW. Events are only written while a trace
+// session has enabled the provider, otherwise a tracepoint costs a
+// single test of the provider state.
+//
+// Without it the tracepoints expand to nothing and their arguments
+// are not evaluated.
+//
+// Every event identifies the stream by the address of its security
+// context handle, which is the same for all events of a stream.
+
+#if defined(BOOST_WINTLS_TRACELOGGING_PROVIDER)
+
+#include <TraceLoggingProvider.h>
+
+#define BOOST_WINTLS_TRACE_HANDSHAKE_START(stream, is_server)                       \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "HandshakeStart",                                               \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingBool(is_server, "Server"))
+
+#define BOOST_WINTLS_TRACE_HANDSHAKE_STEP(stream, status, size_in, size_out)        \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "HandshakeStep",                                                \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingHResult(status, "Status"),                          \
+                    TraceLoggingUInt32(static_cast<UINT32>(size_in), "BytesIn"),    \
+                    TraceLoggingUInt32(static_cast<UINT32>(size_out), "BytesOut"))
+
+#define BOOST_WINTLS_TRACE_HANDSHAKE_VERIFY(stream, status)                         \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "HandshakeVerify",                                              \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingHResult(status, "Status"))
+
+#define BOOST_WINTLS_TRACE_HANDSHAKE_DONE(stream)                                   \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "HandshakeDone",                                                \
+                    TraceLoggingPointer(stream, "Stream"))
+
+#define BOOST_WINTLS_TRACE_HANDSHAKE_FAILED(stream, status)                         \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "HandshakeFailed",                                              \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingHResult(status, "Status"))
+
+#define BOOST_WINTLS_TRACE_INCOMPLETE_MESSAGE(stream, size, missing)                \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "IncompleteMessage",                                            \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingUInt32(static_cast<UINT32>(size), "BytesBuffered"), \
+                    TraceLoggingUInt32(static_cast<UINT32>(missing), "BytesMissing"))
+
+#define BOOST_WINTLS_TRACE_RECORD_ENCRYPTED(stream, size, record_size)              \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "RecordEncrypted",                                              \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingUInt32(static_cast<UINT32>(size), "Bytes"),         \
+                    TraceLoggingUInt32(static_cast<UINT32>(record_size), "RecordBytes"))
+
+#define BOOST_WINTLS_TRACE_RECORD_DECRYPTED(stream, size, record_size)              \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "RecordDecrypted",                                              \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingUInt32(static_cast<UINT32>(size), "Bytes"),         \
+                    TraceLoggingUInt32(static_cast<UINT32>(record_size), "RecordBytes"))
+
+#define BOOST_WINTLS_TRACE_SHUTDOWN(stream, status)                                 \
+  TraceLoggingWrite(BOOST_WINTLS_TRACELOGGING_PROVIDER,                             \
+                    "Shutdown",                                                     \
+                    TraceLoggingPointer(stream, "Stream"),                          \
+                    TraceLoggingHResult(status, "Status"))
+
+#else // BOOST_WINTLS_TRACELOGGING_PROVIDER
+
+#define BOOST_WINTLS_TRACE_HANDSHAKE_START(stream, is_server) ((void)0)
+#define BOOST_WINTLS_TRACE_HANDSHAKE_STEP(stream, status, size_in, size_out) ((void)0)
+#define BOOST_WINTLS_TRACE_HANDSHAKE_VERIFY(stream, status) ((void)0)
+#define BOOST_WINTLS_TRACE_HANDSHAKE_DONE(stream) ((void)0)
+#define BOOST_WINTLS_TRACE_HANDSHAKE_FAILED(stream, status) ((void)0)
+#define BOOST_WINTLS_TRACE_INCOMPLETE_MESSAGE(stream, size, missing) ((void)0)
+#define BOOST_WINTLS_TRACE_RECORD_ENCRYPTED(stream, size, record_size) ((void)0)
+#define BOOST_WINTLS_TRACE_RECORD_DECRYPTED(stream, size, record_size) ((void)0)
+#define BOOST_WINTLS_TRACE_SHUTDOWN(stream, status) ((void)0)
+
+#endif // BOOST_WINTLS_TRACELOGGING_PROVIDER
+
+#endif // BOOST_WINTLS_DETAIL_TRACE_HPP
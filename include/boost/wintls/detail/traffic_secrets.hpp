@@ -0,0 +1,71 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_DETAIL_TRAFFIC_SECRETS_HPP
+#define BOOST_WINTLS_DETAIL_TRAFFIC_SECRETS_HPP
+
+#include <boost/wintls/error.hpp>
+#include <boost/wintls/handshake_type.hpp>
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/make_traffic_secret.hpp>
+#include <boost/wintls/detail/sspi_functions.hpp>
+#include <boost/wintls/detail/sspi_sec_handle.hpp>
+
+#include <boost/asio/error.hpp>
+
+#include <boost/core/ignore_unused.hpp>
+
+#include <array>
+#include <cstddef>
+
+namespace boost {
+namespace wintls {
+namespace detail {
+
+// Queries the secret of the records sent by the given side of the
+// connection. Needs a Windows SDK and a version of Schannel providing
+// the traffic secrets of a connection.
+inline traffic_secret query_traffic_secret(ctxt_handle& ctxt_handle,
+                                           handshake_type sender,
+                                           boost::system::error_code& ec) {
+#if defined(SECPKG_ATTR_TRAFFIC_SECRETS)
+  // Room for the largest secret, the size of a SHA-384 hash
+  static constexpr std::size_t max_secret_size = 48;
+  alignas(SEC_TRAFFIC_SECRETS) std::array<unsigned char, sizeof(SEC_TRAFFIC_SECRETS) + max_secret_size> buffer{};
+  auto& secrets = *reinterpret_cast<SEC_TRAFFIC_SECRETS*>(buffer.data());
+
+  // The type selects which of the two secrets is returned
+  secrets.TrafficSecretType = sender == handshake_type::client ? SecTrafficSecret_Client : SecTrafficSecret_Server;
+  SECURITY_STATUS sc = sspi_functions::QueryContextAttributes(ctxt_handle.get(), SECPKG_ATTR_TRAFFIC_SECRETS, &secrets);
+  if (sc == SEC_E_OK && secrets.TrafficSecretSize > max_secret_size) {
+    sc = SEC_E_BUFFER_TOO_SMALL;
+  }
+  if (sc == SEC_E_UNSUPPORTED_FUNCTION) {
+    // Older versions of Schannel do not know the attribute
+    ec = net::error::operation_not_supported;
+    return {};
+  }
+  if (sc != SEC_E_OK) {
+    ec = error::make_error_code(sc);
+    return {};
+  }
+
+  ec = {};
+  return make_traffic_secret(secrets);
+#else
+  boost::ignore_unused(ctxt_handle, sender);
+  ec = net::error::operation_not_supported;
+  return {};
+#endif
+}
+
+} // namespace detail
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_DETAIL_TRAFFIC_SECRETS_HPP
@@ -13,36 +13,16 @@
 
 
 #include <wincrypt.h>
+#include <ncrypt.h>
+
+#include <boost/asio/buffer.hpp>
+
+#include <vector>
 
 namespace boost {
 namespace wintls {
 namespace detail {
 
-inline std::vector<BYTE> crypt_string_to_binary(const net::const_buffer& crypt_string) {
-  DWORD size = 0;
-  if (!CryptStringToBinaryA(reinterpret_cast<LPCSTR>(crypt_string.data()),
-                            static_cast<DWORD>(crypt_string.size()),
-                            0,
-                            nullptr,
-                            &size,
-                            nullptr,
-                            nullptr)) {
-    throw_last_error("CryptStringToBinaryA");
-  }
-
-  std::vector<BYTE> data(size);
-  if (!CryptStringToBinaryA(reinterpret_cast<LPCSTR>(crypt_string.data()),
-                            static_cast<DWORD>(crypt_string.size()),
-                            0,
-                            data.data(),
-                            &size,
-                            nullptr,
-                            nullptr)) {
-    throw_last_error("CryptStringToBinaryA");
-  }
-  return data;
-}
-
 inline std::vector<BYTE> crypt_decode_object_ex(const net::const_buffer& crypt_object, LPCSTR type) {
   DWORD size = 0;
   if (!CryptDecodeObjectEx(X509_ASN_ENCODING,
@@ -0,0 +1,257 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_IMPL_CERTIFICATE_IPP
+#define BOOST_WINTLS_IMPL_CERTIFICATE_IPP
+
+#include <boost/wintls/certificate.hpp>
+
+#include <cstring>
+
+namespace boost {
+namespace wintls {
+
+namespace detail {
+struct crypt_context {
+  crypt_context(const std::string& name) {
+    if (!CryptAcquireContextA(&ptr, name.c_str(), nullptr, PROV_RSA_FULL, CRYPT_NEWKEYSET | CRYPT_SILENT)) {
+      detail::throw_last_error("CryptAcquireContextA");
+    }
+  }
+
+  ~crypt_context() {
+    CryptReleaseContext(ptr, 0);
+  }
+
+  HCRYPTPROV ptr = 0;
+};
+
+struct crypt_key {
+  ~crypt_key() {
+    CryptDestroyKey(ptr);
+  }
+
+  HCRYPTKEY ptr = 0;
+};
+
+} // namespace detail
+
+BOOST_WINTLS_DECL cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file_format format) {
+  std::vector<std::uint8_t> data;
+  auto der = x509;
+  if (format == file_format::pem) {
+    data = detail::pem_decode(x509);
+    der = net::buffer(data);
+  }
+
+  auto cert = CertCreateCertificateContext(X509_ASN_ENCODING,
+                                           reinterpret_cast<const BYTE*>(der.data()),
+                                           static_cast<DWORD>(der.size()));
+  if (!cert) {
+    detail::throw_last_error("CertCreateCertificateContext");
+  }
+
+  return cert_context_ptr{cert, &CertFreeCertificateContext};
+}
+
+BOOST_WINTLS_DECL cert_context_ptr x509_to_cert_context(const net::const_buffer& x509, file_format format, boost::system::error_code& ec) {
+  ec = {};
+  try {
+    return x509_to_cert_context(x509, format);
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+    return cert_context_ptr{nullptr, &CertFreeCertificateContext};
+  }
+}
+
+BOOST_WINTLS_DECL cert_context_ptr pkcs12_to_cert_context(const net::const_buffer& pkcs12, const std::string& password) {
+  const auto size = password.size() + 1;
+  auto wpassword = std::make_unique<WCHAR[]>(size);
+  const auto size_converted = mbstowcs(wpassword.get(), password.c_str(), size);
+  BOOST_VERIFY_MSG(size_converted == password.size(), "mbstowcs");
+
+  CRYPT_DATA_BLOB blob{static_cast<DWORD>(pkcs12.size()),
+                       reinterpret_cast<BYTE*>(const_cast<void*>(pkcs12.data()))};
+  // Schannel cannot use ephemeral keys for server credentials, so the
+  // key is persisted in the key store of the current user until it is
+  // deleted with delete_private_key
+  auto store = PFXImportCertStore(&blob, wpassword.get(), CRYPT_USER_KEYSET);
+  if (!store) {
+    detail::throw_last_error("PFXImportCertStore");
+  }
+
+  // The certificate holding the private key is the one with key
+  // provider information. CERT_FIND_HAS_PRIVATE_KEY would do the same
+  // but is not available before Windows 8.
+  const CERT_CONTEXT* cert = nullptr;
+  while ((cert = CertEnumCertificatesInStore(store, cert)) != nullptr) {
+    DWORD size = 0;
+    if (CertGetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, nullptr, &size)) {
+      break;
+    }
+  }
+
+  // The certificate keeps the store alive until it is freed itself
+  CertCloseStore(store, 0);
+  if (!cert) {
+    detail::throw_error(error::make_error_code(CRYPT_E_NOT_FOUND), "No certificate with a private key found");
+  }
+
+  return cert_context_ptr{cert, &CertFreeCertificateContext};
+}
+
+BOOST_WINTLS_DECL cert_context_ptr pkcs12_to_cert_context(const net::const_buffer& pkcs12, const std::string& password, boost::system::error_code& ec) {
+  ec = {};
+  try {
+    return pkcs12_to_cert_context(pkcs12, password);
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+    return cert_context_ptr{nullptr, &CertFreeCertificateContext};
+  }
+}
+
+BOOST_WINTLS_DECL void import_private_key(const net::const_buffer& private_key, file_format format, const std::string& name) {
+  std::vector<std::uint8_t> der;
+  if (format == file_format::pem) {
+    der = detail::pem_decode(private_key);
+  }
+  auto data = detail::crypt_decode_object_ex(format == file_format::pem ? net::buffer(der) : private_key,
+                                             PKCS_PRIVATE_KEY_INFO);
+  auto private_key_info = reinterpret_cast<CRYPT_PRIVATE_KEY_INFO*>(data.data());
+
+  // TODO: Set proper error code instead of asserting
+  BOOST_VERIFY_MSG(strcmp(private_key_info->Algorithm.pszObjId, szOID_RSA_RSA) == 0, "Only RSA keys supported");
+  auto rsa_private_key = detail::crypt_decode_object_ex(net::buffer(private_key_info->PrivateKey.pbData,
+                                                                    private_key_info->PrivateKey.cbData),
+                                                        PKCS_RSA_PRIVATE_KEY);
+
+  detail::crypt_context ctx(name);
+  detail::crypt_key key;
+  if (!CryptImportKey(ctx.ptr,
+                      rsa_private_key.data(),
+                      static_cast<DWORD>(rsa_private_key.size()),
+                      0,
+                      0,
+                      &key.ptr)) {
+    detail::throw_last_error("CryptImportKey");
+  }
+}
+
+BOOST_WINTLS_DECL void import_private_key(const net::const_buffer& private_key, file_format format, const std::string& name, boost::system::error_code& ec) {
+  ec = {};
+  try {
+    import_private_key(private_key, format, name);
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+  }
+}
+
+BOOST_WINTLS_DECL void delete_private_key(const std::string& name) {
+  HCRYPTKEY ptr = 0;
+  if (!CryptAcquireContextA(&ptr, name.c_str(), nullptr, PROV_RSA_FULL, CRYPT_DELETEKEYSET)) {
+
+    throw boost::system::system_error(GetLastError(), boost::system::system_category());
+  }
+}
+
+BOOST_WINTLS_DECL void delete_private_key(const std::string& name, boost::system::error_code& ec) {
+  ec = {};
+  try {
+    delete_private_key(name);
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+  }
+}
+
+BOOST_WINTLS_DECL void delete_private_key(const CERT_CONTEXT* cert) {
+  DWORD size = 0;
+  if (!CertGetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, nullptr, &size)) {
+    detail::throw_last_error("CertGetCertificateContextProperty");
+  }
+  std::vector<BYTE> data(size);
+  if (!CertGetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, data.data(), &size)) {
+    detail::throw_last_error("CertGetCertificateContextProperty");
+  }
+  const auto info = reinterpret_cast<const CRYPT_KEY_PROV_INFO*>(data.data());
+
+  if (info->dwProvType == 0) {
+    // A key storage provider of CNG, which holds any keys not
+    // supported by the legacy providers, like ECC keys
+    NCRYPT_PROV_HANDLE provider = 0;
+    auto status = NCryptOpenStorageProvider(&provider, info->pwszProvName, 0);
+    if (status != ERROR_SUCCESS) {
+      detail::throw_error(error::make_error_code(status), "NCryptOpenStorageProvider");
+    }
+    NCRYPT_KEY_HANDLE key = 0;
+    status = NCryptOpenKey(provider, &key, info->pwszContainerName, info->dwKeySpec, info->dwFlags & NCRYPT_MACHINE_KEY_FLAG);
+    if (status == ERROR_SUCCESS) {
+      // Frees the key handle on success
+      status = NCryptDeleteKey(key, 0);
+      if (status != ERROR_SUCCESS) {
+        NCryptFreeObject(key);
+      }
+    }
+    NCryptFreeObject(provider);
+    if (status != ERROR_SUCCESS) {
+      detail::throw_error(error::make_error_code(status), "NCryptDeleteKey");
+    }
+  } else {
+    HCRYPTPROV provider = 0;
+    if (!CryptAcquireContextW(&provider,
+                              info->pwszContainerName,
+                              info->pwszProvName,
+                              info->dwProvType,
+                              CRYPT_DELETEKEYSET | (info->dwFlags & CRYPT_MACHINE_KEYSET))) {
+      detail::throw_last_error("CryptAcquireContextW");
+    }
+  }
+
+  // The certificate no longer refers to the deleted key
+  CertSetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, 0, nullptr);
+}
+
+BOOST_WINTLS_DECL void delete_private_key(const CERT_CONTEXT* cert, boost::system::error_code& ec) {
+  ec = {};
+  try {
+    delete_private_key(cert);
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+  }
+}
+
+BOOST_WINTLS_DECL void assign_private_key(const CERT_CONTEXT* cert, const std::string& name) {
+  // TODO: Move to utility function
+  const auto size = name.size() + 1;
+  auto wname = std::make_unique<WCHAR[]>(size);
+  const auto size_converted = mbstowcs(wname.get(), name.c_str(), size);
+  BOOST_VERIFY_MSG(size_converted == name.size(), "mbstowcs");
+
+  CRYPT_KEY_PROV_INFO keyProvInfo{};
+  keyProvInfo.pwszContainerName = wname.get();
+  keyProvInfo.pwszProvName = nullptr;
+  keyProvInfo.dwFlags = CERT_SET_KEY_PROV_HANDLE_PROP_ID | CERT_SET_KEY_CONTEXT_PROP_ID;
+  keyProvInfo.dwProvType = PROV_RSA_FULL;
+  keyProvInfo.dwKeySpec = AT_KEYEXCHANGE;
+
+  if (!CertSetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, 0, &keyProvInfo)) {
+    detail::throw_last_error("CertSetCertificateContextProperty");
+  }
+}
+
+BOOST_WINTLS_DECL void assign_private_key(const CERT_CONTEXT* cert, const std::string& name, boost::system::error_code& ec) {
+  ec = {};
+  try {
+    assign_private_key(cert, name);
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+  }
+}
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_IMPL_CERTIFICATE_IPP
@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_IMPL_SRC_HPP
+#define BOOST_WINTLS_IMPL_SRC_HPP
+
+// Include this file in exactly one translation unit of a program
+// compiled with BOOST_WINTLS_SEPARATE_COMPILATION defined.
+
+#if !defined(BOOST_WINTLS_SEPARATE_COMPILATION)
+#error BOOST_WINTLS_SEPARATE_COMPILATION must be defined when compiling the library source
+#endif
+
+#include <boost/wintls.hpp>
+
+#include <boost/wintls/impl/certificate.ipp>
+#include <boost/wintls/detail/impl/context_certificates.ipp>
+#include <boost/wintls/detail/impl/sspi_decrypt.ipp>
+#include <boost/wintls/detail/impl/sspi_handshake.ipp>
+
+namespace boost {
+namespace wintls {
+
+template class stream<net::ip::tcp::socket>;
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_IMPL_SRC_HPP
@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_INITIALIZE_HPP
+#define BOOST_WINTLS_INITIALIZE_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/error.hpp>
+#include <boost/wintls/detail/sspi_functions.hpp>
+
+#include <boost/wintls/error.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+
+/// The time spent on one step of warming up the library.
+struct initialization_step {
+  /// A short description of the step.
+  const char* name;
+
+  /// The time the step took.
+  std::chrono::steady_clock::duration duration;
+};
+
+namespace detail {
+template <class Function>
+void timed_step(std::vector<initialization_step>& steps, const char* name, Function&& function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  steps.push_back({name, std::chrono::steady_clock::now() - start});
+}
+
+inline std::vector<initialization_step> initialize_libraries() {
+  std::vector<initialization_step> steps;
+
+  timed_step(steps, "InitSecurityInterfaceW", [] {
+    if (sspi_functions::sspi_function_table() == nullptr) {
+      throw_last_error("InitSecurityInterfaceW");
+    }
+  });
+
+  timed_step(steps, "QuerySecurityPackageInfoW", [] {
+    PSecPkgInfoW package_info = nullptr;
+    const auto sc = sspi_functions::QuerySecurityPackageInfo(const_cast<SEC_WCHAR*>(UNISP_NAME), &package_info);
+    if (sc != SEC_E_OK) {
+      throw_error(error::make_error_code(sc), "QuerySecurityPackageInfoW");
+    }
+    sspi_functions::FreeContextBuffer(package_info);
+  });
+
+  timed_step(steps, "CertOpenSystemStoreW", [] {
+    for (auto name : {L"ROOT", L"CA"}) {
+      auto store = CertOpenSystemStoreW(0, name);
+      if (store == nullptr) {
+        throw_last_error("CertOpenSystemStoreW");
+      }
+      CertCloseStore(store, 0);
+    }
+  });
+
+  return steps;
+}
+
+// Initializes the libraries the first time it is called successfully
+// and returns the steps timed by that call. Sets performed if it was
+// this call.
+inline const std::vector<initialization_step>& initialize_once(bool& performed) {
+  static std::once_flag once;
+  static std::vector<initialization_step> steps;
+  performed = false;
+  // Retried on the next call if an exception is thrown
+  std::call_once(once, [&performed] {
+    steps = initialize_libraries();
+    performed = true;
+  });
+  return steps;
+}
+} // namespace detail
+
+/** Initialize the operating system libraries used for TLS.
+ *
+ * The first stream performing a handshake in a process otherwise has
+ * to initialize the security interface, load the security package
+ * and open the system certificate stores. Calling this function at
+ * startup moves that latency away from the first connection.
+ *
+ * Only the first successful call does any work. Later calls return
+ * the time spent on each step by that call.
+ *
+ * Credentials are acquired per context, see @ref context::warm_up.
+ *
+ * @return The time spent on each step.
+ *
+ * @throws boost::system::system_error Thrown on failure.
+ */
+inline std::vector<initialization_step> initialize() {
+  bool performed;
+  return detail::initialize_once(performed);
+}
+
+/** Initialize the operating system libraries used for TLS.
+ *
+ * The first stream performing a handshake in a process otherwise has
+ * to initialize the security interface, load the security package
+ * and open the system certificate stores. Calling this function at
+ * startup moves that latency away from the first connection.
+ *
+ * Only the first successful call does any work. Later calls return
+ * the time spent on each step by that call.
+ *
+ * Credentials are acquired per context, see @ref context::warm_up.
+ *
+ * @param ec Set to indicate what error occurred, if any.
+ *
+ * @return The time spent on each step.
+ */
+inline std::vector<initialization_step> initialize(boost::system::error_code& ec) {
+  ec = {};
+  try {
+    return initialize();
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+    return {};
+  }
+}
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_INITIALIZE_HPP
@@ -0,0 +1,176 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_OCSP_STAPLER_HPP
+#define BOOST_WINTLS_OCSP_STAPLER_HPP
+
+#include <boost/wintls/context.hpp>
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/ocsp.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+
+/** Keeps an OCSP response stapled to the server certificate of a context.
+ *
+ * The stapler asks the application for an OCSP response for the
+ * server certificate of a @ref context and staples it using @ref
+ * context::use_ocsp_response. A new response is requested when half
+ * of the time until the next update of the current response has
+ * passed, so a response is always stapled well before it expires.
+ *
+ * The response is provided by a function supplied by the
+ * application, e.g. returning a response from a cache shared by
+ * multiple servers or fetching it from the OCSP responder. The
+ * function is called from the executor of the stapler and should not
+ * block for long.
+ *
+ * If the function throws or the response returned is not valid, the
+ * currently stapled response is kept and a new response is requested
+ * again after a minute.
+ *
+ * @par Thread Safety
+ * @e Distinct @e objects: Safe.@n
+ * @e Shared @e objects: Unsafe.
+ */
+class ocsp_stapler {
+public:
+  /// The function providing DER encoded OCSP responses for a certificate.
+  using response_provider = std::function<std::vector<std::uint8_t>(const CERT_CONTEXT* cert)>;
+
+  /** Construct a stapler.
+   *
+   * @param ex The executor or execution context used for scheduling
+   * refreshes of the response.
+   *
+   * @param ctx The context to staple the response to. The context
+   * must outlive the stapler.
+   *
+   * @param provider The function providing the OCSP responses.
+   */
+  template <class ExecutorOrContext>
+  ocsp_stapler(ExecutorOrContext&& ex, context& ctx, response_provider provider)
+    : timer_(std::forward<ExecutorOrContext>(ex))
+    , context_(ctx)
+    , provider_(std::move(provider)) {
+  }
+
+  ocsp_stapler(const ocsp_stapler&) = delete;
+  ocsp_stapler& operator=(const ocsp_stapler&) = delete;
+
+  /** Staple a new response now.
+   *
+   * This function requests a new response and staples it, after
+   * which refreshing the response is scheduled. This must be called
+   * to start stapling and should be called again after replacing the
+   * server certificate of the context.
+   *
+   * @throws boost::system::system_error Thrown on failure. A refresh
+   * is scheduled regardless.
+   */
+  void refresh() {
+    try {
+      const auto snapshot = context_.snapshot();
+      const auto* cert = snapshot->certificates.server_cert.get();
+      if (cert == nullptr) {
+        detail::throw_error(error::make_error_code(SEC_E_NO_CREDENTIALS), "ocsp_stapler");
+      }
+      const auto response = provider_(cert);
+      const auto validity = detail::parse_ocsp_response(net::buffer(response), cert);
+      context_.use_ocsp_response(net::buffer(response));
+      next_update_ = validity.next_update;
+    } catch (...) {
+      schedule(std::chrono::minutes{1});
+      throw;
+    }
+    schedule(refresh_delay());
+  }
+
+  /** Staple a new response now.
+   *
+   * This function requests a new response and staples it, after
+   * which refreshing the response is scheduled. This must be called
+   * to start stapling and should be called again after replacing the
+   * server certificate of the context.
+   *
+   * @param ec Set to indicate what error occurred, if any. A refresh
+   * is scheduled regardless.
+   */
+  void refresh(boost::system::error_code& ec) {
+    ec = {};
+    try {
+      refresh();
+    } catch (const boost::system::system_error& e) {
+      ec = e.code();
+    }
+  }
+
+  /** Stop refreshing the response.
+   *
+   * The currently stapled response is left attached to the server
+   * certificate.
+   */
+  void stop() {
+    timer_.cancel();
+  }
+
+  /** The next update of the currently stapled response.
+   *
+   * @return The time newer information will be available, or the
+   * maximum time point if no response has been stapled or the
+   * response does not specify it.
+   */
+  std::chrono::system_clock::time_point next_update() const {
+    return next_update_;
+  }
+
+private:
+  std::chrono::steady_clock::duration refresh_delay() const {
+    if (next_update_ == std::chrono::system_clock::time_point::max()) {
+      return std::chrono::hours{1};
+    }
+    const auto remaining = next_update_ - std::chrono::system_clock::now();
+    return std::max<std::chrono::steady_clock::duration>(remaining / 2, std::chrono::minutes{1});
+  }
+
+  void schedule(std::chrono::steady_clock::duration delay) {
+    timer_.expires_after(delay);
+    timer_.async_wait([this](const boost::system::error_code& ec) {
+      // The stapler may be gone if the wait was aborted
+      if (ec == net::error::operation_aborted) {
+        return;
+      }
+      // A retry has been scheduled on any failure. Nothing thrown by
+      // the provider, whatever it is, may escape the handler and the
+      // run function of the executor.
+      try {
+        refresh();
+      } catch (...) {
+      }
+    });
+  }
+
+  net::steady_timer timer_;
+  context& context_;
+  response_provider provider_;
+  std::chrono::system_clock::time_point next_update_ = std::chrono::system_clock::time_point::max();
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_OCSP_STAPLER_HPP
@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_RECORD_BUFFER_HPP
+#define BOOST_WINTLS_RECORD_BUFFER_HPP
+
+#include <boost/wintls/detail/config.hpp>
+
+#include <boost/asio/buffer.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace boost {
+namespace wintls {
+
+namespace detail {
+class sspi_decrypt;
+}
+
+/** The decrypted data of a TLS record.
+ *
+ * A record buffer refers to the data decrypted in place in the buffer
+ * it was received in, so reading it does not involve copying the
+ * data. The buffer may hold several records and is owned by the
+ * stream and all record buffers referring to it together. It is
+ * returned to the stream buffer pool, or freed, when the last of
+ * them is done with it.
+ *
+ * Record buffers stay valid regardless of further reads or the
+ * stream being destroyed and may be passed to other threads.
+ *
+ * @par Thread Safety
+ * @e Distinct @e objects: Safe.@n
+ * @e Shared @e objects: Unsafe.
+ */
+class record_buffer {
+public:
+  /// Construct an empty record buffer.
+  record_buffer() = default;
+
+  /// The decrypted data.
+  net::const_buffer data() const {
+    return data_;
+  }
+
+  /// The size of the decrypted data.
+  std::size_t size() const {
+    return data_.size();
+  }
+
+  /// Whether the record buffer holds no data.
+  bool empty() const {
+    return data_.size() == 0;
+  }
+
+  /// Release this copy of the record buffer, leaving it empty.
+  void reset() {
+    owner_.reset();
+    data_ = net::const_buffer{};
+  }
+
+private:
+  friend class detail::sspi_decrypt;
+
+  record_buffer(std::shared_ptr<const void> owner, net::const_buffer data)
+    : owner_(std::move(owner))
+    , data_(data) {
+  }
+
+  std::shared_ptr<const void> owner_;
+  net::const_buffer data_;
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_RECORD_BUFFER_HPP
@@ -0,0 +1,98 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_RELAY_HPP
+#define BOOST_WINTLS_RELAY_HPP
+
+#include <boost/wintls/relay_statistics.hpp>
+
+#include <boost/wintls/detail/async_relay.hpp>
+
+#include <boost/asio/async_result.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace boost {
+namespace wintls {
+
+/** Start relaying data between two streams.
+ *
+ * This function is used to asynchronously pass all data received on
+ * one stream to the other until both streams have been closed by
+ * their peer, e.g. in a TLS terminating proxy. The function call
+ * always returns immediately.
+ *
+ * Whole TLS records are read using `async_read_record`, so the data
+ * decrypted by one stream is only copied once, when encrypted by the
+ * other stream.
+ *
+ * When a peer closes the TLS channel, the remaining data read from it
+ * is written to the other stream, which is then shut down while data
+ * is still relayed in the opposite direction.
+ *
+ * Reading from a stream stops while the data read from it and not
+ * yet written to the other stream exceeds the given limit, so a slow
+ * peer slows down the other instead of making memory use grow.
+ *
+ * Both streams must use the same executor, which must not run their
+ * handlers concurrently, and no other operations may be performed on
+ * the streams until the relay completes.
+ *
+ * @param a The first stream, e.g. a @ref stream.
+ * @param b The second stream, e.g. a @ref stream.
+ * @param max_in_flight The maximum number of bytes read from a stream
+ * and waiting to be written to the other.
+ * @param handler The handler to be called when the relay
+ * completes. Copies will be made of the handler as required. The
+ * equivalent function signature of the handler must be:
+ * @code
+ * void handler(
+ *     const boost::system::error_code& error,        // Result of operation.
+ *     boost::wintls::relay_statistics statistics     // The data relayed.
+ * ); @endcode
+ * On failure, the operations pending on both streams are cancelled
+ * before the handler is called.
+ */
+template <class StreamA, class StreamB, class CompletionToken>
+auto async_relay(StreamA& a, StreamB& b, std::size_t max_in_flight, CompletionToken&& handler) {
+  return net::async_initiate<CompletionToken, void(boost::system::error_code, relay_statistics)>(
+      [&a, &b, max_in_flight](auto&& h) {
+        using handler_type = typename std::decay<decltype(h)>::type;
+        auto op = std::make_shared<detail::async_relay<StreamA, StreamB, handler_type>>(a, b, max_in_flight, std::move(h));
+        op->start();
+      },
+      handler);
+}
+
+/** Start relaying data between two streams.
+ *
+ * Works like @ref async_relay with a limit of 64 KiB of data in flight
+ * in each direction.
+ *
+ * @param a The first stream, e.g. a @ref stream.
+ * @param b The second stream, e.g. a @ref stream.
+ * @param handler The handler to be called when the relay
+ * completes. Copies will be made of the handler as required. The
+ * equivalent function signature of the handler must be:
+ * @code
+ * void handler(
+ *     const boost::system::error_code& error,        // Result of operation.
+ *     boost::wintls::relay_statistics statistics     // The data relayed.
+ * ); @endcode
+ */
+template <class StreamA, class StreamB, class CompletionToken>
+auto async_relay(StreamA& a, StreamB& b, CompletionToken&& handler) {
+  return async_relay(a, b, 0x10000, std::forward<CompletionToken>(handler));
+}
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_RELAY_HPP
@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_RELAY_STATISTICS_HPP
+#define BOOST_WINTLS_RELAY_STATISTICS_HPP
+
+#include <cstdint>
+
+namespace boost {
+namespace wintls {
+
+/// Counters describing the data relayed by @ref async_relay.
+struct relay_statistics {
+  /// Counters for one direction.
+  struct direction {
+    /// The number of decrypted bytes relayed.
+    std::uint64_t bytes = 0;
+
+    /// The number of records relayed.
+    std::uint64_t records = 0;
+  };
+
+  /// Data read from the first stream and written to the second.
+  direction a_to_b;
+
+  /// Data read from the second stream and written to the first.
+  direction b_to_a;
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_RELAY_STATISTICS_HPP
@@ -0,0 +1,32 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_SHUTDOWN_MODE_HPP
+#define BOOST_WINTLS_SHUTDOWN_MODE_HPP
+
+namespace boost {
+namespace wintls {
+
+/// Different ways of shutting down TLS on a stream.
+enum class shutdown_mode {
+  /// Send a close_notify alert to the peer without waiting for one
+  /// in return.
+  close_notify,
+
+  /// Send a close_notify alert to the peer and wait for the peer to
+  /// send one in return. Any data received meanwhile is discarded.
+  bidirectional,
+
+  /// Do not notify the peer. The security context and buffers of the
+  /// stream are released immediately.
+  fast
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_SHUTDOWN_MODE_HPP
@@ -10,18 +10,30 @@
 
 #include <boost/wintls/error.hpp>
 #include <boost/wintls/handshake_type.hpp>
+#include <boost/wintls/record_buffer.hpp>
+#include <boost/wintls/shutdown_mode.hpp>
+#include <boost/wintls/stream_statistics.hpp>
+#include <boost/wintls/stream_timeouts.hpp>
+#include <boost/wintls/timer_wheel.hpp>
+#include <boost/wintls/traffic_keys.hpp>
 
 #include <boost/wintls/detail/async_handshake.hpp>
 #include <boost/wintls/detail/async_read.hpp>
+#include <boost/wintls/detail/async_read_record.hpp>
 #include <boost/wintls/detail/async_shutdown.hpp>
 #include <boost/wintls/detail/async_write.hpp>
+#include <boost/wintls/detail/record_payload_size.hpp>
 #include <boost/wintls/detail/sspi_stream.hpp>
+#include <boost/wintls/detail/stream_deadline.hpp>
 
 #include <boost/asio/compose.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/system/error_code.hpp>
 
+#include <array>
+#include <chrono>
 #include <memory>
+#include <thread>
 
 namespace boost {
 namespace wintls {
@@ -59,6 +71,9 @@ public:
   stream(Arg&& arg, context& ctx)
     : next_layer_(std::forward<Arg>(arg))
     , sspi_stream_(std::make_unique<detail::sspi_stream>(ctx)) {
+    // A TLS stream below delivers a whole record per read, which is
+    // read in one go instead of being split up and buffered
+    sspi_stream_->decrypt.adaptive_read_size = !detail::has_record_payload_size<next_layer_type>::value;
   }
 
   stream(stream&& other) = default;
@@ -114,6 +129,217 @@ public:
     sspi_stream_->handshake.set_server_hostname(hostname);
   }
 
+  /** Get statistics about the data read by the stream.
+   *
+   * The size of the reads from the next layer adapts to the traffic
+   * on the stream. It is kept small when receiving little data at a
+   * time and grows when more data than requested is waiting, to need
+   * fewer reads for bulk transfers.
+   *
+   * @return The current statistics.
+   */
+  stream_statistics statistics() const {
+    return sspi_stream_->decrypt.statistics();
+  }
+
+  /** Get the memory held by the buffers of the stream.
+   *
+   * The buffers for the handshake are freed once it is done, and the
+   * buffers for reading and writing are only allocated when first
+   * needed. With @ref context::use_buffer_pool, the buffer for
+   * reading is only held while there is data to read, so an idle
+   * stream holds no buffers at all. The memory used by Schannel
+   * itself is not included.
+   *
+   * @return The number of bytes held by the buffers.
+   */
+  std::size_t buffer_memory() const {
+    return sspi_stream_->buffer_memory();
+  }
+
+  /** Use a timer wheel for the deadlines of asynchronous operations.
+   *
+   * Each asynchronous handshake, read and shutdown started afterwards
+   * registers a deadline with the wheel according to the given
+   * timeouts. When a deadline expires, pending operations on the next
+   * layer are cancelled, or the next layer is closed if it does not
+   * support cancellation, and the operation completes with
+   * `net::error::timed_out`.
+   *
+   * A read timeout applies to each call to `async_read_some` or
+   * `async_read_record`, e.g. to each read done by `net::async_read`,
+   * so it limits how long the stream may be idle.
+   *
+   * @param wheel The timer wheel to use. Must outlive all operations
+   * on the stream.
+   * @param timeouts The timeouts of the operations.
+   */
+  void use_timer_wheel(timer_wheel& wheel, const stream_timeouts& timeouts) {
+    sspi_stream_->deadline = std::make_shared<detail::stream_deadline>(wheel, timeouts);
+  }
+
+  /** Limit the rate of writing to the stream.
+   *
+   * Writes wait as needed to keep the average number of bytes of TLS
+   * records written per second within the limit. Records are made no
+   * larger than the burst size, so a throttled stream sends small
+   * records at a steady pace instead of bursts of full size records.
+   *
+   * @param bytes_per_second The maximum average number of bytes
+   * written per second, or zero for no limit.
+   * @param burst_size The maximum number of bytes written at once.
+   * Zero means a tenth of a second worth of data, but at least 1 KiB.
+   */
+  void limit_write_rate(std::size_t bytes_per_second, std::size_t burst_size = 0) {
+    sspi_stream_->encrypt.buffers.rate_limit = detail::token_bucket{bytes_per_second, burst_size};
+  }
+
+  /** Limit the rate of reading from the stream.
+   *
+   * Reads from the next layer wait as needed to keep the average
+   * number of bytes read per second within the limit and read no
+   * more than the burst size at a time, leaving the rest of the data
+   * in the next layer, e.g. the receive buffer of a socket, so the
+   * peer is slowed down by flow control.
+   *
+   * @param bytes_per_second The maximum average number of bytes read
+   * per second, or zero for no limit.
+   * @param burst_size The maximum number of bytes read at once. Zero
+   * means a tenth of a second worth of data, but at least 1 KiB.
+   */
+  void limit_read_rate(std::size_t bytes_per_second, std::size_t burst_size = 0) {
+    sspi_stream_->decrypt.rate_limit = detail::token_bucket{bytes_per_second, burst_size};
+  }
+
+  /** Get the maximum size of the data in a TLS record.
+   *
+   * Another stream layered on top of this stream, e.g. when
+   * tunnelling TLS through a TLS connection to a proxy, uses this to
+   * keep each of its records small enough to be sent in a single
+   * record of this stream.
+   *
+   * @return The maximum number of bytes sent in a record or zero if
+   * not known, e.g. before the handshake has completed.
+   */
+  std::size_t record_payload_size() {
+    return sspi_stream_->encrypt.max_message_size();
+  }
+
+  /** Export the secrets protecting the TLS records of the stream.
+   *
+   * Gets the TLS 1.3 traffic secrets negotiated by the handshake
+   * along with the sequence numbers of the next records in each
+   * direction, e.g. for setting up kernel TLS or a network card
+   * offloading the encryption. Use together with @ref
+   * offload_record_layer.
+   *
+   * Must be called right after the handshake, before anything has
+   * been read from or written to the stream, otherwise it fails with
+   * `net::error::in_progress`. The sequence numbers are those reported
+   * by Schannel, which include any records Schannel sent itself, e.g.
+   * a session ticket at the end of the handshake.
+   *
+   * Needs a version of Schannel providing the traffic secrets of a
+   * connection. Fails with `net::error::operation_not_supported` if
+   * built with a Windows SDK without support for that.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @returns The secrets of the records read and written.
+   */
+  traffic_keys export_traffic_keys(boost::system::error_code& ec) {
+    if (!sspi_stream_->handshake.done()) {
+      ec = net::error::not_connected;
+      return {};
+    }
+    return sspi_stream_->export_traffic_keys(ec);
+  }
+
+  /** Export the secrets protecting the TLS records of the stream.
+   *
+   * Gets the TLS 1.3 traffic secrets negotiated by the handshake
+   * along with the sequence numbers of the next records in each
+   * direction, e.g. for setting up kernel TLS or a network card
+   * offloading the encryption. Use together with @ref
+   * offload_record_layer.
+   *
+   * Must be called right after the handshake, before anything has
+   * been read from or written to the stream. The sequence numbers are
+   * those reported by Schannel, which include any records Schannel
+   * sent itself, e.g. a session ticket at the end of the handshake.
+   *
+   * Needs a version of Schannel providing the traffic secrets of a
+   * connection.
+   *
+   * @returns The secrets of the records read and written.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  traffic_keys export_traffic_keys() {
+    boost::system::error_code ec{};
+    auto keys = export_traffic_keys(ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+    return keys;
+  }
+
+  /** Hand the processing of TLS records over to the next layer.
+   *
+   * Afterwards data is written to and read from the next layer as
+   * is, leaving the encryption and decryption of the records to the
+   * next layer, e.g. a socket with kernel TLS set up using the
+   * secrets from @ref export_traffic_keys. Any data already decrypted
+   * but not read yet is still returned first. Shutting down the
+   * stream only releases the security context, as sending the
+   * close_notify alert is up to the next layer as well.
+   *
+   * Must be called with no operations pending and after all data
+   * read from the next layer has been decrypted, otherwise it fails
+   * with `net::error::in_progress`. Neither should be done between
+   * exporting the secrets and calling this, as the sequence numbers
+   * would no longer match.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   */
+  void offload_record_layer(boost::system::error_code& ec) {
+    if (!sspi_stream_->handshake.done()) {
+      ec = net::error::not_connected;
+      return;
+    }
+    if (sspi_stream_->decrypt.buffered_input()) {
+      ec = net::error::in_progress;
+      return;
+    }
+    ec = {};
+    sspi_stream_->offload();
+  }
+
+  /** Hand the processing of TLS records over to the next layer.
+   *
+   * Afterwards data is written to and read from the next layer as
+   * is, leaving the encryption and decryption of the records to the
+   * next layer, e.g. a socket with kernel TLS set up using the
+   * secrets from @ref export_traffic_keys. Any data already decrypted
+   * but not read yet is still returned first. Shutting down the
+   * stream only releases the security context, as sending the
+   * close_notify alert is up to the next layer as well.
+   *
+   * Must be called with no operations pending and after all data
+   * read from the next layer has been decrypted. Neither should be
+   * done between exporting the secrets and calling this, as the
+   * sequence numbers would no longer match.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  void offload_record_layer() {
+    boost::system::error_code ec{};
+    offload_record_layer(ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+  }
+
   /** Perform TLS handshaking.
    *
    * This function is used to perform TLS handshaking on the
@@ -200,7 +426,11 @@ public:
   template <class CompletionToken>
   auto async_handshake(handshake_type type, CompletionToken&& handler) {
     return boost::asio::async_compose<CompletionToken, void(boost::system::error_code)>(
-        detail::async_handshake<next_layer_type>{next_layer_, sspi_stream_->handshake, type}, handler);
+        detail::async_handshake<next_layer_type>{next_layer_,
+                                                 sspi_stream_->handshake,
+                                                 type,
+                                                 start_deadline(detail::deadline_kind::handshake)},
+        handler);
   }
 
   /** Read some data from the stream.
@@ -223,7 +453,8 @@ public:
   size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& ec) {
     detail::sspi_decrypt::state state;
     while((state = sspi_stream_->decrypt(buffers)) == detail::sspi_decrypt::state::data_needed) {
-      std::size_t size_read = next_layer_.read_some(sspi_stream_->decrypt.input_buffer, ec);
+      throttle(sspi_stream_->decrypt.rate_limit);
+      std::size_t size_read = next_layer_.read_some(sspi_stream_->decrypt.input_buffer(), ec);
       if (ec) {
         return 0;
       }
@@ -293,7 +524,101 @@ public:
   template <class MutableBufferSequence, class CompletionToken>
   auto async_read_some(const MutableBufferSequence& buffers, CompletionToken&& handler) {
     return boost::asio::async_compose<CompletionToken, void(boost::system::error_code, std::size_t)>(
-        detail::async_read<next_layer_type, MutableBufferSequence>{next_layer_, buffers, sspi_stream_->decrypt}, handler);
+        detail::async_read<next_layer_type, MutableBufferSequence>{next_layer_,
+                                                                   buffers,
+                                                                   sspi_stream_->decrypt,
+                                                                   start_deadline(detail::deadline_kind::read)},
+        handler);
+  }
+
+  /** Read a TLS record from the stream.
+   *
+   * This function is used to read the decrypted data of the next TLS
+   * record from the stream without copying it. The function call will
+   * block until a record has been read successfully, or until an
+   * error occurs.
+   *
+   * The returned record buffer owns the buffer the record was
+   * decrypted in, which is taken from the buffer pool of the stream
+   * if enabled with @ref context::use_buffer_pool. The application
+   * may keep it for as long as needed.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @returns The decrypted record, which may be empty.
+   */
+  record_buffer read_record(boost::system::error_code& ec) {
+    record_buffer record;
+    detail::sspi_decrypt::state state;
+    while((state = sspi_stream_->decrypt(record)) == detail::sspi_decrypt::state::data_needed) {
+      throttle(sspi_stream_->decrypt.rate_limit);
+      std::size_t size_read = next_layer_.read_some(sspi_stream_->decrypt.input_buffer(), ec);
+      if (ec) {
+        return {};
+      }
+      sspi_stream_->decrypt.size_read(size_read);
+      continue;
+    }
+
+    if (state == detail::sspi_decrypt::state::error) {
+      ec = sspi_stream_->decrypt.last_error();
+      return {};
+    }
+
+    ec = {};
+    return record;
+  }
+
+  /** Read a TLS record from the stream.
+   *
+   * This function is used to read the decrypted data of the next TLS
+   * record from the stream without copying it. The function call will
+   * block until a record has been read successfully, or until an
+   * error occurs.
+   *
+   * The returned record buffer owns the buffer the record was
+   * decrypted in, which is taken from the buffer pool of the stream
+   * if enabled with @ref context::use_buffer_pool. The application
+   * may keep it for as long as needed.
+   *
+   * @returns The decrypted record, which may be empty.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  record_buffer read_record() {
+    boost::system::error_code ec{};
+    auto record = read_record(ec);
+    if (ec) {
+      detail::throw_error(ec);
+    }
+    return record;
+  }
+
+  /** Start an asynchronous read of a TLS record.
+   *
+   * This function is used to asynchronously read the decrypted data
+   * of the next TLS record from the stream without copying it. The
+   * function call always returns immediately.
+   *
+   * The record buffer passed to the handler owns the buffer the
+   * record was decrypted in, which is taken from the buffer pool of
+   * the stream if enabled with @ref context::use_buffer_pool. The
+   * application may keep it for as long as needed.
+   *
+   * @param handler The handler to be called when the read operation
+   * completes.  Copies will be made of the handler as required. The
+   * equivalent function signature of the handler must be:
+   * @code
+   * void handler(
+   *     const boost::system::error_code& error, // Result of operation.
+   *     boost::wintls::record_buffer record     // The decrypted record.
+   * ); @endcode
+   */
+  template <class CompletionToken>
+  auto async_read_record(CompletionToken&& handler) {
+    return boost::asio::async_compose<CompletionToken, void(boost::system::error_code, record_buffer)>(
+        detail::async_read_record<next_layer_type>{next_layer_, sspi_stream_->decrypt, start_deadline(detail::deadline_kind::read)},
+        handler);
   }
 
   /** Write some data to the stream.
@@ -314,7 +639,14 @@ public:
    */
   template <class ConstBufferSequence>
   std::size_t write_some(const ConstBufferSequence& buffers, boost::system::error_code& ec) {
-    std::size_t bytes_consumed = sspi_stream_->encrypt(buffers, ec);
+    throttle(sspi_stream_->encrypt.buffers.rate_limit);
+    if (sspi_stream_->offloaded()) {
+      std::size_t size_written = next_layer_.write_some(buffers, ec);
+      sspi_stream_->encrypt.buffers.rate_limit.consume(size_written, detail::token_bucket::clock_type::now());
+      return size_written;
+    }
+
+    std::size_t bytes_consumed = sspi_stream_->encrypt(buffers, ec, detail::record_payload_size(next_layer_, detail::priority<1>{}));
     if (ec) {
       return 0;
     }
@@ -382,7 +714,11 @@ public:
   template <class ConstBufferSequence, class CompletionToken>
   auto async_write_some(const ConstBufferSequence& buffers, CompletionToken&& handler) {
     return boost::asio::async_compose<CompletionToken, void(boost::system::error_code, std::size_t)>(
-        detail::async_write<next_layer_type, ConstBufferSequence>{next_layer_, buffers, sspi_stream_->encrypt}, handler);
+        detail::async_write<next_layer_type, ConstBufferSequence>{next_layer_,
+                                                                  buffers,
+                                                                  sspi_stream_->encrypt,
+                                                                  detail::record_payload_size(next_layer_, detail::priority<1>{})},
+        handler);
   }
 
   /** Shut down TLS on the stream.
@@ -391,30 +727,110 @@ public:
    * function call will block until TLS has been shut down or an
    * error occurs.
    *
+   * This sends a close_notify alert to the peer without waiting for
+   * one in return, like @ref shutdown_mode::close_notify.
+   *
    * @param ec Set to indicate what error occurred, if any.
    */
   void shutdown(boost::system::error_code& ec) {
+    shutdown(shutdown_mode::close_notify, ec);
+  }
+
+  /** Shut down TLS on the stream.
+   *
+   * This function is used to shut down TLS on the stream. The
+   * function call will block until TLS has been shut down or an error
+   * occurs.
+   *
+   * This sends a close_notify alert to the peer without waiting for
+   * one in return, like @ref shutdown_mode::close_notify.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  void shutdown() {
+    shutdown(shutdown_mode::close_notify);
+  }
+
+  /** Shut down TLS on the stream.
+   *
+   * This function is used to shut down TLS on the stream in the
+   * given way. The function call will block until TLS has been shut
+   * down or an error occurs.
+   *
+   * With @ref shutdown_mode::bidirectional this blocks until the
+   * close_notify alert from the peer has been received. Use @ref
+   * async_shutdown for limiting the time to wait.
+   *
+   * Once the session is over, the security context and all buffers of
+   * the stream are released. No other operations may be pending on
+   * the stream when using @ref shutdown_mode::fast.
+   *
+   * @param mode The @ref shutdown_mode to use.
+   * @param ec Set to indicate what error occurred, if any.
+   */
+  void shutdown(shutdown_mode mode, boost::system::error_code& ec) {
+    ec = {};
+    if (mode == shutdown_mode::fast || sspi_stream_->offloaded()) {
+      sspi_stream_->release();
+      return;
+    }
+
     ec = sspi_stream_->shutdown();
     if (ec) {
       return;
     }
     std::size_t size_written = net::write(next_layer_, sspi_stream_->shutdown.buffer(), ec);
-    if (!ec) {
-      sspi_stream_->shutdown.size_written(size_written);
+    if (ec) {
+      return;
+    }
+    sspi_stream_->shutdown.size_written(size_written);
+    sspi_stream_->close_notify_sent();
+
+    if (mode == shutdown_mode::close_notify) {
+      return;
+    }
+
+    // Discard any data until the close_notify alert from the peer
+    std::array<char, 1024> discarded;
+    detail::sspi_decrypt::state state;
+    while ((state = sspi_stream_->decrypt(net::buffer(discarded))) != detail::sspi_decrypt::state::error) {
+      if (state == detail::sspi_decrypt::state::data_needed) {
+        std::size_t size_read = next_layer_.read_some(sspi_stream_->decrypt.input_buffer(), ec);
+        if (ec) {
+          return;
+        }
+        sspi_stream_->decrypt.size_read(size_read);
+      }
+    }
+
+    ec = sspi_stream_->decrypt.last_error();
+    if (ec == net::error::eof) {
+      ec = {};
+      sspi_stream_->release();
     }
   }
 
   /** Shut down TLS on the stream.
    *
-   * This function is used to shut down TLS on the stream. The
-   * function call will block until TLS has been shut down or an error
-   * occurs.
+   * This function is used to shut down TLS on the stream in the
+   * given way. The function call will block until TLS has been shut
+   * down or an error occurs.
+   *
+   * With @ref shutdown_mode::bidirectional this blocks until the
+   * close_notify alert from the peer has been received. Use @ref
+   * async_shutdown for limiting the time to wait.
+   *
+   * Once the session is over, the security context and all buffers of
+   * the stream are released. No other operations may be pending on
+   * the stream when using @ref shutdown_mode::fast.
+   *
+   * @param mode The @ref shutdown_mode to use.
    *
    * @throws boost::system::system_error Thrown on failure.
    */
-  void shutdown() {
+  void shutdown(shutdown_mode mode) {
     boost::system::error_code ec{};
-    shutdown(ec);
+    shutdown(mode, ec);
     if (ec) {
       detail::throw_error(ec);
     }
@@ -425,6 +841,9 @@ public:
    * This function is used to asynchronously shut down TLS on the
    * stream. This function call always returns immediately.
    *
+   * This sends a close_notify alert to the peer without waiting for
+   * one in return, like @ref shutdown_mode::close_notify.
+   *
    * @param handler The handler to be called when the handshake
    * operation completes. Copies will be made of the handler as
    * required. The equivalent function signature of the handler must
@@ -436,15 +855,113 @@ public:
    */
   template <class CompletionToken>
   auto async_shutdown(CompletionToken&& handler) {
+    return async_shutdown(shutdown_mode::close_notify, std::forward<CompletionToken>(handler));
+  }
+
+  /** Asynchronously shut down TLS on the stream.
+   *
+   * This function is used to asynchronously shut down TLS on the
+   * stream in the given way. This function call always returns
+   * immediately.
+   *
+   * With @ref shutdown_mode::bidirectional the operation completes
+   * once the close_notify alert from the peer has been received.
+   *
+   * Once the session is over, the security context and all buffers of
+   * the stream are released. No other operations may be pending on
+   * the stream when using @ref shutdown_mode::fast.
+   *
+   * @param mode The @ref shutdown_mode to use.
+   * @param handler The handler to be called when the handshake
+   * operation completes. Copies will be made of the handler as
+   * required. The equivalent function signature of the handler must
+   * be:
+   * @code void handler(
+   *     const boost::system::error_code& error // Result of operation.
+   *);
+   * @endcode
+   */
+  template <class CompletionToken>
+  auto async_shutdown(shutdown_mode mode, CompletionToken&& handler) {
     return boost::asio::async_compose<CompletionToken, void(boost::system::error_code)>(
-        detail::async_shutdown<next_layer_type>{next_layer_, sspi_stream_->shutdown}, handler);
+        detail::async_shutdown<next_layer_type>{next_layer_,
+                                                *sspi_stream_,
+                                                sspi_stream_->offloaded() ? shutdown_mode::fast : mode,
+                                                std::chrono::steady_clock::duration::max(),
+                                                start_deadline(detail::deadline_kind::shutdown)},
+        handler);
+  }
+
+  /** Asynchronously shut down TLS on the stream.
+   *
+   * This function is used to asynchronously shut down TLS on the
+   * stream in the given way. This function call always returns
+   * immediately.
+   *
+   * With @ref shutdown_mode::bidirectional the operation completes
+   * once the close_notify alert from the peer has been received, or
+   * with `net::error::timed_out` if it has not been received within
+   * the given time. Pending operations on the next layer are
+   * cancelled on timeout, or the next layer is closed if it does not
+   * support cancellation.
+   *
+   * Once the session is over, the security context and all buffers of
+   * the stream are released. No other operations may be pending on
+   * the stream when using @ref shutdown_mode::fast.
+   *
+   * @param mode The @ref shutdown_mode to use.
+   * @param timeout The maximum time to wait for the close_notify
+   * alert from the peer.
+   * @param handler The handler to be called when the handshake
+   * operation completes. Copies will be made of the handler as
+   * required. The equivalent function signature of the handler must
+   * be:
+   * @code void handler(
+   *     const boost::system::error_code& error // Result of operation.
+   *);
+   * @endcode
+   */
+  template <class Rep, class Period, class CompletionToken>
+  auto async_shutdown(shutdown_mode mode, const std::chrono::duration<Rep, Period>& timeout, CompletionToken&& handler) {
+    return boost::asio::async_compose<CompletionToken, void(boost::system::error_code)>(
+        detail::async_shutdown<next_layer_type>{next_layer_,
+                                                *sspi_stream_,
+                                                sspi_stream_->offloaded() ? shutdown_mode::fast : mode,
+                                                std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout),
+                                                start_deadline(detail::deadline_kind::shutdown)},
+        handler);
   }
 
 private:
+  // Blocks until the rate limit allows reading or writing
+  static void throttle(detail::token_bucket& rate_limit) {
+    const auto delay = rate_limit.delay(detail::token_bucket::clock_type::now());
+    if (delay > detail::token_bucket::clock_type::duration::zero()) {
+      std::this_thread::sleep_for(delay);
+    }
+  }
+
+  // Registers the deadline of an operation with the timer wheel used,
+  // if any
+  detail::deadline_scope start_deadline(detail::deadline_kind kind) {
+    const auto& deadline = sspi_stream_->deadline;
+    if (!deadline) {
+      return {};
+    }
+    return detail::deadline_scope{deadline, kind, get_executor(), [next_layer = &next_layer_]() {
+      detail::cancel_next_layer(*next_layer, detail::priority<3>{});
+    }};
+  }
+
   NextLayer next_layer_;
   std::unique_ptr<detail::sspi_stream> sspi_stream_;
 };
 
+#if defined(BOOST_WINTLS_SEPARATE_COMPILATION)
+// Explicitly instantiated by <boost/wintls/impl/src.hpp>
+extern template class stream<net::ip::tcp::socket>;
+#endif
+
 } // namespace wintls
 } // namespace boost
 
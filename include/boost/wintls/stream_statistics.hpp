@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_STREAM_STATISTICS_HPP
+#define BOOST_WINTLS_STREAM_STATISTICS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace boost {
+namespace wintls {
+
+/// Counters describing the data read by a stream.
+struct stream_statistics {
+  /// The number of reads from the next layer.
+  std::uint64_t reads = 0;
+
+  /// The number of encrypted bytes read from the next layer.
+  std::uint64_t bytes_read = 0;
+
+  /// The number of TLS records decrypted.
+  std::uint64_t records = 0;
+
+  /// The number of bytes currently offered to the next layer per
+  /// read. Small for interactive traffic and growing for bulk
+  /// transfers.
+  std::size_t read_size = 0;
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_STREAM_STATISTICS_HPP
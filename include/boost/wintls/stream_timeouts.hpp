@@ -0,0 +1,33 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_STREAM_TIMEOUTS_HPP
+#define BOOST_WINTLS_STREAM_TIMEOUTS_HPP
+
+#include <chrono>
+
+namespace boost {
+namespace wintls {
+
+/// The maximum durations of asynchronous operations on a stream
+/// using a @ref timer_wheel. The maximum duration means no timeout.
+struct stream_timeouts {
+  /// The maximum duration of a handshake.
+  std::chrono::steady_clock::duration handshake = std::chrono::steady_clock::duration::max();
+
+  /// The maximum time a read waits for data.
+  std::chrono::steady_clock::duration read = std::chrono::steady_clock::duration::max();
+
+  /// The maximum duration of a shutdown, including waiting for the
+  /// close_notify alert from the peer.
+  std::chrono::steady_clock::duration shutdown = std::chrono::steady_clock::duration::max();
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_STREAM_TIMEOUTS_HPP
@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_TIMER_WHEEL_HPP
+#define BOOST_WINTLS_TIMER_WHEEL_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/hierarchical_wheel.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+
+namespace detail {
+class stream_deadline;
+}
+
+/** Keeps track of the deadlines of operations on many streams.
+ *
+ * Streams using a timer wheel, see @ref stream::use_timer_wheel,
+ * register the deadline of each operation with the wheel when the
+ * operation starts and remove it when the operation completes. Both
+ * take constant time and do not involve any timer of the next layer
+ * or the executor, so the deadlines of a large number of streams
+ * with frequent reads only cost a single timer ticking while there
+ * are deadlines to keep track of.
+ *
+ * Deadlines are rounded up to whole ticks of the wheel, so an
+ * operation times out up to one tick later than requested but never
+ * earlier. The resolution should be chosen as coarse as the timeouts
+ * allow.
+ *
+ * A wheel is intended to be used by the streams running on a single
+ * executor, e.g. one wheel per thread when running an io_context per
+ * thread, although streams on other executors may use it as well.
+ * The wheel must outlive the operations of the streams using it.
+ *
+ * @par Thread Safety
+ * @e Distinct @e objects: Safe.@n
+ * @e Shared @e objects: Safe.
+ */
+class timer_wheel {
+public:
+  /** Construct a timer wheel.
+   *
+   * @param ex The executor or execution context used for the timer
+   * driving the wheel.
+   *
+   * @param resolution The duration of a tick of the wheel.
+   */
+  template <class ExecutorOrContext>
+  explicit timer_wheel(ExecutorOrContext&& ex,
+                       std::chrono::steady_clock::duration resolution = std::chrono::milliseconds{100})
+    : state_(std::make_shared<state>(std::forward<ExecutorOrContext>(ex), resolution)) {
+  }
+
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+  ~timer_wheel() {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stopped = true;
+    state_->timer.cancel();
+  }
+
+  /// The duration of a tick of the wheel.
+  std::chrono::steady_clock::duration resolution() const {
+    return state_->resolution;
+  }
+
+  /// The number of deadlines currently registered.
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->wheel.size();
+  }
+
+private:
+  friend class detail::stream_deadline;
+
+  using clock_type = std::chrono::steady_clock;
+
+  // Shared with the timer, which may complete after the wheel is gone
+  struct state : std::enable_shared_from_this<state> {
+    template <class ExecutorOrContext>
+    state(ExecutorOrContext&& ex, clock_type::duration tick)
+      : timer(std::forward<ExecutorOrContext>(ex))
+      , resolution(tick)
+      , origin(clock_type::now()) {
+    }
+
+    void schedule(detail::wheel_entry& entry, clock_type::time_point expiry, std::function<void()> on_expiry) {
+      std::lock_guard<std::mutex> lock(mutex);
+      wheel.remove(entry);
+      if (wheel.empty() && !running) {
+        wheel.reset(ticks(clock_type::now()));
+      }
+      entry.on_expiry = std::move(on_expiry);
+      // Rounded up so the deadline never expires early
+      wheel.add(entry, ticks(expiry) + 1);
+      start();
+    }
+
+    void cancel(detail::wheel_entry& entry) {
+      std::lock_guard<std::mutex> lock(mutex);
+      wheel.remove(entry);
+    }
+
+    // Must be called with the mutex locked
+    void start() {
+      if (running || stopped) {
+        return;
+      }
+      running = true;
+      timer.expires_at(origin + resolution * static_cast<clock_type::rep>(wheel.next_tick()));
+      timer.async_wait([self = this->shared_from_this()](const boost::system::error_code& ec) {
+        self->on_tick(ec);
+      });
+    }
+
+    void on_tick(const boost::system::error_code& ec) {
+      std::vector<std::function<void()>> expired;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        if (ec == net::error::operation_aborted || stopped) {
+          return;
+        }
+        wheel.advance(ticks(clock_type::now()), [&expired](detail::wheel_entry& entry) {
+          expired.push_back(std::move(entry.on_expiry));
+        });
+        if (!wheel.empty()) {
+          start();
+        }
+      }
+      for (auto& f : expired) {
+        f();
+      }
+    }
+
+    // The number of whole ticks since the wheel was created
+    std::uint64_t ticks(clock_type::time_point t) const {
+      return t <= origin ? 0 : static_cast<std::uint64_t>((t - origin) / resolution);
+    }
+
+    mutable std::mutex mutex;
+    net::steady_timer timer;
+    const clock_type::duration resolution;
+    const clock_type::time_point origin;
+    detail::hierarchical_wheel wheel;
+    bool running = false;
+    bool stopped = false;
+  };
+
+  std::shared_ptr<state> state_;
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_TIMER_WHEEL_HPP
@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_TRAFFIC_KEYS_HPP
+#define BOOST_WINTLS_TRAFFIC_KEYS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+
+/// The secret protecting the TLS records sent in one direction.
+struct traffic_secret {
+  /// The CNG identifier of the symmetric algorithm, e.g. "AES".
+  std::string cipher;
+
+  /// The CNG identifier of the chaining mode, e.g. "ChainingModeGCM".
+  std::string chaining_mode;
+
+  /// The CNG identifier of the hash algorithm, e.g. "SHA384".
+  std::string hash;
+
+  /// The size in bytes of the key derived from the secret.
+  std::size_t key_size = 0;
+
+  /// The size in bytes of the IV derived from the secret.
+  std::size_t iv_size = 0;
+
+  /// The sequence number of the next record.
+  std::uint64_t sequence_number = 0;
+
+  /// The TLS 1.3 traffic secret the key and IV are derived from.
+  std::vector<unsigned char> secret;
+};
+
+/// The secrets protecting the TLS records of a stream, as seen from
+/// the stream.
+struct traffic_keys {
+  /// The secret of the records read from the peer.
+  traffic_secret read;
+
+  /// The secret of the records written to the peer.
+  traffic_secret write;
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_TRAFFIC_KEYS_HPP
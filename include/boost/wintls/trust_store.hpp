@@ -0,0 +1,113 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BOOST_WINTLS_TRUST_STORE_HPP
+#define BOOST_WINTLS_TRUST_STORE_HPP
+
+#include <boost/wintls/detail/config.hpp>
+#include <boost/wintls/detail/cert_chain.hpp>
+#include <boost/wintls/detail/decode_certificates.hpp>
+#include <boost/wintls/detail/mapped_file.hpp>
+
+#include <boost/wintls/certificate.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace boost {
+namespace wintls {
+
+class context;
+
+namespace detail {
+struct trust_store_state {
+  explicit trust_store_state(const std::vector<cert_context_ptr>& certs)
+    : store(open_cert_store(CERT_STORE_PROV_MEMORY))
+    , size(certs.size()) {
+    for (const auto& cert : certs) {
+      if (!CertAddCertificateContextToStore(store.get(), cert.get(), CERT_STORE_ADD_ALWAYS, nullptr)) {
+        throw_last_error("CertAddCertificateContextToStore");
+      }
+    }
+    engine = std::make_unique<cert_chain_engine>(store.get());
+  }
+
+  cert_store_ptr store;
+  std::unique_ptr<cert_chain_engine> engine;
+  std::size_t size;
+};
+} // namespace detail
+
+/** An immutable set of trusted certification authorities.
+ *
+ * A trust store can be shared by any number of contexts using @ref
+ * context::use_trust_store instead of each context holding its own
+ * copy of the same certificates. Copying a trust store is cheap as
+ * copies share the same underlying certificate store.
+ *
+ * The certificate chain engine used for verification is created
+ * once when the trust store is constructed and reused by every
+ * context using the trust store.
+ *
+ * @par Thread Safety
+ * @e Distinct @e objects: Safe.@n
+ * @e Shared @e objects: Safe.
+ */
+class trust_store {
+public:
+  /** Construct a trust store from certificates.
+   *
+   * @param certs The trusted certificates. The certificates are
+   * copied to the trust store.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  explicit trust_store(const std::vector<cert_context_ptr>& certs)
+    : state_(std::make_shared<const detail::trust_store_state>(certs)) {
+  }
+
+  /** Construct a trust store from a PEM bundle.
+   *
+   * @param pem_bundle Buffer holding any number of PEM encoded
+   * certificates, like a CA bundle.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  explicit trust_store(const net::const_buffer& pem_bundle)
+    : trust_store(detail::decode_certificates(pem_bundle)) {
+  }
+
+  /** Construct a trust store from a PEM file.
+   *
+   * @param filename The name of a file holding any number of PEM
+   * encoded certificates, like a CA bundle.
+   *
+   * @return The trust store.
+   *
+   * @throws boost::system::system_error Thrown on failure.
+   */
+  static trust_store from_file(const std::string& filename) {
+    detail::mapped_file file(filename);
+    return trust_store(file.buffer());
+  }
+
+  /// The number of certificates in the trust store.
+  std::size_t size() const {
+    return state_->size;
+  }
+
+private:
+  friend class context;
+
+  std::shared_ptr<const detail::trust_store_state> state_;
+};
+
+} // namespace wintls
+} // namespace boost
+
+#endif // BOOST_WINTLS_TRUST_STORE_HPP
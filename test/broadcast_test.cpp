@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "unittest.hpp"
+#include "wintls_client_stream.hpp"
+#include "wintls_server_stream.hpp"
+
+#include <boost/wintls.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/read.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using stream_type = boost::wintls::stream<test_stream>;
+
+struct connection {
+  connection(net::io_context& io_context, boost::wintls::context& client_ctx, boost::wintls::context& server_ctx)
+    : client(io_context, client_ctx)
+    , server(io_context, server_ctx) {
+    client.next_layer().connect(server.next_layer());
+    client.async_handshake(boost::wintls::handshake_type::client, [](const boost::system::error_code& ec) {
+      REQUIRE_FALSE(ec);
+    });
+    server.async_handshake(boost::wintls::handshake_type::server, [](const boost::system::error_code& ec) {
+      REQUIRE_FALSE(ec);
+    });
+  }
+
+  std::string receive(std::size_t size) {
+    std::string data(size, '\0');
+    net::read(client, net::buffer(&data[0], data.size()));
+    return data;
+  }
+
+  stream_type client;
+  stream_type server;
+};
+
+boost::wintls::broadcaster<stream_type>::payload_type make_payload(const std::string& str) {
+  return std::make_shared<const std::vector<std::uint8_t>>(str.begin(), str.end());
+}
+
+}
+
+TEST_CASE("broadcaster") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+
+  std::vector<std::unique_ptr<connection>> connections;
+  for (int i = 0; i < 3; ++i) {
+    connections.push_back(std::make_unique<connection>(io_context, client_ctx, server_ctx));
+  }
+  io_context.run();
+  io_context.restart();
+
+  SECTION("messages sent to all subscribers") {
+    boost::wintls::broadcaster<stream_type> broadcaster;
+    for (auto& c : connections) {
+      broadcaster.subscribe(c->server);
+    }
+    broadcaster.unsubscribe(connections.back()->server);
+
+    broadcaster.publish(make_payload("Der er et "));
+    broadcaster.publish(make_payload("yndigt land"));
+    io_context.run();
+
+    for (std::size_t i = 0; i < connections.size() - 1; ++i) {
+      CHECK(connections[i]->receive(21) == "Der er et yndigt land");
+    }
+
+    const auto statistics = broadcaster.statistics();
+    CHECK(statistics.published == 2);
+    CHECK(statistics.delivered == 4);
+    CHECK(statistics.bytes_delivered == 42);
+    CHECK(statistics.dropped == 0);
+    CHECK(statistics.subscribers == 2);
+  }
+
+  SECTION("resubscribing while a message is written") {
+    boost::wintls::broadcaster<stream_type> broadcaster;
+    broadcaster.subscribe(connections.front()->server);
+
+    boost::system::error_code ec;
+    broadcaster.subscribe(connections.front()->server, ec);
+    CHECK(ec == net::error::already_started);
+
+    // Starts writing the message
+    broadcaster.publish(make_payload("message"));
+    io_context.run_one();
+
+    broadcaster.unsubscribe(connections.front()->server);
+    broadcaster.subscribe(connections.front()->server, ec);
+    CHECK(ec == net::error::already_started);
+    CHECK(broadcaster.statistics().subscribers == 0);
+
+    io_context.run();
+    io_context.restart();
+    CHECK(connections.front()->receive(7) == "message");
+
+    broadcaster.subscribe(connections.front()->server, ec);
+    CHECK_FALSE(ec);
+    broadcaster.publish(make_payload("again"));
+    io_context.run();
+    CHECK(connections.front()->receive(5) == "again");
+    CHECK(broadcaster.statistics().delivered == 2);
+  }
+
+  SECTION("slow subscribers removed") {
+    std::vector<boost::system::error_code> errors;
+    boost::wintls::broadcaster<stream_type> broadcaster(1, [&errors](stream_type&, const boost::system::error_code& ec) {
+      errors.push_back(ec);
+    });
+    broadcaster.subscribe(connections.front()->server);
+
+    // The first message is still being written when the second is
+    // queued
+    broadcaster.publish(make_payload("first"));
+    broadcaster.publish(make_payload("second"));
+    io_context.run();
+
+    CHECK(connections.front()->receive(5) == "first");
+    REQUIRE(errors.size() == 1);
+    CHECK(errors.front() == net::error::no_buffer_space);
+
+    const auto statistics = broadcaster.statistics();
+    CHECK(statistics.delivered == 1);
+    CHECK(statistics.dropped == 1);
+    CHECK(statistics.subscribers == 0);
+  }
+}
@@ -13,6 +13,7 @@
 
 #include <fstream>
 #include <iterator>
+#include <string>
 #include <vector>
 #include <cstdint>
 
@@ -37,6 +38,50 @@ bool container_exists(const std::string& name) {
   CryptReleaseContext(ptr, 0);
   return true;
 }
+
+// The location of the private key of a certificate
+struct key_location {
+  explicit key_location(const CERT_CONTEXT* cert) {
+    DWORD size = 0;
+    REQUIRE(CertGetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, nullptr, &size));
+    std::vector<BYTE> data(size);
+    REQUIRE(CertGetCertificateContextProperty(cert, CERT_KEY_PROV_INFO_PROP_ID, data.data(), &size));
+    const auto info = reinterpret_cast<const CRYPT_KEY_PROV_INFO*>(data.data());
+    container = info->pwszContainerName;
+    provider = info->pwszProvName ? info->pwszProvName : L"";
+    provider_type = info->dwProvType;
+    flags = info->dwFlags;
+  }
+
+  bool exists() const {
+    const auto provider_name = provider.empty() ? nullptr : provider.c_str();
+    if (provider_type == 0) {
+      NCRYPT_PROV_HANDLE prov = 0;
+      REQUIRE(NCryptOpenStorageProvider(&prov, provider_name, 0) == ERROR_SUCCESS);
+      NCRYPT_KEY_HANDLE key = 0;
+      const auto status = NCryptOpenKey(prov, &key, container.c_str(), 0, flags & NCRYPT_MACHINE_KEY_FLAG);
+      if (status == ERROR_SUCCESS) {
+        NCryptFreeObject(key);
+      }
+      NCryptFreeObject(prov);
+      REQUIRE((status == ERROR_SUCCESS || status == NTE_BAD_KEYSET));
+      return status == ERROR_SUCCESS;
+    }
+    HCRYPTPROV prov = 0;
+    if (!CryptAcquireContextW(&prov, container.c_str(), provider_name, provider_type,
+                              CRYPT_SILENT | (flags & CRYPT_MACHINE_KEYSET))) {
+      REQUIRE(boost::winapi::GetLastError() == static_cast<boost::winapi::DWORD_>(NTE_BAD_KEYSET));
+      return false;
+    }
+    CryptReleaseContext(prov, 0);
+    return true;
+  }
+
+  std::wstring container;
+  std::wstring provider;
+  DWORD provider_type;
+  DWORD flags;
+};
 }
 
 TEST_CASE("certificate conversion") {
@@ -46,6 +91,12 @@ TEST_CASE("certificate conversion") {
     CHECK(get_cert_name(cert.get()) == "localhost");
   }
 
+  SECTION("valid DER cert bytes") {
+    const auto cert_bytes = test_binary_file_bytes(TEST_CERTIFICATE_DER_PATH);
+    const auto cert = boost::wintls::x509_to_cert_context(net::buffer(cert_bytes), boost::wintls::file_format::asn1);
+    CHECK(get_cert_name(cert.get()) == "localhost");
+  }
+
   SECTION("invalid cert bytes") {
     const std::vector<char> cert_bytes;
     CHECK_THROWS(boost::wintls::x509_to_cert_context(net::buffer(cert_bytes), boost::wintls::file_format::pem));
@@ -72,4 +123,40 @@ TEST_CASE("import private key") {
 
   boost::wintls::delete_private_key(name, ec);
   CHECK(ec.value() == NTE_BAD_KEYSET);
+
+  boost::wintls::import_private_key(net::buffer(test_binary_file_bytes(TEST_PRIVATE_KEY_DER_PATH)), boost::wintls::file_format::asn1, name);
+  CHECK(container_exists(name));
+
+  boost::wintls::delete_private_key(name);
+  CHECK_FALSE(container_exists(name));
+}
+
+TEST_CASE("pkcs12 import") {
+  const auto pkcs12 = test_binary_file_bytes(TEST_PKCS12_PATH);
+
+  SECTION("valid password") {
+    const auto cert = boost::wintls::pkcs12_to_cert_context(net::buffer(pkcs12), TEST_PKCS12_PASSWORD);
+    CHECK(get_cert_name(cert.get()) == "localhost");
+
+    // The key is persisted so Schannel can use it for server credentials
+    const key_location key(cert.get());
+    CHECK(key.exists());
+
+    // Until deleted
+    boost::wintls::delete_private_key(cert.get());
+    CHECK_FALSE(key.exists());
+
+    // The certificate no longer has a key to delete
+    boost::system::error_code error;
+    boost::wintls::delete_private_key(cert.get(), error);
+    CHECK(error);
+  }
+
+  SECTION("invalid password") {
+    CHECK_THROWS(boost::wintls::pkcs12_to_cert_context(net::buffer(pkcs12), "not the password"));
+    auto error = boost::system::errc::make_error_code(boost::system::errc::success);
+    const auto cert = boost::wintls::pkcs12_to_cert_context(net::buffer(pkcs12), "not the password", error);
+    CHECK(error);
+    CHECK_FALSE(cert);
+  }
 }
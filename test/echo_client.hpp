@@ -10,6 +10,10 @@
 
 #include "unittest.hpp"
 
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+
 template<typename Stream>
 class echo_client : public Stream {
 public:
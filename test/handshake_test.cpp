@@ -9,6 +9,8 @@
 #include "async_echo_client.hpp"
 #include "tls_record.hpp"
 #include "unittest.hpp"
+#include "wintls_client_stream.hpp"
+#include "wintls_server_stream.hpp"
 
 #include <boost/wintls.hpp>
 
@@ -102,6 +104,29 @@ TEST_CASE("certificates") {
     CHECK_FALSE(server_error);
   }
 
+  SECTION("context modified during handshake") {
+    using namespace boost::system;
+
+    auto client_error = errc::make_error_code(errc::not_supported);
+    client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                  [&client_error, &io_context](const boost::system::error_code& ec) {
+                                    client_error = ec;
+                                    io_context.stop();
+                                  });
+
+    // Only affects handshakes started after this point
+    client_ctx.verify_server_certificate(true);
+
+    auto server_error = errc::make_error_code(errc::not_supported);
+    server_stream.async_handshake(asio_ssl::stream_base::server,
+                                  [&server_error](const boost::system::error_code& ec) {
+                                    server_error = ec;
+                                  });
+    io_context.run();
+    CHECK_FALSE(client_error);
+    CHECK_FALSE(server_error);
+  }
+
   SECTION("trusted certificate verified") {
     using namespace boost::system;
 
@@ -127,6 +152,444 @@ TEST_CASE("certificates") {
     CHECK_FALSE(client_error);
     CHECK_FALSE(server_error);
   }
+
+  SECTION("trusted certificate from bundle verified") {
+    using namespace boost::system;
+
+    client_ctx.verify_server_certificate(true);
+
+    // Enough copies of the certificate to have the bundle decoded by
+    // more than one thread
+    const auto x509 = test_cert_bytes();
+    std::string bundle = "Text outside of the PEM blocks is ignored\n";
+    for (int i = 0; i < 100; ++i) {
+      bundle.append(x509.begin(), x509.end());
+    }
+    client_ctx.add_certificate_authorities(net::buffer(bundle));
+
+    auto client_error = errc::make_error_code(errc::not_supported);
+    client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                  [&client_error, &io_context](const boost::system::error_code& ec) {
+                                    client_error = ec;
+                                    io_context.stop();
+                                  });
+
+    auto server_error = errc::make_error_code(errc::not_supported);
+    server_stream.async_handshake(asio_ssl::stream_base::server,
+                                  [&server_error](const boost::system::error_code& ec) {
+                                    server_error = ec;
+                                  });
+    io_context.run();
+    CHECK_FALSE(client_error);
+    CHECK_FALSE(server_error);
+  }
+
+  SECTION("trusted certificate from file verified") {
+    using namespace boost::system;
+
+    client_ctx.verify_server_certificate(true);
+    client_ctx.load_verify_file(TEST_CERTIFICATE_PATH);
+
+    auto client_error = errc::make_error_code(errc::not_supported);
+    client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                  [&client_error, &io_context](const boost::system::error_code& ec) {
+                                    client_error = ec;
+                                    io_context.stop();
+                                  });
+
+    auto server_error = errc::make_error_code(errc::not_supported);
+    server_stream.async_handshake(asio_ssl::stream_base::server,
+                                  [&server_error](const boost::system::error_code& ec) {
+                                    server_error = ec;
+                                  });
+    io_context.run();
+    CHECK_FALSE(client_error);
+    CHECK_FALSE(server_error);
+  }
+
+  SECTION("invalid certificate bundles") {
+    using namespace boost::system;
+
+    const std::string no_certificates = "no certificates here";
+    CHECK_THROWS(client_ctx.add_certificate_authorities(net::buffer(no_certificates)));
+
+    auto error = errc::make_error_code(errc::success);
+    client_ctx.add_certificate_authorities(net::buffer(no_certificates), error);
+    CHECK(error.value() == CRYPT_E_NOT_FOUND);
+
+    error = errc::make_error_code(errc::success);
+    client_ctx.load_verify_file("this file does not exist", error);
+    CHECK(error);
+  }
+}
+
+TEST_CASE("server certificate replaced") {
+  wintls_client_context client_ctx;
+  client_ctx.verify_server_certificate(true);
+  wintls_server_context server_ctx;
+  net::io_context io_context;
+
+  auto handshake = [&io_context](boost::wintls::stream<test_stream>& client, boost::wintls::stream<test_stream>& server) {
+    boost::system::error_code client_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    boost::system::error_code server_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    client.next_layer().connect(server.next_layer());
+    client.async_handshake(boost::wintls::handshake_type::client,
+                           [&client_error](const boost::system::error_code& ec) {
+                             client_error = ec;
+                           });
+    server.async_handshake(boost::wintls::handshake_type::server,
+                           [&server_error](const boost::system::error_code& ec) {
+                             server_error = ec;
+                           });
+    io_context.restart();
+    io_context.run();
+    CHECK_FALSE(client_error);
+    CHECK_FALSE(server_error);
+  };
+
+  // Performs a handshake with an OpenSSL client and returns the DER
+  // encoded certificate it received from the server
+  auto certificate_received = [&io_context, &server_ctx]() {
+    std::vector<unsigned char> received;
+    asio_ssl::context client_ctx(asio_ssl::context::tls_client);
+    client_ctx.set_verify_mode(asio_ssl::verify_peer);
+    client_ctx.set_verify_callback([&received](bool, asio_ssl::verify_context& ctx) {
+      if (X509_STORE_CTX_get_error_depth(ctx.native_handle()) == 0) {
+        X509* cert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
+        received.resize(static_cast<std::size_t>(i2d_X509(cert, nullptr)));
+        unsigned char* data = received.data();
+        i2d_X509(cert, &data);
+      }
+      return true;
+    });
+
+    asio_ssl::stream<test_stream> client(io_context, client_ctx);
+    boost::wintls::stream<test_stream> server(io_context, server_ctx);
+    client.next_layer().connect(server.next_layer());
+    boost::system::error_code client_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    boost::system::error_code server_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    client.async_handshake(asio_ssl::stream_base::client,
+                           [&client_error](const boost::system::error_code& ec) {
+                             client_error = ec;
+                           });
+    server.async_handshake(boost::wintls::handshake_type::server,
+                           [&server_error](const boost::system::error_code& ec) {
+                             server_error = ec;
+                           });
+    io_context.restart();
+    io_context.run();
+    CHECK_FALSE(client_error);
+    CHECK_FALSE(server_error);
+    return received;
+  };
+
+  auto encoded = [](const CERT_CONTEXT* cert) {
+    return std::vector<unsigned char>(cert->pbCertEncoded, cert->pbCertEncoded + cert->cbCertEncoded);
+  };
+
+  const auto first = boost::wintls::x509_to_cert_context(net::buffer(test_cert_bytes()), boost::wintls::file_format::pem);
+  CHECK(certificate_received() == encoded(first.get()));
+
+  boost::wintls::stream<test_stream> established_client(io_context, client_ctx);
+  boost::wintls::stream<test_stream> established_server(io_context, server_ctx);
+  handshake(established_client, established_server);
+
+  const auto pkcs12 = test_binary_file_bytes(TEST_LEAF_PKCS12_PATH);
+  const auto second = boost::wintls::pkcs12_to_cert_context(net::buffer(pkcs12), TEST_PKCS12_PASSWORD);
+  server_ctx.use_certificate(second.get());
+
+  // Handshakes use the new certificate once its credentials have been
+  // acquired in the background
+  server_ctx.warm_up();
+  CHECK(certificate_received() == encoded(second.get()));
+
+  // Streams established before the certificate was replaced keep working
+  const std::string message{"still here"};
+  net::write(established_client, net::buffer(message));
+  std::string received(message.size(), '\0');
+  net::read(established_server, net::buffer(&received[0], received.size()));
+  CHECK(received == message);
+}
+
+TEST_CASE("shared trust store") {
+  wintls_server_context server_ctx;
+  net::io_context io_context;
+
+  auto handshake = [&io_context, &server_ctx](boost::wintls::context& client_ctx) {
+    client_ctx.verify_server_certificate(true);
+    boost::wintls::stream<test_stream> client(io_context, client_ctx);
+    boost::wintls::stream<test_stream> server(io_context, server_ctx);
+    boost::system::error_code client_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    boost::system::error_code server_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    client.next_layer().connect(server.next_layer());
+    client.async_handshake(boost::wintls::handshake_type::client,
+                           [&client_error](const boost::system::error_code& ec) {
+                             client_error = ec;
+                           });
+    server.async_handshake(boost::wintls::handshake_type::server,
+                           [&server_error](const boost::system::error_code& ec) {
+                             server_error = ec;
+                           });
+    io_context.restart();
+    io_context.run();
+    return client_error;
+  };
+
+  const auto x509 = test_cert_bytes();
+  const boost::wintls::trust_store store(net::buffer(x509));
+  CHECK(store.size() == 1);
+
+  SECTION("shared by contexts") {
+    boost::wintls::context first_ctx(boost::wintls::method::system_default);
+    boost::wintls::context second_ctx(boost::wintls::method::system_default);
+    first_ctx.use_trust_store(store);
+    second_ctx.use_trust_store(store);
+    CHECK_FALSE(handshake(first_ctx));
+    CHECK_FALSE(handshake(second_ctx));
+  }
+
+  SECTION("context certificates layered on top") {
+    const boost::wintls::trust_store empty_store(std::vector<boost::wintls::cert_context_ptr>{});
+    CHECK(empty_store.size() == 0);
+
+    boost::wintls::context client_ctx(boost::wintls::method::system_default);
+    client_ctx.use_trust_store(empty_store);
+    const auto client_error = handshake(client_ctx);
+    CHECK(client_error.value() == CERT_E_UNTRUSTEDROOT);
+
+    const auto cert_ptr = x509_to_cert_context(net::buffer(x509), boost::wintls::file_format::pem);
+    client_ctx.add_certificate_authority(cert_ptr.get());
+    CHECK_FALSE(handshake(client_ctx));
+  }
+}
+
+TEST_CASE("warm up") {
+  const auto steps = boost::wintls::initialize();
+  CHECK(steps.size() == 3);
+
+  // Only the first call does any work
+  const auto again = boost::wintls::initialize();
+  REQUIRE(again.size() == steps.size());
+  CHECK(again.front().duration == steps.front().duration);
+
+  // Client credentials and the chain engine, the libraries are
+  // initialized already
+  wintls_client_context client_ctx;
+  client_ctx.verify_server_certificate(true);
+  const auto client_steps = client_ctx.warm_up();
+  REQUIRE(client_steps.size() == 2);
+  CHECK(std::string(client_steps.front().name) == "AcquireCredentialsHandleW (client)");
+
+  // Server credentials and the chain engine
+  wintls_server_context server_ctx;
+  const auto server_steps = server_ctx.warm_up();
+  REQUIRE(server_steps.size() == 2);
+  CHECK(std::string(server_steps.front().name) == "AcquireCredentialsHandleW (server)");
+
+  net::io_context io_context;
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  boost::system::error_code client_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_error](const boost::system::error_code& ec) {
+                                  client_error = ec;
+                                });
+
+  boost::system::error_code server_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_error](const boost::system::error_code& ec) {
+                                  server_error = ec;
+                                });
+  io_context.run();
+  CHECK_FALSE(client_error);
+  CHECK_FALSE(server_error);
+}
+
+TEST_CASE("server certificate from pkcs12") {
+  using namespace boost::system;
+
+  wintls_client_context client_ctx;
+  client_ctx.verify_server_certificate(true);
+
+  // No private key to import or assign as it comes with the certificate
+  boost::wintls::context server_ctx(boost::wintls::method::system_default);
+  const auto pkcs12 = test_binary_file_bytes(TEST_PKCS12_PATH);
+  const auto certificate = boost::wintls::pkcs12_to_cert_context(net::buffer(pkcs12), TEST_PKCS12_PASSWORD);
+  server_ctx.use_certificate(certificate.get());
+
+  net::io_context io_context;
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  auto client_error = errc::make_error_code(errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_error](const boost::system::error_code& ec) {
+                                  client_error = ec;
+                                });
+
+  auto server_error = errc::make_error_code(errc::not_supported);
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_error](const boost::system::error_code& ec) {
+                                  server_error = ec;
+                                });
+  io_context.run();
+  CHECK_FALSE(client_error);
+  CHECK_FALSE(server_error);
+}
+
+TEST_CASE("client certificates") {
+  using namespace boost::system;
+
+  const auto certificate = boost::wintls::x509_to_cert_context(net::buffer(test_cert_bytes()), boost::wintls::file_format::pem);
+  boost::wintls::assign_private_key(certificate.get(), TEST_PRIVATE_KEY_NAME);
+
+  wintls_client_context client_ctx;
+  client_ctx.verify_server_certificate(true);
+  net::io_context io_context;
+
+  SECTION("verified by wintls server") {
+    wintls_server_context server_ctx;
+    server_ctx.verify_client_certificate(true);
+    server_ctx.add_certificate_authority(certificate.get());
+
+    boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+    boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+    client_stream.next_layer().connect(server_stream.next_layer());
+
+    SECTION("certificate presented") {
+      client_ctx.use_client_certificate(certificate.get());
+      auto client_error = errc::make_error_code(errc::not_supported);
+      client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                    [&client_error](const boost::system::error_code& ec) {
+                                      client_error = ec;
+                                    });
+
+      auto server_error = errc::make_error_code(errc::not_supported);
+      server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                    [&server_error](const boost::system::error_code& ec) {
+                                      server_error = ec;
+                                    });
+      io_context.run();
+      CHECK_FALSE(client_error);
+      CHECK_FALSE(server_error);
+    }
+
+    SECTION("no certificate presented") {
+      client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                    [](const boost::system::error_code&) {
+                                    });
+
+      auto server_error = errc::make_error_code(errc::success);
+      server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                    [&server_error, &client_stream](const boost::system::error_code& ec) {
+                                      server_error = ec;
+                                      client_stream.next_layer().close();
+                                    });
+      io_context.run();
+      CHECK(server_error);
+    }
+  }
+
+  SECTION("requested by openssl server") {
+    client_ctx.use_client_certificate(certificate.get());
+
+    asio_ssl::context server_ctx(asio_ssl::context::tls_server);
+    server_ctx.use_certificate_chain_file(TEST_CERTIFICATE_PATH);
+    server_ctx.use_private_key_file(TEST_PRIVATE_KEY_PATH, asio_ssl::context::pem);
+    server_ctx.load_verify_file(TEST_CERTIFICATE_PATH);
+    server_ctx.set_verify_mode(asio_ssl::verify_peer | asio_ssl::verify_fail_if_no_peer_cert);
+
+    boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+    asio_ssl::stream<test_stream> server_stream(io_context, server_ctx);
+    client_stream.next_layer().connect(server_stream.next_layer());
+
+    auto client_error = errc::make_error_code(errc::not_supported);
+    client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                  [&client_error](const boost::system::error_code& ec) {
+                                    client_error = ec;
+                                  });
+
+    auto server_error = errc::make_error_code(errc::not_supported);
+    server_stream.async_handshake(asio_ssl::stream_base::server,
+                                  [&server_error](const boost::system::error_code& ec) {
+                                    server_error = ec;
+                                  });
+    io_context.run();
+    CHECK_FALSE(client_error);
+    CHECK_FALSE(server_error);
+  }
+}
+
+TEST_CASE("server certificate chain") {
+  // TLS 1.2 is used as the certificates are encrypted in TLS 1.3
+  boost::wintls::context server_ctx(boost::wintls::method::tlsv12);
+  const auto pkcs12 = test_binary_file_bytes(TEST_LEAF_PKCS12_PATH);
+  const auto leaf = boost::wintls::pkcs12_to_cert_context(net::buffer(pkcs12), TEST_PKCS12_PASSWORD);
+  const auto intermediate_pem = test_binary_file_bytes(TEST_INTERMEDIATE_CERTIFICATE_PATH);
+  const auto intermediate = boost::wintls::x509_to_cert_context(net::buffer(intermediate_pem), boost::wintls::file_format::pem);
+
+  // Passes the client_hello on to the server and returns the number
+  // of certificates in the certificate message the server replies with
+  auto certificates_sent = [&server_ctx]() -> std::size_t {
+    boost::wintls::context client_ctx(boost::wintls::method::tlsv12);
+    net::io_context io_context;
+    boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+    boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+    test_stream client_peer(io_context);
+    test_stream server_peer(io_context);
+    client_stream.next_layer().connect(client_peer);
+    server_stream.next_layer().connect(server_peer);
+
+    client_stream.async_handshake(boost::wintls::handshake_type::client, [](const boost::system::error_code&) {});
+    server_stream.async_handshake(boost::wintls::handshake_type::server, [](const boost::system::error_code&) {});
+
+    std::array<char, 16384> buffer;
+    std::vector<char> flight;
+    client_peer.async_read_some(net::buffer(buffer), [&](const boost::system::error_code& ec, std::size_t length) {
+      REQUIRE_FALSE(ec);
+      net::write(server_peer, net::buffer(buffer, length));
+      server_peer.async_read_some(net::buffer(buffer), [&](const boost::system::error_code& ec, std::size_t length) {
+        REQUIRE_FALSE(ec);
+        flight.assign(buffer.data(), buffer.data() + length);
+        io_context.stop();
+      });
+    });
+    io_context.run();
+
+    std::vector<char> messages;
+    auto records = net::buffer(flight);
+    while (records.size() > 0) {
+      tls_record rec(records);
+      REQUIRE(rec.type == tls_record::record_type::handshake);
+      const auto payload = reinterpret_cast<const char*>(records.data()) + 5;
+      messages.insert(messages.end(), payload, payload + rec.size);
+      records += 5 + rec.size;
+    }
+
+    auto data = net::buffer(messages);
+    while (data.size() > 0) {
+      tls_handshake handshake(data);
+      if (handshake.type == tls_handshake::handshake_type::certificate) {
+        return boost::get<tls_handshake::certificate>(handshake.message).certificate_list.size();
+      }
+      data += 4 + handshake.size;
+    }
+    FAIL("No certificate message sent");
+    return 0;
+  };
+
+  SECTION("certificate only") {
+    server_ctx.use_certificate(leaf.get());
+    CHECK(certificates_sent() == 1);
+  }
+
+  SECTION("certificate with intermediate") {
+    server_ctx.use_certificate_chain(leaf.get(), {intermediate.get()});
+    CHECK(certificates_sent() == 2);
+  }
 }
 
 TEST_CASE("failing handshakes") {
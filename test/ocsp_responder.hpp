@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#ifndef OCSP_RESPONDER_HPP
+#define OCSP_RESPONDER_HPP
+
+#include "unittest.hpp"
+
+#include <openssl/ocsp.h>
+#include <openssl/pem.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Stand-in for an OCSP responder. The responses are signed by the
+// issuer of the certificate, which by default is the self signed test
+// certificate itself.
+class ocsp_responder {
+public:
+  ocsp_responder()
+    : ocsp_responder(TEST_CERTIFICATE_PATH, TEST_CERTIFICATE_PATH, TEST_PRIVATE_KEY_PATH) {
+  }
+
+  ocsp_responder(const char* cert_path, const char* issuer_path, const char* issuer_key_path)
+    : cert_(load<X509>(cert_path, &PEM_read_bio_X509), &X509_free)
+    , issuer_(load<X509>(issuer_path, &PEM_read_bio_X509), &X509_free)
+    , key_(load<EVP_PKEY>(issuer_key_path, &PEM_read_bio_PrivateKey), &EVP_PKEY_free) {
+    REQUIRE(cert_);
+    REQUIRE(issuer_);
+    REQUIRE(key_);
+  }
+
+  std::vector<std::uint8_t> response(std::chrono::seconds validity, int status = V_OCSP_CERTSTATUS_GOOD) {
+    ++requests;
+
+    std::unique_ptr<OCSP_BASICRESP, decltype(&OCSP_BASICRESP_free)> basic{OCSP_BASICRESP_new(), &OCSP_BASICRESP_free};
+    std::unique_ptr<ASN1_TIME, decltype(&ASN1_TIME_free)> this_update{X509_gmtime_adj(nullptr, 0), &ASN1_TIME_free};
+    std::unique_ptr<ASN1_TIME, decltype(&ASN1_TIME_free)> next_update{X509_gmtime_adj(nullptr, static_cast<long>(validity.count())), &ASN1_TIME_free};
+    std::unique_ptr<OCSP_CERTID, decltype(&OCSP_CERTID_free)> id{OCSP_cert_to_id(nullptr, cert_.get(), issuer_.get()), &OCSP_CERTID_free};
+    REQUIRE(OCSP_basic_add1_status(basic.get(), id.get(), status, OCSP_REVOKED_STATUS_NOSTATUS,
+                                   status == V_OCSP_CERTSTATUS_REVOKED ? this_update.get() : nullptr,
+                                   this_update.get(), next_update.get()) != nullptr);
+    REQUIRE(OCSP_basic_sign(basic.get(), issuer_.get(), key_.get(), EVP_sha256(), nullptr, 0) == 1);
+
+    std::unique_ptr<OCSP_RESPONSE, decltype(&OCSP_RESPONSE_free)> resp{
+      OCSP_response_create(OCSP_RESPONSE_STATUS_SUCCESSFUL, basic.get()), &OCSP_RESPONSE_free};
+    REQUIRE(resp);
+
+    const auto size = i2d_OCSP_RESPONSE(resp.get(), nullptr);
+    REQUIRE(size > 0);
+    std::vector<std::uint8_t> der(static_cast<std::size_t>(size));
+    auto out = der.data();
+    i2d_OCSP_RESPONSE(resp.get(), &out);
+    return der;
+  }
+
+  int requests = 0;
+
+private:
+  template <class T, class Reader>
+  static T* load(const char* path, Reader reader) {
+    std::unique_ptr<BIO, decltype(&BIO_free)> bio{BIO_new_file(path, "r"), &BIO_free};
+    return bio ? reader(bio.get(), nullptr, nullptr, nullptr) : nullptr;
+  }
+
+  std::unique_ptr<X509, decltype(&X509_free)> cert_;
+  std::unique_ptr<X509, decltype(&X509_free)> issuer_;
+  std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key_;
+};
+
+#endif // OCSP_RESPONDER_HPP
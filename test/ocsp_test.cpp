@@ -0,0 +1,212 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "asio_ssl_client_stream.hpp"
+#include "ocsp_responder.hpp"
+#include "unittest.hpp"
+#include "wintls_client_stream.hpp"
+#include "wintls_server_stream.hpp"
+
+#include <boost/wintls.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Performs a handshake with an OpenSSL client requesting a stapled
+// OCSP response and returns the response received, if any.
+std::vector<std::uint8_t> stapled_response(boost::wintls::context& server_ctx) {
+  net::io_context io_context;
+  asio_ssl_client_context client_ctx;
+  asio_ssl::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+  SSL_set_tlsext_status_type(client_stream.native_handle(), TLSEXT_STATUSTYPE_ocsp);
+
+  boost::system::error_code client_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(asio_ssl::stream_base::client,
+                                [&client_error](const boost::system::error_code& ec) {
+                                  client_error = ec;
+                                });
+
+  boost::system::error_code server_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_error](const boost::system::error_code& ec) {
+                                  server_error = ec;
+                                });
+  io_context.run();
+  REQUIRE_FALSE(client_error);
+  REQUIRE_FALSE(server_error);
+
+  const unsigned char* data = nullptr;
+  const auto size = SSL_get_tlsext_status_ocsp_resp(client_stream.native_handle(), &data);
+  if (data == nullptr || size <= 0) {
+    return {};
+  }
+  return {data, data + size};
+}
+
+// Uses the leaf certificate issued by the test intermediate CA
+void use_leaf_certificate(boost::wintls::context& server_ctx) {
+  const auto pkcs12 = test_binary_file_bytes(TEST_LEAF_PKCS12_PATH);
+  const auto leaf = boost::wintls::pkcs12_to_cert_context(net::buffer(pkcs12), TEST_PKCS12_PASSWORD);
+  const auto intermediate_pem = test_binary_file_bytes(TEST_INTERMEDIATE_CERTIFICATE_PATH);
+  const auto intermediate = boost::wintls::x509_to_cert_context(net::buffer(intermediate_pem), boost::wintls::file_format::pem);
+  server_ctx.use_certificate_chain(leaf.get(), {intermediate.get()});
+}
+
+// Staples the response given as argument to the handshake of an
+// OpenSSL server, which unlike Boost.Wintls staples any response.
+int staple_response(SSL* ssl, void* arg) {
+  const auto& response = *static_cast<const std::vector<std::uint8_t>*>(arg);
+  auto data = static_cast<unsigned char*>(OPENSSL_malloc(response.size()));
+  std::copy(response.begin(), response.end(), data);
+  SSL_set_tlsext_status_ocsp_resp(ssl, data, static_cast<long>(response.size()));
+  return SSL_TLSEXT_ERR_OK;
+}
+
+// Performs a handshake with a client trusting the test CA only and
+// checking the revocation status of the server certificate, and
+// returns the error of the client.
+template <class ServerStream, class HandshakeType>
+boost::system::error_code revocation_checked_handshake(net::io_context& io_context,
+                                                       ServerStream& server_stream,
+                                                       HandshakeType server_handshake_type) {
+  // TLS 1.2 is used as OpenSSL staples the response differently in TLS 1.3
+  boost::wintls::context client_ctx(boost::wintls::method::tlsv12_client);
+  const auto ca_pem = test_binary_file_bytes(TEST_CA_CERTIFICATE_PATH);
+  const auto ca = boost::wintls::x509_to_cert_context(net::buffer(ca_pem), boost::wintls::file_format::pem);
+  client_ctx.add_certificate_authority(ca.get());
+  client_ctx.verify_server_certificate(true);
+  client_ctx.check_certificate_revocation(true);
+
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  boost::system::error_code client_error = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_error](const boost::system::error_code& ec) {
+                                  client_error = ec;
+                                });
+  server_stream.async_handshake(server_handshake_type, [](const boost::system::error_code&) {});
+  io_context.run();
+  return client_error;
+}
+
+}
+
+TEST_CASE("ocsp stapling") {
+  wintls_server_context server_ctx;
+  ocsp_responder responder;
+
+  SECTION("response stapled") {
+    const auto response = responder.response(std::chrono::hours{24});
+    server_ctx.use_ocsp_response(net::buffer(response));
+    CHECK(stapled_response(server_ctx) == response);
+  }
+
+  SECTION("invalid responses") {
+    boost::system::error_code ec;
+
+    const std::vector<std::uint8_t> garbage(64, 0x42);
+    server_ctx.use_ocsp_response(net::buffer(garbage), ec);
+    CHECK(ec);
+
+    const auto revoked = responder.response(std::chrono::hours{24}, V_OCSP_CERTSTATUS_REVOKED);
+    server_ctx.use_ocsp_response(net::buffer(revoked), ec);
+    CHECK(ec.value() == CRYPT_E_REVOKED);
+
+    boost::wintls::context no_certificate_ctx(boost::wintls::method::system_default);
+    const auto response = responder.response(std::chrono::hours{24});
+    no_certificate_ctx.use_ocsp_response(net::buffer(response), ec);
+    CHECK(ec.value() == SEC_E_NO_CREDENTIALS);
+
+    // Nothing is stapled after failing to set a response
+    CHECK(stapled_response(server_ctx).empty());
+  }
+}
+
+TEST_CASE("stapled response used for revocation checking") {
+  // The leaf certificate is issued by the test intermediate CA and has
+  // neither an OCSP responder nor a CRL distribution point, so its
+  // revocation status is only known from the stapled response
+  ocsp_responder responder(TEST_LEAF_CERTIFICATE_PATH, TEST_INTERMEDIATE_CERTIFICATE_PATH, TEST_INTERMEDIATE_PRIVATE_KEY_PATH);
+  net::io_context io_context;
+
+  SECTION("good") {
+    boost::wintls::context server_ctx(boost::wintls::method::tlsv12_server);
+    use_leaf_certificate(server_ctx);
+    const auto response = responder.response(std::chrono::hours{24});
+    server_ctx.use_ocsp_response(net::buffer(response));
+
+    boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+    CHECK_FALSE(revocation_checked_handshake(io_context, server_stream, boost::wintls::handshake_type::server));
+  }
+
+  SECTION("revoked") {
+    const auto response = responder.response(std::chrono::hours{24}, V_OCSP_CERTSTATUS_REVOKED);
+
+    asio_ssl::context server_ctx(asio_ssl::context_base::tls_server);
+    server_ctx.use_certificate_file(TEST_LEAF_CERTIFICATE_PATH, asio_ssl::context_base::pem);
+    server_ctx.use_private_key_file(TEST_LEAF_PRIVATE_KEY_PATH, asio_ssl::context_base::pem);
+    const auto intermediate_pem = test_binary_file_bytes(TEST_INTERMEDIATE_CERTIFICATE_PATH);
+    std::unique_ptr<BIO, decltype(&BIO_free)> bio{BIO_new_mem_buf(intermediate_pem.data(), static_cast<int>(intermediate_pem.size())), &BIO_free};
+    std::unique_ptr<X509, decltype(&X509_free)> intermediate{PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr), &X509_free};
+    REQUIRE(intermediate);
+    REQUIRE(SSL_CTX_add1_chain_cert(server_ctx.native_handle(), intermediate.get()) == 1);
+    SSL_CTX_set_tlsext_status_cb(server_ctx.native_handle(), &staple_response);
+    SSL_CTX_set_tlsext_status_arg(server_ctx.native_handle(), const_cast<std::vector<std::uint8_t>*>(&response));
+
+    asio_ssl::stream<test_stream> server_stream(io_context, server_ctx);
+    CHECK(revocation_checked_handshake(io_context, server_stream, asio_ssl::stream_base::server).value() == CRYPT_E_REVOKED);
+  }
+
+  SECTION("not stapled") {
+    boost::wintls::context server_ctx(boost::wintls::method::tlsv12_server);
+    use_leaf_certificate(server_ctx);
+
+    boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+    CHECK(revocation_checked_handshake(io_context, server_stream, boost::wintls::handshake_type::server));
+  }
+}
+
+TEST_CASE("ocsp stapler") {
+  wintls_server_context server_ctx;
+  ocsp_responder responder;
+  net::io_context io_context;
+
+  std::vector<std::uint8_t> provided;
+  boost::wintls::ocsp_stapler stapler(io_context, server_ctx, [&responder, &provided](const CERT_CONTEXT* cert) {
+    REQUIRE(cert != nullptr);
+    provided = responder.response(std::chrono::hours{2});
+    return provided;
+  });
+
+  const auto before = std::chrono::system_clock::now();
+  stapler.refresh();
+  CHECK(responder.requests == 1);
+  CHECK(stapler.next_update() > before + std::chrono::minutes{119});
+  CHECK(stapler.next_update() < before + std::chrono::minutes{121});
+  CHECK(stapled_response(server_ctx) == provided);
+
+  // The next refresh is scheduled for an hour from now
+  io_context.run_for(std::chrono::milliseconds{100});
+  CHECK(responder.requests == 1);
+
+  stapler.stop();
+  io_context.run();
+  CHECK(responder.requests == 1);
+}
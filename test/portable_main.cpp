@@ -0,0 +1,11 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Runner for the tests not depending on Schannel, which do not need
+// the private test key imported
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "unittest.hpp"
+
+#include <boost/wintls/detail/read_ahead.hpp>
+
+TEST_CASE("read ahead") {
+  using boost::wintls::detail::read_ahead;
+  constexpr std::size_t max_size = 0x10000;
+  const std::size_t min_size = read_ahead::min_size;
+  const std::size_t initial_size = read_ahead::initial_size;
+
+  read_ahead policy;
+  CHECK(policy.size() == initial_size);
+
+  SECTION("limited by available space and missing data") {
+    CHECK(policy.next(max_size, 0) == initial_size);
+    CHECK(policy.next(max_size, 0x4005) == 0x4005);
+    CHECK(policy.next(0x800, 0x4005) == 0x800);
+  }
+
+  SECTION("bulk traffic") {
+    for (int i = 0; i < 8; ++i) {
+      const auto offered = policy.next(max_size, 0);
+      policy.update(offered, offered, 0, max_size);
+    }
+    CHECK(policy.size() == max_size);
+  }
+
+  SECTION("interactive traffic") {
+    for (int i = 0; i < 64; ++i) {
+      const auto offered = policy.next(max_size, 0);
+      policy.update(offered, 100, 0, max_size);
+    }
+    CHECK(policy.size() == min_size);
+
+    // Grows again as soon as the traffic changes
+    const auto offered = policy.next(max_size, 0);
+    policy.update(offered, offered, 0, max_size);
+    CHECK(policy.size() == 2 * min_size);
+  }
+
+  SECTION("remainder of a record") {
+    const std::size_t missing = 0x4005;
+    const auto offered = policy.next(max_size, missing);
+    REQUIRE(offered == missing);
+    policy.update(offered, offered, missing, max_size);
+    CHECK(policy.size() == initial_size);
+  }
+}
@@ -0,0 +1,119 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "unittest.hpp"
+#include "wintls_client_stream.hpp"
+#include "wintls_server_stream.hpp"
+
+#include <boost/wintls.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/read.hpp>
+
+#include <array>
+#include <string>
+
+namespace {
+
+using stream_type = boost::wintls::stream<test_stream>;
+
+void handshake(stream_type& client, stream_type& server) {
+  client.next_layer().connect(server.next_layer());
+  client.async_handshake(boost::wintls::handshake_type::client, [](const boost::system::error_code& ec) {
+    REQUIRE_FALSE(ec);
+  });
+  server.async_handshake(boost::wintls::handshake_type::server, [](const boost::system::error_code& ec) {
+    REQUIRE_FALSE(ec);
+  });
+}
+
+void run_ready(net::io_context& io_context) {
+  while (io_context.poll() > 0) {
+  }
+}
+
+}
+
+TEST_CASE("relay") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+
+  // user <-> proxy_front | relay | proxy_back <-> backend
+  stream_type user(io_context, client_ctx);
+  stream_type proxy_front(io_context, server_ctx);
+  stream_type proxy_back(io_context, client_ctx);
+  stream_type backend(io_context, server_ctx);
+  handshake(user, proxy_front);
+  handshake(proxy_back, backend);
+  io_context.run();
+  io_context.restart();
+
+  boost::system::error_code relay_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::wintls::relay_statistics statistics;
+  bool relay_done = false;
+  boost::wintls::async_relay(proxy_front, proxy_back, [&](const boost::system::error_code& ec, boost::wintls::relay_statistics s) {
+    relay_ec = ec;
+    statistics = s;
+    relay_done = true;
+  });
+
+  const std::string request{"GET / HTTP/1.1\r\n\r\n"};
+  const std::string response{"HTTP/1.1 204 No Content\r\n\r\n"};
+  std::string received_request(request.size(), '\0');
+  std::string received_response(response.size(), '\0');
+
+  net::write(user, net::buffer(request));
+  net::async_read(backend, net::buffer(&received_request[0], received_request.size()),
+                  [](const boost::system::error_code& ec, std::size_t) {
+                    REQUIRE_FALSE(ec);
+                  });
+  run_ready(io_context);
+  CHECK(received_request == request);
+
+  net::write(backend, net::buffer(response));
+  net::async_read(user, net::buffer(&received_response[0], received_response.size()),
+                  [](const boost::system::error_code& ec, std::size_t) {
+                    REQUIRE_FALSE(ec);
+                  });
+  run_ready(io_context);
+  CHECK(received_response == response);
+
+  // The backend closing its side is passed on to the user after the
+  // rest of its data, while the other direction stays open
+  net::write(backend, net::buffer(response));
+  backend.shutdown();
+  std::string last_response(response.size(), '\0');
+  std::array<char, 16> buffer{};
+  boost::system::error_code user_ec;
+  net::async_read(user, net::buffer(&last_response[0], last_response.size()),
+                  [&user, &user_ec, &buffer](const boost::system::error_code& ec, std::size_t) {
+                    REQUIRE_FALSE(ec);
+                    user.async_read_some(net::buffer(buffer), [&user_ec](const boost::system::error_code& error, std::size_t) {
+                      user_ec = error;
+                    });
+                  });
+  run_ready(io_context);
+  CHECK(last_response == response);
+  CHECK(user_ec == net::error::eof);
+  CHECK_FALSE(relay_done);
+
+  boost::system::error_code backend_ec;
+  user.shutdown();
+  backend.async_read_some(net::buffer(buffer), [&backend_ec](const boost::system::error_code& ec, std::size_t) {
+    backend_ec = ec;
+  });
+  run_ready(io_context);
+  CHECK(backend_ec == net::error::eof);
+
+  REQUIRE(relay_done);
+  CHECK_FALSE(relay_ec);
+  CHECK(statistics.a_to_b.bytes == request.size());
+  CHECK(statistics.a_to_b.records == 1);
+  CHECK(statistics.b_to_a.bytes == 2 * response.size());
+  CHECK(statistics.b_to_a.records == 2);
+}
@@ -20,8 +20,10 @@
 #include <boost/asio/io_context.hpp>
 
 #include <array>
+#include <memory>
 #include <thread>
 #include <string>
+#include <vector>
 
 class test_server : public async_echo_server<asio_ssl_server_stream> {
 public:
@@ -253,3 +255,655 @@ TEST_CASE("small reads") {
     CHECK(client.data<std::string>() == test_data);
   }
 }
+
+TEST_CASE("shutdown modes") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_ec](const boost::system::error_code& ec) {
+                                  client_ec = ec;
+                                });
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_ec](const boost::system::error_code& ec) {
+                                  server_ec = ec;
+                                });
+  io_context.run();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+  io_context.restart();
+
+  std::array<char, 32> buffer{};
+
+  SECTION("close_notify read as end of file") {
+    client_stream.shutdown();
+    server_stream.read_some(net::buffer(buffer), server_ec);
+    CHECK(server_ec == net::error::eof);
+
+    // Still end of file after the buffers have been released
+    server_stream.read_some(net::buffer(buffer), server_ec);
+    CHECK(server_ec == net::error::eof);
+  }
+
+  SECTION("session released once both sides have closed") {
+    net::write(server_stream, net::buffer(std::string{"goodbye"}));
+    CHECK(server_stream.record_payload_size() > 0);
+
+    client_stream.shutdown();
+    server_stream.read_some(net::buffer(buffer), server_ec);
+    CHECK(server_ec == net::error::eof);
+
+    // Still needed for sending a close_notify in return
+    CHECK(server_stream.record_payload_size() > 0);
+    server_stream.shutdown();
+    CHECK(server_stream.record_payload_size() == 0);
+
+    // The client shut down first and is done once it has read the
+    // close_notify from the server
+    CHECK(client_stream.read_some(net::buffer(buffer)) == 7);
+    client_stream.read_some(net::buffer(buffer), client_ec);
+    CHECK(client_ec == net::error::eof);
+    CHECK(client_stream.record_payload_size() == 0);
+
+    // No buffers are left
+    CHECK(client_stream.buffer_memory() == 0);
+    CHECK(server_stream.buffer_memory() == 0);
+  }
+
+  SECTION("bidirectional") {
+    client_stream.async_shutdown(boost::wintls::shutdown_mode::bidirectional,
+                                 std::chrono::seconds{10},
+                                 [&client_ec](const boost::system::error_code& ec) {
+                                   client_ec = ec;
+                                 });
+    server_stream.async_read_some(net::buffer(buffer),
+                                  [&server_ec, &server_stream](const boost::system::error_code& ec, std::size_t) {
+                                    server_ec = ec;
+                                    server_stream.async_shutdown([](const boost::system::error_code& ec) {
+                                      CHECK_FALSE(ec);
+                                    });
+                                  });
+    io_context.run();
+    CHECK(server_ec == net::error::eof);
+    CHECK_FALSE(client_ec);
+  }
+
+  SECTION("bidirectional timeout") {
+    client_stream.async_shutdown(boost::wintls::shutdown_mode::bidirectional,
+                                 std::chrono::milliseconds{50},
+                                 [&client_ec](const boost::system::error_code& ec) {
+                                   client_ec = ec;
+                                 });
+    io_context.run();
+    CHECK(client_ec == net::error::timed_out);
+  }
+
+  SECTION("fast") {
+    const auto writes = client_stream.next_layer().nwrite();
+    client_stream.shutdown(boost::wintls::shutdown_mode::fast, client_ec);
+    CHECK_FALSE(client_ec);
+
+    // Nothing is sent to the peer and the security context is gone
+    CHECK(client_stream.next_layer().nwrite() == writes);
+    net::write(client_stream, net::buffer(buffer), client_ec);
+    CHECK(client_ec);
+  }
+}
+
+TEST_CASE("buffer pool") {
+  using storage_pool = boost::wintls::detail::sspi_decrypt::storage_pool;
+
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  client_ctx.use_buffer_pool(true);
+  server_ctx.use_buffer_pool(true);
+
+  net::ip::tcp::acceptor acceptor(io_context, net::ip::tcp::endpoint(net::ip::address_v4::loopback(), 0));
+  boost::wintls::stream<net::ip::tcp::socket> client_stream(io_context, client_ctx);
+  boost::wintls::stream<net::ip::tcp::socket> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(acceptor.local_endpoint());
+  acceptor.accept(server_stream.next_layer());
+
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_ec](const boost::system::error_code& ec) {
+                                  client_ec = ec;
+                                });
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_ec](const boost::system::error_code& ec) {
+                                  server_ec = ec;
+                                });
+  io_context.run();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+  io_context.restart();
+
+  const auto outstanding = storage_pool::instance().outstanding();
+  std::array<char, 4> received{};
+  std::size_t size_received = 0;
+  server_stream.async_read_some(net::buffer(received),
+                                [&server_ec, &size_received](const boost::system::error_code& ec, std::size_t size) {
+                                  server_ec = ec;
+                                  size_received = size;
+                                });
+
+  // No buffer is held while waiting for data
+  io_context.poll();
+  CHECK(storage_pool::instance().outstanding() == outstanding);
+
+  const std::string message{"Der er et yndigt land"};
+  net::write(client_stream, net::buffer(message));
+  io_context.run();
+  REQUIRE_FALSE(server_ec);
+  CHECK(std::string(received.data(), size_received) == message.substr(0, size_received));
+
+  // The buffer is kept until the rest of the data has been read
+  CHECK(storage_pool::instance().outstanding() == outstanding + 1);
+  std::string rest(message.size() - size_received, '\0');
+  net::read(server_stream, net::buffer(&rest[0], rest.size()));
+  CHECK(rest == message.substr(size_received));
+  CHECK(storage_pool::instance().outstanding() == outstanding);
+
+  const auto statistics = server_stream.statistics();
+  CHECK(statistics.records == 1);
+  CHECK(statistics.bytes_read > message.size());
+  CHECK(statistics.read_size > 0);
+}
+
+TEST_CASE("buffer pool with stream destroyed") {
+  using storage_pool = boost::wintls::detail::sspi_decrypt::storage_pool;
+
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  server_ctx.use_buffer_pool(true);
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  auto server_stream = std::make_unique<boost::wintls::stream<test_stream>>(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream->next_layer());
+
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_ec](const boost::system::error_code& ec) {
+                                  client_ec = ec;
+                                });
+  server_stream->async_handshake(boost::wintls::handshake_type::server,
+                                 [&server_ec](const boost::system::error_code& ec) {
+                                   server_ec = ec;
+                                 });
+  io_context.run();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+
+  const auto outstanding = storage_pool::instance().outstanding();
+  net::write(client_stream, net::buffer(std::string{"Der er et yndigt land"}));
+  std::array<char, 4> received{};
+  net::read(*server_stream, net::buffer(received));
+  CHECK(storage_pool::instance().outstanding() == outstanding + 1);
+
+  // The buffer holding the rest of the data is returned to the pool
+  // with the stream
+  server_stream.reset();
+  CHECK(storage_pool::instance().outstanding() == outstanding);
+}
+
+TEST_CASE("memory held by streams") {
+  using input_pool = boost::wintls::detail::sspi_handshake::input_pool;
+
+  const auto pooled = GENERATE(false, true);
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  client_ctx.use_buffer_pool(pooled);
+  server_ctx.use_buffer_pool(pooled);
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+  CHECK(client_stream.buffer_memory() == 0);
+
+  const auto outstanding = input_pool::instance().outstanding();
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_ec](const boost::system::error_code& ec) {
+                                  client_ec = ec;
+                                });
+
+  // The client holds a buffer for the reply from the server while
+  // waiting for it
+  io_context.poll();
+  CHECK(client_stream.buffer_memory() >= 0x10000);
+  CHECK(input_pool::instance().outstanding() == (pooled ? outstanding + 1 : outstanding));
+
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_ec](const boost::system::error_code& ec) {
+                                  server_ec = ec;
+                                });
+  io_context.run();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+
+  // Nothing is held once the handshake is done
+  CHECK(client_stream.buffer_memory() == 0);
+  CHECK(server_stream.buffer_memory() == 0);
+  CHECK(input_pool::instance().outstanding() == outstanding);
+
+  // Only the buffers needed for the data sent and received
+  net::write(client_stream, net::buffer(std::string{"Der er et yndigt land"}));
+  CHECK(client_stream.buffer_memory() > 0);
+  std::array<char, 21> received{};
+  net::read(server_stream, net::buffer(received));
+  if (pooled) {
+    CHECK(server_stream.buffer_memory() == 0);
+  } else {
+    CHECK(server_stream.buffer_memory() > 0);
+  }
+}
+
+TEST_CASE("record buffers") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_ec](const boost::system::error_code& ec) {
+                                  client_ec = ec;
+                                });
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_ec](const boost::system::error_code& ec) {
+                                  server_ec = ec;
+                                });
+  io_context.run();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+  io_context.restart();
+
+  auto to_string = [](const boost::wintls::record_buffer& record) {
+    return std::string(static_cast<const char*>(record.data().data()), record.size());
+  };
+
+  SECTION("records kept across reads") {
+    net::write(client_stream, net::buffer(std::string{"first"}));
+    net::write(client_stream, net::buffer(std::string{"second"}));
+
+    const auto first = server_stream.read_record();
+    const auto second = server_stream.read_record();
+    CHECK(to_string(first) == "first");
+    CHECK(to_string(second) == "second");
+
+    net::write(client_stream, net::buffer(std::string{"third"}));
+    boost::wintls::record_buffer third;
+    server_stream.async_read_record([&server_ec, &third](const boost::system::error_code& ec, boost::wintls::record_buffer record) {
+      server_ec = ec;
+      third = std::move(record);
+    });
+    io_context.run();
+    CHECK_FALSE(server_ec);
+    CHECK(to_string(third) == "third");
+    CHECK(to_string(first) == "first");
+  }
+
+  SECTION("records share the buffer they were received in") {
+    net::write(client_stream, net::buffer(std::string{"first"}));
+    net::write(client_stream, net::buffer(std::string{"second"}));
+
+    // The records are decrypted one after another in the same buffer
+    const auto first = server_stream.read_record();
+    const auto second = server_stream.read_record();
+    const auto first_data = static_cast<const char*>(first.data().data());
+    const auto second_data = static_cast<const char*>(second.data().data());
+    CHECK(second_data > first_data);
+    CHECK(second_data - first_data < 0x10000);
+  }
+
+  SECTION("many records kept") {
+    // More than fits in one buffer, so the data not decrypted yet is
+    // moved away from the records still referred to
+    std::vector<std::string> messages;
+    for (int i = 0; i < 64; ++i) {
+      messages.push_back(std::string(0x1000, static_cast<char>('a' + i % 26)));
+      net::write(client_stream, net::buffer(messages.back()));
+    }
+
+    std::vector<boost::wintls::record_buffer> records;
+    std::size_t size = 0;
+    while (size < messages.size() * 0x1000) {
+      records.push_back(server_stream.read_record());
+      size += records.back().size();
+    }
+    std::string received;
+    for (const auto& record : records) {
+      received += to_string(record);
+    }
+    std::string sent;
+    for (const auto& message : messages) {
+      sent += message;
+    }
+    CHECK(received == sent);
+  }
+
+  SECTION("rest of a partially read record") {
+    net::write(client_stream, net::buffer(std::string{"leftover"}));
+    std::array<char, 4> buffer{};
+    net::read(server_stream, net::buffer(buffer));
+    CHECK(std::string(buffer.data(), buffer.size()) == "left");
+    CHECK(to_string(server_stream.read_record()) == "over");
+  }
+
+  SECTION("end of file") {
+    client_stream.shutdown();
+    const auto record = server_stream.read_record(server_ec);
+    CHECK(server_ec == net::error::eof);
+    CHECK(record.empty());
+  }
+}
+
+TEST_CASE("nested streams") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  boost::wintls::stream<test_stream> outer_client(io_context, client_ctx);
+  boost::wintls::stream<test_stream> outer_server(io_context, server_ctx);
+  outer_client.next_layer().connect(outer_server.next_layer());
+
+  using nested_stream = boost::wintls::stream<boost::wintls::stream<test_stream>&>;
+  nested_stream inner_client(outer_client, client_ctx);
+  nested_stream inner_server(outer_server, server_ctx);
+
+  CHECK(outer_client.record_payload_size() == 0);
+
+  auto handshake = [&io_context](auto& client, auto& server) {
+    boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+    client.async_handshake(boost::wintls::handshake_type::client,
+                           [&client_ec](const boost::system::error_code& ec) {
+                             client_ec = ec;
+                           });
+    server.async_handshake(boost::wintls::handshake_type::server,
+                           [&server_ec](const boost::system::error_code& ec) {
+                             server_ec = ec;
+                           });
+    io_context.run();
+    io_context.restart();
+    REQUIRE_FALSE(client_ec);
+    REQUIRE_FALSE(server_ec);
+  };
+  handshake(outer_client, outer_server);
+  handshake(inner_client, inner_server);
+
+  const auto outer_payload_size = outer_client.record_payload_size();
+  CHECK(outer_payload_size > 0);
+  CHECK(inner_client.record_payload_size() > 0);
+  CHECK(inner_client.record_payload_size() <= outer_payload_size);
+
+  std::vector<char> message(0x10000);
+  for (std::size_t i = 0; i < message.size(); ++i) {
+    message[i] = static_cast<char>(i * 7);
+  }
+  std::vector<char> received(message.size());
+
+  const auto outer_records = outer_server.statistics().records;
+  const auto inner_records = inner_server.statistics().records;
+
+  boost::system::error_code write_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code read_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  net::async_write(inner_client, net::buffer(message), [&write_ec](const boost::system::error_code& ec, std::size_t) {
+    write_ec = ec;
+  });
+  net::async_read(inner_server, net::buffer(received), [&read_ec](const boost::system::error_code& ec, std::size_t) {
+    read_ec = ec;
+  });
+  io_context.run();
+  CHECK_FALSE(write_ec);
+  CHECK_FALSE(read_ec);
+  CHECK(received == message);
+
+  // Every inner record was sent in a single outer record
+  CHECK(outer_server.statistics().records - outer_records == inner_server.statistics().records - inner_records);
+}
+
+TEST_CASE("timer wheel") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  boost::wintls::timer_wheel wheel(io_context, std::chrono::milliseconds{10});
+  CHECK(wheel.resolution() == std::chrono::milliseconds{10});
+  boost::wintls::stream_timeouts timeouts;
+  timeouts.handshake = std::chrono::milliseconds{50};
+  timeouts.read = std::chrono::milliseconds{50};
+
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+
+  SECTION("handshake timeout") {
+    client_stream.use_timer_wheel(wheel, timeouts);
+    client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                  [&client_ec](const boost::system::error_code& ec) {
+                                    client_ec = ec;
+                                  });
+    CHECK(wheel.size() == 1);
+    const auto started = std::chrono::steady_clock::now();
+    io_context.run();
+    CHECK(client_ec == net::error::timed_out);
+    CHECK(std::chrono::steady_clock::now() - started >= timeouts.handshake);
+    CHECK(wheel.size() == 0);
+  }
+
+  SECTION("deadlines removed when operations complete") {
+    client_stream.use_timer_wheel(wheel, timeouts);
+    server_stream.use_timer_wheel(wheel, timeouts);
+    client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                  [&client_ec](const boost::system::error_code& ec) {
+                                    client_ec = ec;
+                                  });
+    server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                  [&server_ec](const boost::system::error_code& ec) {
+                                    server_ec = ec;
+                                  });
+    CHECK(wheel.size() == 2);
+    io_context.run();
+    io_context.restart();
+    REQUIRE_FALSE(client_ec);
+    REQUIRE_FALSE(server_ec);
+    CHECK(wheel.size() == 0);
+
+    SECTION("read completing in time") {
+      const std::string message{"hello"};
+      std::array<char, 5> buffer{};
+      server_stream.async_read_some(net::buffer(buffer), [&server_ec](const boost::system::error_code& ec, std::size_t) {
+        server_ec = ec;
+      });
+      net::write(client_stream, net::buffer(message));
+      io_context.run();
+      CHECK_FALSE(server_ec);
+      CHECK(std::string(buffer.data(), buffer.size()) == message);
+      CHECK(wheel.size() == 0);
+    }
+
+    SECTION("read timeout") {
+      std::array<char, 5> buffer{};
+      server_stream.async_read_some(net::buffer(buffer), [&server_ec](const boost::system::error_code& ec, std::size_t) {
+        server_ec = ec;
+      });
+      io_context.run();
+      CHECK(server_ec == net::error::timed_out);
+    }
+
+    SECTION("read timeout with a shutdown in between") {
+      timeouts.shutdown = std::chrono::seconds{10};
+      server_stream.use_timer_wheel(wheel, timeouts);
+      std::array<char, 5> buffer{};
+      server_stream.async_read_some(net::buffer(buffer), [&server_ec](const boost::system::error_code& ec, std::size_t) {
+        server_ec = ec;
+      });
+      boost::system::error_code shutdown_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+      server_stream.async_shutdown([&shutdown_ec](const boost::system::error_code& ec) {
+        shutdown_ec = ec;
+      });
+      io_context.run();
+      CHECK_FALSE(shutdown_ec);
+      CHECK(server_ec == net::error::timed_out);
+      CHECK(wheel.size() == 0);
+    }
+  }
+}
+
+TEST_CASE("rate limits") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_ec](const boost::system::error_code& ec) {
+                                  client_ec = ec;
+                                });
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_ec](const boost::system::error_code& ec) {
+                                  server_ec = ec;
+                                });
+  io_context.run();
+  io_context.restart();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+
+  const std::vector<char> message(0x8000, 'x');
+  std::vector<char> received(message.size());
+  const auto records = server_stream.statistics().records;
+  std::size_t min_records = 1;
+
+  SECTION("write rate") {
+    client_stream.limit_write_rate(0x10000, 0x1000);
+    // Records are no larger than a burst
+    min_records = message.size() / 0x1000;
+  }
+
+  SECTION("read rate") {
+    server_stream.limit_read_rate(0x10000, 0x1000);
+  }
+
+  const auto started = std::chrono::steady_clock::now();
+  net::async_write(client_stream, net::buffer(message), [&client_ec](const boost::system::error_code& ec, std::size_t) {
+    client_ec = ec;
+  });
+  net::async_read(server_stream, net::buffer(received), [&server_ec](const boost::system::error_code& ec, std::size_t) {
+    server_ec = ec;
+  });
+  io_context.run();
+  CHECK_FALSE(client_ec);
+  CHECK_FALSE(server_ec);
+  CHECK(received == message);
+  CHECK(server_stream.statistics().records - records >= min_records);
+
+  // The first burst is sent right away, the rest at the given rate
+  CHECK(std::chrono::steady_clock::now() - started >= std::chrono::milliseconds{400});
+}
+
+TEST_CASE("record layer offload") {
+  net::io_context io_context;
+  wintls_client_context client_ctx;
+  wintls_server_context server_ctx;
+  boost::wintls::stream<test_stream> client_stream(io_context, client_ctx);
+  boost::wintls::stream<test_stream> server_stream(io_context, server_ctx);
+  client_stream.next_layer().connect(server_stream.next_layer());
+
+  boost::system::error_code ec{};
+  client_stream.offload_record_layer(ec);
+  CHECK(ec == net::error::not_connected);
+  client_stream.export_traffic_keys(ec);
+  CHECK(ec == net::error::not_connected);
+
+  boost::system::error_code client_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  boost::system::error_code server_ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+  client_stream.async_handshake(boost::wintls::handshake_type::client,
+                                [&client_ec](const boost::system::error_code& ec) {
+                                  client_ec = ec;
+                                });
+  server_stream.async_handshake(boost::wintls::handshake_type::server,
+                                [&server_ec](const boost::system::error_code& ec) {
+                                  server_ec = ec;
+                                });
+  io_context.run();
+  io_context.restart();
+  REQUIRE_FALSE(client_ec);
+  REQUIRE_FALSE(server_ec);
+
+  // Depends on the version of Schannel, but the only acceptable
+  // failure is the secrets not being provided and the secrets of both
+  // ends must match if available
+  const auto client_keys = client_stream.export_traffic_keys(client_ec);
+  const auto server_keys = server_stream.export_traffic_keys(server_ec);
+  CHECK(client_ec == server_ec);
+  if (client_ec) {
+    CHECK(client_ec == net::error::operation_not_supported);
+  } else {
+    CHECK_FALSE(client_keys.write.cipher.empty());
+    CHECK_FALSE(client_keys.write.hash.empty());
+    CHECK(client_keys.write.key_size != 0);
+    CHECK(client_keys.write.iv_size != 0);
+    CHECK_FALSE(client_keys.write.secret.empty());
+    CHECK(client_keys.write.secret != client_keys.read.secret);
+    CHECK(client_keys.write.secret == server_keys.read.secret);
+    CHECK(client_keys.read.secret == server_keys.write.secret);
+    CHECK(client_keys.write.sequence_number == server_keys.read.sequence_number);
+    CHECK(client_keys.read.sequence_number == server_keys.write.sequence_number);
+  }
+
+  // The test streams stand in for a next layer doing the encryption
+  client_stream.offload_record_layer();
+  server_stream.offload_record_layer();
+
+  const std::string message{"hello"};
+  std::array<char, 5> buffer{};
+  net::async_write(client_stream, net::buffer(message), [&client_ec](const boost::system::error_code& ec, std::size_t) {
+    client_ec = ec;
+  });
+  net::async_read(server_stream.next_layer(), net::buffer(buffer), [&server_ec](const boost::system::error_code& ec, std::size_t) {
+    server_ec = ec;
+  });
+  io_context.run();
+  io_context.restart();
+  CHECK_FALSE(client_ec);
+  CHECK_FALSE(server_ec);
+  CHECK(std::string(buffer.data(), buffer.size()) == message);
+
+  buffer = {};
+  net::write(client_stream.next_layer(), net::buffer(message));
+  net::async_read(server_stream, net::buffer(buffer), [&server_ec](const boost::system::error_code& ec, std::size_t) {
+    server_ec = ec;
+  });
+  io_context.run();
+  CHECK_FALSE(server_ec);
+  CHECK(std::string(buffer.data(), buffer.size()) == message);
+
+  // The sequence numbers are not known anymore once data has been read
+  server_stream.export_traffic_keys(ec);
+  CHECK(ec == net::error::in_progress);
+
+  // Nothing is sent when shutting down, that is up to the next layer
+  const auto written = client_stream.next_layer().nwrite_bytes();
+  client_stream.shutdown(ec);
+  CHECK_FALSE(ec);
+  CHECK(client_stream.next_layer().nwrite_bytes() == written);
+}
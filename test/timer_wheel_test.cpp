@@ -0,0 +1,89 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "unittest.hpp"
+
+#include <boost/wintls/detail/hierarchical_wheel.hpp>
+
+#include <cstdint>
+#include <vector>
+
+TEST_CASE("hierarchical wheel") {
+  using boost::wintls::detail::hierarchical_wheel;
+  using boost::wintls::detail::wheel_entry;
+
+  hierarchical_wheel wheel;
+  wheel.reset(1000);
+
+  // Advances the wheel a tick at a time, recording when every entry expired
+  auto run = [&wheel](std::vector<wheel_entry>& entries, std::uint64_t until) {
+    std::vector<std::uint64_t> expired_at(entries.size(), 0);
+    while (wheel.next_tick() <= until) {
+      const auto now = wheel.next_tick();
+      wheel.advance(now, [&](wheel_entry& entry) {
+        expired_at[static_cast<std::size_t>(&entry - entries.data())] = now;
+      });
+    }
+    return expired_at;
+  };
+
+  SECTION("entries expire at their tick on all levels") {
+    const std::vector<std::uint64_t> ticks{1000, 1001, 1063, 1064, 1065, 1088, 4095, 4096, 5000, 70000, 300000};
+    std::vector<wheel_entry> entries(ticks.size());
+    for (std::size_t i = 0; i < ticks.size(); ++i) {
+      wheel.add(entries[i], ticks[i]);
+    }
+    CHECK(wheel.size() == ticks.size());
+
+    CHECK(run(entries, 300000) == ticks);
+    CHECK(wheel.empty());
+  }
+
+  SECTION("past ticks expire at the next tick") {
+    std::vector<wheel_entry> entries(1);
+    wheel.add(entries[0], 10);
+    CHECK(run(entries, 1000) == std::vector<std::uint64_t>{1000});
+  }
+
+  SECTION("ticks beyond the range of the wheel") {
+    const std::uint64_t far = 1000 + (std::uint64_t{1} << 24) + 100;
+    std::vector<wheel_entry> entries(1);
+    wheel.add(entries[0], far);
+    wheel.advance(far - 1, [](wheel_entry&) {
+      FAIL("expired too early");
+    });
+    CHECK(wheel.size() == 1);
+    CHECK(run(entries, far) == std::vector<std::uint64_t>{far});
+  }
+
+  SECTION("removed entries do not expire") {
+    std::vector<wheel_entry> entries(3);
+    wheel.add(entries[0], 1010);
+    wheel.add(entries[1], 2000);
+    wheel.add(entries[2], 2000);
+    wheel.remove(entries[1]);
+    wheel.remove(entries[1]);
+    CHECK(wheel.size() == 2);
+    CHECK_FALSE(entries[1].linked());
+    CHECK(run(entries, 3000) == std::vector<std::uint64_t>{1010, 0, 2000});
+  }
+
+  SECTION("advancing over many ticks at once") {
+    std::vector<wheel_entry> entries(2);
+    wheel.add(entries[0], 1500);
+    wheel.add(entries[1], 90000);
+    std::size_t expired = 0;
+    wheel.advance(89999, [&expired](wheel_entry&) {
+      ++expired;
+    });
+    CHECK(expired == 1);
+    wheel.advance(90000, [&expired](wheel_entry&) {
+      ++expired;
+    });
+    CHECK(expired == 2);
+  }
+}
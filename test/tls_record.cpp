@@ -50,7 +50,19 @@ tls_record::message_type read_message(tls_record::record_type type, net::const_b
   BOOST_UNREACHABLE_RETURN(0);
 }
 
-tls_handshake::message_type read_message(tls_handshake::handshake_type t, net::const_buffer&) {
+tls_handshake::certificate read_certificate(net::const_buffer& buffer) {
+  tls_handshake::certificate cert;
+  auto list = net::buffer(buffer, read_three_byte_value(buffer));
+  while (list.size() > 0) {
+    const auto size = read_three_byte_value(list);
+    BOOST_ASSERT(list.size() >= size);
+    cert.certificate_list.push_back(net::buffer(list, size));
+    list += size;
+  }
+  return cert;
+}
+
+tls_handshake::message_type read_message(tls_handshake::handshake_type t, net::const_buffer& buffer) {
   switch(t) {
     case tls_handshake::handshake_type::hello_request:
       return tls_handshake::hello_request{};
@@ -59,7 +71,7 @@ tls_handshake::message_type read_message(tls_handshake::handshake_type t, net::c
     case tls_handshake::handshake_type::server_hello:
       return tls_handshake::server_hello{};
     case tls_handshake::handshake_type::certificate:
-      return tls_handshake::certificate{};
+      return read_certificate(buffer);
     case tls_handshake::handshake_type::server_key_exchange:
       return tls_handshake::server_key_exchange{};
     case tls_handshake::handshake_type::certificate_request:
@@ -13,6 +13,7 @@
 #include <boost/variant.hpp>
 
 #include <cstdint>
+#include <vector>
 
 enum class tls_version : std::uint16_t {
   ssl_3_0 = 0x0300,
@@ -56,7 +57,8 @@ struct tls_handshake {
   };
 
   struct certificate {
-    // TODO: Implement
+    // The DER encoded certificates, starting with the sender's own
+    std::vector<net::const_buffer> certificate_list;
   };
 
   struct server_key_exchange {
@@ -0,0 +1,57 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "unittest.hpp"
+
+#include <boost/wintls/detail/token_bucket.hpp>
+
+#include <chrono>
+
+TEST_CASE("token bucket") {
+  using boost::wintls::detail::token_bucket;
+  using clock_type = token_bucket::clock_type;
+  const auto zero = clock_type::duration::zero();
+  const auto start = clock_type::now();
+
+  SECTION("not limited") {
+    token_bucket bucket;
+    CHECK_FALSE(bucket.limited());
+    bucket.consume(0x100000, start);
+    CHECK(bucket.delay(start) == zero);
+  }
+
+  SECTION("default burst size") {
+    const std::size_t min_burst_size = token_bucket::min_burst_size;
+    CHECK(token_bucket(1000, 0, start).burst_size() == min_burst_size);
+    CHECK(token_bucket(1000000, 0, start).burst_size() == 100000);
+    CHECK(token_bucket(1000000, 5000, start).burst_size() == 5000);
+  }
+
+  SECTION("sending waits for the bucket to refill") {
+    token_bucket bucket(1000, 500, start);
+    CHECK(bucket.limited());
+    CHECK(bucket.delay(start) == zero);
+
+    bucket.consume(500, start);
+    const auto empty_delay = bucket.delay(start);
+    CHECK(empty_delay > zero);
+    CHECK(empty_delay <= std::chrono::milliseconds{2});
+
+    bucket.consume(1000, start);
+    const auto debt_delay = bucket.delay(start);
+    CHECK(debt_delay >= std::chrono::seconds{1});
+    CHECK(debt_delay <= std::chrono::milliseconds{1002});
+    CHECK(bucket.delay(start + debt_delay) == zero);
+  }
+
+  SECTION("bursts are limited") {
+    token_bucket bucket(1000, 500, start);
+    const auto later = start + std::chrono::seconds{10};
+    bucket.consume(501, later);
+    CHECK(bucket.delay(later) > zero);
+  }
+}
@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "unittest.hpp"
+
+#include <boost/wintls/detail/make_traffic_secret.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// Stands in for the SEC_TRAFFIC_SECRETS structure filled by Schannel
+struct test_traffic_secrets {
+  wchar_t SymmetricAlgId[64];
+  wchar_t ChainingMode[64];
+  wchar_t HashAlgId[64];
+  unsigned short KeySize;
+  unsigned short IvSize;
+  unsigned short MsgSequenceStart;
+  unsigned short MsgSequenceEnd;
+  unsigned short TrafficSecretSize;
+  unsigned char TrafficSecret[48];
+};
+
+} // namespace
+
+TEST_CASE("traffic secrets") {
+  test_traffic_secrets secrets{L"AES", L"ChainingModeGCM", L"SHA384", 32, 12, 1, 0, 48, {}};
+  for (unsigned char i = 0; i < 48; ++i) {
+    secrets.TrafficSecret[i] = i;
+  }
+
+  SECTION("all fields are converted") {
+    const auto secret = boost::wintls::detail::make_traffic_secret(secrets);
+    CHECK(secret.cipher == "AES");
+    CHECK(secret.chaining_mode == "ChainingModeGCM");
+    CHECK(secret.hash == "SHA384");
+    CHECK(secret.key_size == 32);
+    CHECK(secret.iv_size == 12);
+    CHECK(secret.sequence_number == 1);
+    REQUIRE(secret.secret.size() == 48);
+    CHECK(secret.secret.front() == 0);
+    CHECK(secret.secret.back() == 47);
+  }
+
+  SECTION("only the size given is copied") {
+    secrets.TrafficSecretSize = 32;
+    const auto secret = boost::wintls::detail::make_traffic_secret(secrets);
+    CHECK(secret.secret == std::vector<unsigned char>(secrets.TrafficSecret, secrets.TrafficSecret + 32));
+  }
+
+  SECTION("identifiers filling the whole array") {
+    for (auto& c : secrets.HashAlgId) {
+      c = L'X';
+    }
+    const auto secret = boost::wintls::detail::make_traffic_secret(secrets);
+    CHECK(secret.hash == std::string(64, 'X'));
+  }
+}
@@ -39,6 +39,11 @@ inline std::vector<char> test_key_bytes() {
   return {std::istreambuf_iterator<char>{ifs}, {}};
 }
 
+inline std::vector<char> test_binary_file_bytes(const char* path) {
+  std::ifstream ifs{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{ifs}, {}};
+}
+
 namespace net = boost::wintls::net;
 namespace asio_ssl = boost::asio::ssl;
 using test_stream = boost::beast::test::stream;
@@ -0,0 +1,506 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// HTTPS load generator built on Boost.Wintls.
+//
+// Drives a number of concurrent keep-alive connections, each with a
+// configurable number of pipelined requests, and reports requests per
+// second, latency percentiles and how the time was split between TLS
+// handshakes and transferring data.
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/version.hpp>
+
+#include <boost/wintls.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace beast = boost::beast;   // from <boost/beast.hpp>
+namespace http = beast::http;     // from <boost/beast/http.hpp>
+namespace net = boost::asio;      // from <boost/asio.hpp>
+namespace ssl = boost::wintls;    // from <boost/wintls/wintls.hpp>
+
+using tcp = boost::asio::ip::tcp; // from <boost/asio/ip/tcp.hpp>
+using clock_type = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+
+enum class handshake_mode {
+  // Share one context between all connections allowing TLS sessions
+  // to be resumed when reconnecting
+  resume,
+  // Use a new context for every connection forcing full handshakes
+  full
+};
+
+struct options {
+  std::string host;
+  std::string port;
+  std::string path;
+  std::size_t connections = 10;
+  std::size_t pipeline = 1;
+  std::size_t requests = 0;
+  std::size_t requests_per_connection = 0;
+  std::size_t threads = 1;
+  std::chrono::seconds duration{10};
+  handshake_mode handshake = handshake_mode::resume;
+  bool verify = true;
+};
+
+// Statistics gathered by all connections running on the same thread
+struct statistics {
+  std::vector<clock_type::duration> latencies;
+  std::vector<clock_type::duration> handshakes;
+  clock_type::duration handshake_time{};
+  clock_type::duration transfer_time{};
+  std::uint64_t bytes_received = 0;
+  std::size_t errors = 0;
+  std::size_t bad_status = 0;
+
+  void merge(const statistics& other) {
+    latencies.insert(latencies.end(), other.latencies.begin(), other.latencies.end());
+    handshakes.insert(handshakes.end(), other.handshakes.begin(), other.handshakes.end());
+    handshake_time += other.handshake_time;
+    transfer_time += other.transfer_time;
+    bytes_received += other.bytes_received;
+    errors += other.errors;
+    bad_status += other.bad_status;
+  }
+};
+
+// Decides when to stop issuing requests. Shared between all threads.
+class request_budget {
+public:
+  explicit request_budget(const options& opts)
+    : remaining_(static_cast<std::int64_t>(opts.requests))
+    , unlimited_(opts.requests == 0)
+    , deadline_(clock_type::now() + opts.duration) {
+  }
+
+  bool take() {
+    if (unlimited_) {
+      return clock_type::now() < deadline_;
+    }
+    return remaining_.fetch_sub(1) > 0;
+  }
+
+  bool exhausted() const {
+    if (unlimited_) {
+      return clock_type::now() >= deadline_;
+    }
+    return remaining_.load() <= 0;
+  }
+
+private:
+  std::atomic<std::int64_t> remaining_;
+  const bool unlimited_;
+  const clock_type::time_point deadline_;
+};
+
+//------------------------------------------------------------------------------
+
+// Runs keep-alive HTTP requests on a single connection, reconnecting
+// when the server closes the connection or when the configured number
+// of requests per connection has been reached.
+class connection : public std::enable_shared_from_this<connection> {
+public:
+  connection(net::io_context& ioc,
+             ssl::context& shared_ctx,
+             const tcp::resolver::results_type& endpoints,
+             const options& opts,
+             request_budget& budget,
+             statistics& stats)
+    : ioc_(ioc)
+    , shared_ctx_(shared_ctx)
+    , endpoints_(endpoints)
+    , opts_(opts)
+    , budget_(budget)
+    , stats_(stats) {
+    req_.version(11);
+    req_.method(http::verb::get);
+    req_.target(opts_.path);
+    req_.set(http::field::host, opts_.host);
+    req_.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+  }
+
+  void start() {
+    do_connect();
+  }
+
+private:
+  ssl::context& context() {
+    if (opts_.handshake == handshake_mode::full) {
+      return *own_ctx_;
+    }
+    return shared_ctx_;
+  }
+
+  void do_connect() {
+    if (budget_.exhausted()) {
+      return;
+    }
+
+    stream_.reset();
+    in_flight_.clear();
+    failed_ = false;
+    if (opts_.handshake == handshake_mode::full) {
+      own_ctx_ = std::make_unique<ssl::context>(ssl::method::system_default);
+      own_ctx_->use_default_certificates(true);
+      own_ctx_->verify_server_certificate(opts_.verify);
+    }
+    stream_ = std::make_unique<ssl::stream<beast::tcp_stream>>(ioc_, context());
+    stream_->set_server_hostname(opts_.host);
+    buffer_.clear();
+    sent_on_connection_ = 0;
+
+    beast::get_lowest_layer(*stream_).expires_after(std::chrono::seconds(30));
+    beast::get_lowest_layer(*stream_).async_connect(endpoints_,
+                                                    beast::bind_front_handler(&connection::on_connect, shared_from_this()));
+  }
+
+  void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type) {
+    if (ec) {
+      return fail(ec, "connect");
+    }
+
+    handshake_started_ = clock_type::now();
+    stream_->async_handshake(ssl::handshake_type::client,
+                             beast::bind_front_handler(&connection::on_handshake, shared_from_this()));
+  }
+
+  void on_handshake(beast::error_code ec) {
+    if (ec) {
+      return fail(ec, "handshake");
+    }
+
+    connected_ = clock_type::now();
+    const auto handshake_duration = connected_ - handshake_started_;
+    stats_.handshakes.push_back(handshake_duration);
+    stats_.handshake_time += handshake_duration;
+
+    do_write();
+  }
+
+  bool connection_exhausted() const {
+    return opts_.requests_per_connection != 0 && sent_on_connection_ >= opts_.requests_per_connection;
+  }
+
+  void do_write() {
+    if (writing_ || in_flight_.size() >= opts_.pipeline || connection_exhausted() || !budget_.take()) {
+      do_read();
+      return;
+    }
+
+    writing_ = true;
+    ++sent_on_connection_;
+    req_.keep_alive(!connection_exhausted());
+    in_flight_.push_back(clock_type::now());
+
+    beast::get_lowest_layer(*stream_).expires_after(std::chrono::seconds(30));
+    http::async_write(*stream_, req_, beast::bind_front_handler(&connection::on_write, shared_from_this()));
+    do_read();
+  }
+
+  void on_write(beast::error_code ec, std::size_t) {
+    writing_ = false;
+    if (ec || failed_) {
+      return fail_transfer(ec, "write");
+    }
+    do_write();
+  }
+
+  void do_read() {
+    if (reading_ || in_flight_.empty()) {
+      return;
+    }
+
+    reading_ = true;
+    res_ = {};
+    http::async_read(*stream_, buffer_, res_, beast::bind_front_handler(&connection::on_read, shared_from_this()));
+  }
+
+  void on_read(beast::error_code ec, std::size_t bytes_transferred) {
+    reading_ = false;
+    if (ec || failed_) {
+      return fail_transfer(ec, "read");
+    }
+
+    stats_.latencies.push_back(clock_type::now() - in_flight_.front());
+    stats_.bytes_received += bytes_transferred;
+    if (res_.result_int() >= 400) {
+      ++stats_.bad_status;
+    }
+    in_flight_.pop_front();
+
+    if (!in_flight_.empty() || writing_) {
+      do_write();
+      return;
+    }
+
+    if (!res_.keep_alive() || connection_exhausted() || budget_.exhausted()) {
+      do_shutdown();
+      return;
+    }
+
+    do_write();
+  }
+
+  void do_shutdown() {
+    stats_.transfer_time += clock_type::now() - connected_;
+    beast::get_lowest_layer(*stream_).expires_after(std::chrono::seconds(30));
+    stream_->async_shutdown(beast::bind_front_handler(&connection::on_shutdown, shared_from_this()));
+  }
+
+  void on_shutdown(beast::error_code) {
+    // Errors during shutdown are expected as the server might just
+    // close the connection after receiving a close_notify
+    beast::error_code ec;
+    beast::get_lowest_layer(*stream_).socket().close(ec);
+    do_connect();
+  }
+
+  void fail(beast::error_code ec, const char* what) {
+    ++stats_.errors;
+    std::cerr << what << ": " << ec.message() << "\n";
+  }
+
+  // Gives up on the current connection, e.g. closed by the server
+  // while idle, and makes a new one once neither a read nor a write
+  // is pending on it anymore
+  void fail_transfer(beast::error_code ec, const char* what) {
+    if (!failed_) {
+      failed_ = true;
+      stats_.transfer_time += clock_type::now() - connected_;
+      fail(ec, what);
+      beast::error_code ignored;
+      beast::get_lowest_layer(*stream_).socket().close(ignored);
+    }
+    if (reading_ || writing_) {
+      return;
+    }
+    do_connect();
+  }
+
+  net::io_context& ioc_;
+  ssl::context& shared_ctx_;
+  const tcp::resolver::results_type& endpoints_;
+  const options& opts_;
+  request_budget& budget_;
+  statistics& stats_;
+
+  std::unique_ptr<ssl::context> own_ctx_;
+  std::unique_ptr<ssl::stream<beast::tcp_stream>> stream_;
+  beast::flat_buffer buffer_;
+  http::request<http::empty_body> req_;
+  http::response<http::string_body> res_;
+  std::deque<clock_type::time_point> in_flight_;
+  std::size_t sent_on_connection_ = 0;
+  bool writing_ = false;
+  bool reading_ = false;
+  bool failed_ = false;
+  clock_type::time_point handshake_started_;
+  clock_type::time_point connected_;
+};
+
+//------------------------------------------------------------------------------
+
+double to_ms(clock_type::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+clock_type::duration percentile(const std::vector<clock_type::duration>& sorted, double p) {
+  if (sorted.empty()) {
+    return {};
+  }
+  const auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+  return sorted[std::min(sorted.size() - 1, std::max<std::size_t>(rank, 1) - 1)];
+}
+
+void print_percentiles(const char* title, std::vector<clock_type::duration> values) {
+  std::sort(values.begin(), values.end());
+  std::cout << std::left << std::setw(18) << title << std::right << std::fixed << std::setprecision(3);
+  const std::pair<const char*, double> percentiles[] = {{"p50", 50.0}, {"p90", 90.0}, {"p99", 99.0}, {"p99.9", 99.9}};
+  for (const auto& p : percentiles) {
+    std::cout << " " << p.first << " " << to_ms(percentile(values, p.second));
+  }
+  std::cout << " max " << (values.empty() ? 0.0 : to_ms(values.back())) << "\n";
+}
+
+void report(const options& opts, const statistics& stats, clock_type::duration elapsed) {
+  const auto seconds = std::chrono::duration<double>(elapsed).count();
+  const auto completed = stats.latencies.size();
+  const auto total_time = stats.handshake_time + stats.transfer_time;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Connections:       " << opts.connections << " (pipeline depth " << opts.pipeline
+            << ", " << opts.threads << " thread(s))\n";
+  std::cout << "Duration:          " << seconds << " s\n";
+  std::cout << "Requests:          " << completed << " completed, " << stats.bad_status
+            << " with error status, " << stats.errors << " connection errors\n";
+  std::cout << "Requests/sec:      " << static_cast<double>(completed) / seconds << "\n";
+  std::cout << "Transfer/sec:      " << static_cast<double>(stats.bytes_received) / seconds / (1024 * 1024) << " MiB\n";
+  print_percentiles("Latency (ms):", stats.latencies);
+  std::cout << "Handshakes:        " << stats.handshakes.size() << " ("
+            << (opts.handshake == handshake_mode::full ? "full" : "resumption allowed") << ")\n";
+  print_percentiles("Handshake (ms):", stats.handshakes);
+  if (total_time.count() > 0) {
+    const auto handshake_share = 100.0 * to_ms(stats.handshake_time) / to_ms(total_time);
+    std::cout << "Time split:        handshake " << std::setprecision(1) << handshake_share
+              << " %, transfer " << 100.0 - handshake_share << " %\n";
+  }
+}
+
+void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [options] <https-url>\n\n"
+            << "Options:\n"
+            << "  -c, --connections N       Number of concurrent connections (default: 10)\n"
+            << "  -p, --pipeline N          Pipelined requests in flight per connection (default: 1)\n"
+            << "  -n, --requests N          Total number of requests to perform\n"
+            << "  -d, --duration SECONDS    Duration of the test if no number of requests is given (default: 10)\n"
+            << "  -r, --reconnect N         Reconnect after N requests per connection (default: 0, keep-alive)\n"
+            << "  -t, --threads N           Number of threads each running their own io_context (default: 1)\n"
+            << "  --handshake full|resume   Use a new context per connection forcing full handshakes\n"
+            << "                            or share one context allowing resumption (default: resume)\n"
+            << "  -k, --insecure            Do not verify the server certificate\n\n"
+            << "Example: " << name << " -c 100 -p 4 -d 30 https://localhost:8443/\n";
+}
+
+bool parse_options(int argc, char** argv, options& opts) {
+  std::string url;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg{argv[i]};
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("missing value for " + arg);
+      }
+      return argv[++i];
+    };
+    auto next_number = [&]() -> std::size_t {
+      return static_cast<std::size_t>(std::stoul(next()));
+    };
+
+    if (arg == "-c" || arg == "--connections") {
+      opts.connections = next_number();
+    } else if (arg == "-p" || arg == "--pipeline") {
+      opts.pipeline = next_number();
+    } else if (arg == "-n" || arg == "--requests") {
+      opts.requests = next_number();
+    } else if (arg == "-d" || arg == "--duration") {
+      opts.duration = std::chrono::seconds(next_number());
+    } else if (arg == "-r" || arg == "--reconnect") {
+      opts.requests_per_connection = next_number();
+    } else if (arg == "-t" || arg == "--threads") {
+      opts.threads = next_number();
+    } else if (arg == "--handshake") {
+      const auto mode = next();
+      if (mode == "full") {
+        opts.handshake = handshake_mode::full;
+      } else if (mode == "resume") {
+        opts.handshake = handshake_mode::resume;
+      } else {
+        throw std::invalid_argument("invalid handshake mode: " + mode);
+      }
+    } else if (arg == "-k" || arg == "--insecure") {
+      opts.verify = false;
+    } else if (url.empty() && arg.compare(0, 1, "-") != 0) {
+      url = arg;
+    } else {
+      throw std::invalid_argument("unknown option: " + arg);
+    }
+  }
+
+  if (url.empty() || opts.connections == 0 || opts.pipeline == 0 || opts.threads == 0) {
+    return false;
+  }
+
+  // Very basic URL matching. Not a full URL validator.
+  std::regex re("https://([^/$:]+):?([^/$]*)(/?.*)");
+  std::smatch what;
+  if (!regex_match(url, what, re)) {
+    throw std::invalid_argument("invalid or unsupported URL: " + url);
+  }
+  opts.host = what[1];
+  opts.port = what[2].length() > 0 ? what[2].str() : "443";
+  opts.path = what[3].length() > 0 ? what[3].str() : "/";
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  options opts;
+  try {
+    if (!parse_options(argc, argv, opts)) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n\n";
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    net::io_context resolver_ioc;
+    tcp::resolver resolver{resolver_ioc};
+    const auto endpoints = resolver.resolve(opts.host, opts.port);
+
+    ssl::context ctx{ssl::method::system_default};
+    ctx.use_default_certificates(true);
+    ctx.verify_server_certificate(opts.verify);
+
+    // One io_context per thread, each with its own statistics so no
+    // synchronization is needed while running
+    std::vector<std::unique_ptr<net::io_context>> contexts;
+    std::vector<statistics> stats(opts.threads);
+    for (std::size_t i = 0; i < opts.threads; ++i) {
+      contexts.push_back(std::make_unique<net::io_context>(1));
+    }
+
+    request_budget budget{opts};
+    for (std::size_t i = 0; i < opts.connections; ++i) {
+      const auto n = i % opts.threads;
+      std::make_shared<connection>(*contexts[n], ctx, endpoints, opts, budget, stats[n])->start();
+    }
+
+    const auto started = clock_type::now();
+    std::vector<std::thread> threads;
+    for (auto& ioc : contexts) {
+      threads.emplace_back([&ioc] { ioc->run(); });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    const auto elapsed = clock_type::now() - started;
+
+    statistics total;
+    for (const auto& s : stats) {
+      total.merge(s);
+    }
+    report(opts, total, elapsed);
+  } catch (const std::exception& e) {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// PEM and base64 decoding benchmark.
+//
+// Decodes a bundle of PEM encoded certificates, either read from a
+// file or made up of random data, and reports the throughput of
+// splitting the bundle into objects, of decoding each object and of
+// decoding the base64 data alone.
+//
+// Only depends on the portable PEM decoder of Boost.Wintls, so it can
+// be built on any platform. Which base64 decoder is used depends on
+// the instruction set targeted by the compiler, so it is built once
+// for each of them.
+
+#include <boost/wintls/detail/pem.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace net = boost::asio;                  // from <boost/asio.hpp>
+namespace detail = boost::wintls::detail;     // from <boost/wintls/detail/pem.hpp>
+
+using clock_type = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+
+struct options {
+  std::string pem_file;
+  std::size_t objects = 1000;
+  std::size_t object_size = 1200;
+  std::size_t rounds = 100;
+};
+
+//------------------------------------------------------------------------------
+
+// Base64 encodes the data with line breaks like a PEM file
+std::string encode(const std::vector<std::uint8_t>& data) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string base64;
+  for (std::size_t i = 0; i < data.size(); i += 3) {
+    std::uint32_t group = static_cast<std::uint32_t>(data[i]) << 16;
+    if (i + 1 < data.size()) {
+      group |= static_cast<std::uint32_t>(data[i + 1]) << 8;
+    }
+    if (i + 2 < data.size()) {
+      group |= data[i + 2];
+    }
+    base64 += alphabet[group >> 18 & 0x3f];
+    base64 += alphabet[group >> 12 & 0x3f];
+    base64 += i + 1 < data.size() ? alphabet[group >> 6 & 0x3f] : '=';
+    base64 += i + 2 < data.size() ? alphabet[group & 0x3f] : '=';
+  }
+
+  std::string lines;
+  for (std::size_t i = 0; i < base64.size(); i += 64) {
+    lines += base64.substr(i, 64) + "\n";
+  }
+  return lines;
+}
+
+// A bundle of objects of random data looking like certificates
+std::string make_bundle(const options& opts) {
+  std::mt19937 generator;
+  std::uniform_int_distribution<int> distribution(0, 255);
+  std::string bundle;
+  for (std::size_t i = 0; i < opts.objects; ++i) {
+    std::vector<std::uint8_t> data(opts.object_size);
+    for (auto& byte : data) {
+      byte = static_cast<std::uint8_t>(distribution(generator));
+    }
+    bundle += "-----BEGIN CERTIFICATE-----\n" + encode(data) + "-----END CERTIFICATE-----\n";
+  }
+  return bundle;
+}
+
+template <class Function>
+double mib_per_second(std::size_t size, std::size_t rounds, Function&& function) {
+  const auto start = clock_type::now();
+  for (std::size_t i = 0; i < rounds; ++i) {
+    function();
+  }
+  const std::chrono::duration<double> elapsed = clock_type::now() - start;
+  return elapsed.count() > 0 ? static_cast<double>(size) * rounds / elapsed.count() / (1024 * 1024) : 0;
+}
+
+void run(const std::string& bundle, const options& opts) {
+  const auto objects = detail::pem_split(net::buffer(bundle), "CERTIFICATE");
+  if (objects.empty()) {
+    throw std::runtime_error("no certificates found");
+  }
+
+  // The base64 data of the objects without the header and footer
+  std::vector<std::string> bodies;
+  for (const auto& object : objects) {
+    const std::string text(static_cast<const char*>(object.data()), object.size());
+    const auto begin = text.find('\n') + 1;
+    bodies.push_back(text.substr(begin, text.rfind("-----END") - begin));
+  }
+  std::vector<std::uint8_t> output(detail::base64_decoded_size(bundle.size()));
+
+  std::size_t decoded = 0;
+  const auto split = mib_per_second(bundle.size(), opts.rounds, [&bundle, &decoded] {
+    decoded += detail::pem_split(net::buffer(bundle), "CERTIFICATE").size();
+  });
+  const auto pem = mib_per_second(bundle.size(), opts.rounds, [&objects, &decoded] {
+    for (const auto& object : objects) {
+      decoded += detail::pem_decode(object).size();
+    }
+  });
+  std::size_t base64_size = 0;
+  for (const auto& body : bodies) {
+    base64_size += body.size();
+  }
+  const auto base64 = mib_per_second(base64_size, opts.rounds, [&bodies, &output, &decoded] {
+    for (const auto& body : bodies) {
+      decoded += detail::base64_decode(net::buffer(body), net::buffer(output));
+    }
+  });
+
+#ifdef BOOST_WINTLS_BASE64_SSSE3
+  std::cout << "Base64 decoder:    " << (detail::base64::cpu_has_ssse3() ? "SSSE3" : "scalar") << "\n";
+#else
+  std::cout << "Base64 decoder:    scalar\n";
+#endif
+  std::cout << "Objects:           " << objects.size() << " (" << bundle.size() << " bytes)\n"
+            << std::fixed << std::setprecision(1)
+            << "pem_split:         " << split << " MiB/s\n"
+            << "pem_decode:        " << pem << " MiB/s\n"
+            << "base64_decode:     " << base64 << " MiB/s\n";
+
+  // Keeps the decoding from being optimized away
+  if (decoded == 0) {
+    throw std::runtime_error("nothing decoded");
+  }
+}
+
+void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [options] [pem-file]\n\n"
+            << "Options:\n"
+            << "  -n, --objects COUNT       Number of certificates when not using a file (default: 1000)\n"
+            << "  -s, --size BYTES          Size of each certificate when not using a file (default: 1200)\n"
+            << "  -r, --rounds COUNT        Number of times to decode everything (default: 100)\n\n"
+            << "Without a file, a bundle of random data encoded like certificates is used.\n\n"
+            << "Example: " << name << " -r 10 /etc/ssl/certs/ca-certificates.crt\n";
+}
+
+bool parse_options(int argc, char** argv, options& opts) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg{argv[i]};
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("missing value for " + arg);
+      }
+      return argv[++i];
+    };
+    auto next_number = [&]() -> std::size_t {
+      return static_cast<std::size_t>(std::stoul(next()));
+    };
+
+    if (arg == "-n" || arg == "--objects") {
+      opts.objects = next_number();
+    } else if (arg == "-s" || arg == "--size") {
+      opts.object_size = next_number();
+    } else if (arg == "-r" || arg == "--rounds") {
+      opts.rounds = next_number();
+    } else if (opts.pem_file.empty() && arg.compare(0, 1, "-") != 0) {
+      opts.pem_file = arg;
+    } else {
+      throw std::invalid_argument("unknown option: " + arg);
+    }
+  }
+
+  return opts.objects != 0 && opts.object_size != 0 && opts.rounds != 0;
+}
+
+std::string read_file(const std::string& filename) {
+  std::ifstream ifs{filename, std::ios::binary};
+  if (!ifs) {
+    throw std::runtime_error("unable to open: " + filename);
+  }
+  return {std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  options opts;
+  try {
+    if (!parse_options(argc, argv, opts)) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n\n";
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const auto bundle = opts.pem_file.empty() ? make_bundle(opts) : read_file(opts.pem_file);
+    run(bundle, opts);
+  } catch (const std::exception& e) {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
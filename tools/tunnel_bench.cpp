@@ -0,0 +1,293 @@
+//
+// Copyright (c) 2021 Kasper Laudrup (laudrup at stacktrace dot dk)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// TLS tunnel throughput benchmark built on Boost.Wintls.
+//
+// Transfers data over a loopback TCP connection, once using a single
+// TLS stream and once using a TLS stream running through another TLS
+// stream, as when tunnelling TLS through a TLS connection to a CONNECT
+// proxy, and reports the throughput and the number of records and
+// reads needed by the receiving streams.
+
+#include <boost/wintls.hpp>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace net = boost::asio;      // from <boost/asio.hpp>
+namespace ssl = boost::wintls;    // from <boost/wintls/wintls.hpp>
+
+using tcp = boost::asio::ip::tcp; // from <boost/asio/ip/tcp.hpp>
+using clock_type = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+
+struct options {
+  std::string pkcs12_file;
+  std::string password;
+  std::size_t megabytes = 256;
+  std::size_t chunk_size = 64 * 1024;
+};
+
+struct result {
+  clock_type::duration elapsed{};
+  std::uint64_t bytes = 0;
+  ssl::stream_statistics inner;
+  ssl::stream_statistics outer;
+};
+
+//------------------------------------------------------------------------------
+
+// Connects two sockets over the loopback interface
+void connect_pair(net::io_context& ioc, tcp::socket& client, tcp::socket& server) {
+  tcp::acceptor acceptor{ioc, tcp::endpoint{net::ip::address_v4::loopback(), 0}};
+  client.connect(acceptor.local_endpoint());
+  acceptor.accept(server);
+  client.set_option(tcp::no_delay(true));
+  server.set_option(tcp::no_delay(true));
+}
+
+template <class Client, class Server>
+void handshake(net::io_context& ioc, Client& client, Server& server) {
+  boost::system::error_code client_ec;
+  boost::system::error_code server_ec;
+  client.async_handshake(ssl::handshake_type::client, [&client_ec](const boost::system::error_code& ec) {
+    client_ec = ec;
+  });
+  server.async_handshake(ssl::handshake_type::server, [&server_ec](const boost::system::error_code& ec) {
+    server_ec = ec;
+  });
+  ioc.run();
+  ioc.restart();
+  if (client_ec) {
+    throw boost::system::system_error(client_ec, "client handshake");
+  }
+  if (server_ec) {
+    throw boost::system::system_error(server_ec, "server handshake");
+  }
+}
+
+// Writes the data in chunks from the sender while reading it all on
+// the receiver
+template <class Sender, class Receiver>
+result transfer(net::io_context& ioc, Sender& sender, Receiver& receiver, const options& opts) {
+  const std::vector<char> chunk(opts.chunk_size, 'x');
+  std::vector<char> received(opts.chunk_size);
+  const std::uint64_t total = static_cast<std::uint64_t>(opts.megabytes) * 1024 * 1024;
+
+  std::uint64_t written = 0;
+  std::uint64_t read = 0;
+  boost::system::error_code error;
+
+  std::function<void()> do_write = [&]() {
+    if (written >= total || error) {
+      return;
+    }
+    net::async_write(sender, net::buffer(chunk), [&](const boost::system::error_code& ec, std::size_t size) {
+      written += size;
+      if (ec) {
+        error = ec;
+        return;
+      }
+      do_write();
+    });
+  };
+
+  std::function<void()> do_read = [&]() {
+    if (read >= total || error) {
+      return;
+    }
+    net::async_read(receiver, net::buffer(received), [&](const boost::system::error_code& ec, std::size_t size) {
+      read += size;
+      if (ec) {
+        error = ec;
+        return;
+      }
+      do_read();
+    });
+  };
+
+  const auto started = clock_type::now();
+  do_write();
+  do_read();
+  ioc.run();
+  ioc.restart();
+
+  if (error) {
+    throw boost::system::system_error(error, "transfer");
+  }
+
+  result res;
+  res.elapsed = clock_type::now() - started;
+  res.bytes = read;
+  return res;
+}
+
+template <class Stream>
+ssl::stream_statistics difference(Stream& stream, const ssl::stream_statistics& before) {
+  auto after = stream.statistics();
+  after.reads -= before.reads;
+  after.bytes_read -= before.bytes_read;
+  after.records -= before.records;
+  return after;
+}
+
+result run_single(net::io_context& ioc, ssl::context& client_ctx, ssl::context& server_ctx, const options& opts) {
+  ssl::stream<tcp::socket> client{ioc, client_ctx};
+  ssl::stream<tcp::socket> server{ioc, server_ctx};
+  connect_pair(ioc, client.next_layer(), server.next_layer());
+  handshake(ioc, client, server);
+
+  const auto before = server.statistics();
+  auto res = transfer(ioc, client, server, opts);
+  res.inner = difference(server, before);
+  return res;
+}
+
+result run_tunnel(net::io_context& ioc, ssl::context& client_ctx, ssl::context& server_ctx, const options& opts) {
+  ssl::stream<tcp::socket> outer_client{ioc, client_ctx};
+  ssl::stream<tcp::socket> outer_server{ioc, server_ctx};
+  connect_pair(ioc, outer_client.next_layer(), outer_server.next_layer());
+  handshake(ioc, outer_client, outer_server);
+
+  ssl::stream<ssl::stream<tcp::socket>&> inner_client{outer_client, client_ctx};
+  ssl::stream<ssl::stream<tcp::socket>&> inner_server{outer_server, server_ctx};
+  handshake(ioc, inner_client, inner_server);
+
+  const auto inner_before = inner_server.statistics();
+  const auto outer_before = outer_server.statistics();
+  auto res = transfer(ioc, inner_client, inner_server, opts);
+  res.inner = difference(inner_server, inner_before);
+  res.outer = difference(outer_server, outer_before);
+  return res;
+}
+
+//------------------------------------------------------------------------------
+
+double mib_per_second(const result& res) {
+  const auto seconds = std::chrono::duration<double>(res.elapsed).count();
+  return seconds > 0 ? static_cast<double>(res.bytes) / seconds / (1024 * 1024) : 0.0;
+}
+
+void print_layer(const char* title, const ssl::stream_statistics& stats) {
+  std::cout << "  " << std::left << std::setw(16) << title << std::right
+            << stats.records << " records, " << stats.reads << " reads, "
+            << stats.bytes_read << " bytes read\n";
+}
+
+void report(const result& single, const result& tunnel) {
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Single TLS layer:  " << mib_per_second(single) << " MiB/s\n";
+  print_layer("receiver:", single.inner);
+  std::cout << "TLS in TLS:        " << mib_per_second(tunnel) << " MiB/s\n";
+  print_layer("inner receiver:", tunnel.inner);
+  print_layer("outer receiver:", tunnel.outer);
+  if (mib_per_second(single) > 0) {
+    std::cout << "Relative:          " << std::setprecision(1)
+              << 100.0 * mib_per_second(tunnel) / mib_per_second(single) << " %\n";
+  }
+}
+
+void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [options] <pkcs12-file>\n\n"
+            << "Options:\n"
+            << "  -P, --password PASSWORD   Password of the PKCS#12 file (default: empty)\n"
+            << "  -s, --size MIB            Amount of data to transfer per run (default: 256)\n"
+            << "  -b, --chunk KIB           Size of each write (default: 64)\n\n"
+            << "The PKCS#12 file holds the certificate and private key used by the servers.\n\n"
+            << "Example: " << name << " -s 1024 server.pfx\n";
+}
+
+bool parse_options(int argc, char** argv, options& opts) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg{argv[i]};
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("missing value for " + arg);
+      }
+      return argv[++i];
+    };
+    auto next_number = [&]() -> std::size_t {
+      return static_cast<std::size_t>(std::stoul(next()));
+    };
+
+    if (arg == "-P" || arg == "--password") {
+      opts.password = next();
+    } else if (arg == "-s" || arg == "--size") {
+      opts.megabytes = next_number();
+    } else if (arg == "-b" || arg == "--chunk") {
+      opts.chunk_size = next_number() * 1024;
+    } else if (opts.pkcs12_file.empty() && arg.compare(0, 1, "-") != 0) {
+      opts.pkcs12_file = arg;
+    } else {
+      throw std::invalid_argument("unknown option: " + arg);
+    }
+  }
+
+  return !opts.pkcs12_file.empty() && opts.megabytes != 0 && opts.chunk_size != 0;
+}
+
+std::vector<char> read_file(const std::string& filename) {
+  std::ifstream ifs{filename, std::ios::binary};
+  if (!ifs) {
+    throw std::runtime_error("unable to open: " + filename);
+  }
+  return {std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  options opts;
+  try {
+    if (!parse_options(argc, argv, opts)) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n\n";
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const auto pkcs12 = read_file(opts.pkcs12_file);
+    const auto certificate = ssl::pkcs12_to_cert_context(net::buffer(pkcs12), opts.password);
+
+    ssl::context server_ctx{ssl::method::system_default};
+    server_ctx.use_certificate(certificate.get());
+
+    // The servers use whatever certificate was given, so it is not
+    // verified by the clients
+    ssl::context client_ctx{ssl::method::system_default};
+    client_ctx.verify_server_certificate(false);
+
+    net::io_context ioc{1};
+    const auto single = run_single(ioc, client_ctx, server_ctx, opts);
+    const auto tunnel = run_tunnel(ioc, client_ctx, server_ctx, opts);
+    report(single, tunnel);
+  } catch (const std::exception& e) {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}